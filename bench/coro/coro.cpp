@@ -0,0 +1,81 @@
+#include "fib.h"
+#include "deadlock/coro.hpp"
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+
+namespace {
+
+dl::coro<long>
+fib(int n)
+{
+	if (n < 2)
+		co_return n;
+	dl::coro<long> a = fib(n - 1);
+	dl::coro<long> b = fib(n - 2);
+	co_await dl::when_all(a, b);
+	co_return a.result() + b.result();
+}
+
+dl::coro<unsigned long long>
+fib_rounds()
+{
+	unsigned long long elapsed = 0;
+	for (unsigned i = 0; i < FIB_ROUNDS; ++ i) {
+		unsigned long long began = now_ns();
+		long result = co_await fib(FIB_N);
+		elapsed += now_ns() - began;
+		if (result != fib_expected(FIB_N)) {
+			std::fprintf(stderr, "C++ fib mismatch\n");
+			std::exit(EXIT_FAILURE);
+		}
+	}
+	co_return elapsed / FIB_ROUNDS;
+}
+
+unsigned long long
+coro_fib_run(int num_threads)
+{
+	dl::coro<unsigned long long> root = fib_rounds();
+	int result = dl::run(root, num_threads);
+	if (result) {
+		std::perror("Error in dlmain");
+		return 0;
+	}
+	return root.result();
+}
+
+} /* namespace */
+
+int
+main(int argc, char **argv)
+{
+	int num_threads = -1;
+	if (argc > 1 && argv[1]) {
+		errno = 0;
+		num_threads = (int)std::strtoul(argv[1], NULL, 10);
+		if (num_threads == 0) errno = EINVAL;
+		if (errno) {
+			std::perror("Invalid <num-threads>");
+			std::fprintf(stderr, "Usage: ./coro <num-threads>\n");
+			return EXIT_FAILURE;
+		}
+	}
+
+	/* Interleave to even out frequency scaling and cache warmup */
+	unsigned long long c = 0, co = 0;
+	for (int i = 0; i < 2; ++ i) {
+		unsigned long long ct = c_fib_run(num_threads);
+		unsigned long long cot = coro_fib_run(num_threads);
+		if (!ct || !cot)
+			return EXIT_FAILURE;
+		c += ct;
+		co += cot;
+	}
+
+	std::printf("Average of %u fib(%d) computations:\n"
+	            "\tC tasks and continuations: %lluns\n"
+	            "\tdl::coro<long>:            %lluns\n",
+	            2 * FIB_ROUNDS, FIB_N, c / 2, co / 2);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,123 @@
+#include "fib.h"
+#include "deadlock/dl.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+struct fib_pkg {
+	dltask          task;
+	struct fib_pkg *children;
+	int             n;
+	long            result;
+};
+
+struct root_pkg {
+	dltask              task;
+	struct fib_pkg      fib;
+	unsigned            round;
+	unsigned long long  began;
+	unsigned long long  elapsed;
+};
+
+static void root_task_run(DL_TASK_ARGS);
+static void fib_task_run(DL_TASK_ARGS);
+static void fib_task_sum(DL_TASK_ARGS);
+
+unsigned long long
+c_fib_run(int num_threads)
+{
+	struct root_pkg root = { .round = 0 };
+	root.task = dlcreate(root_task_run, NULL);
+
+	int result;
+	if (num_threads == -1) {
+		result = dlmain(&root.task, NULL, NULL);
+	} else {
+		result = dlmainex(&root.task, NULL, NULL, num_threads);
+	}
+	if (result) perror("Error in dlmain");
+
+	return result ? 0 : root.elapsed / FIB_ROUNDS;
+}
+
+long
+fib_expected(int n)
+{
+	long a = 0, b = 1;
+	while (n --) {
+		long c = a + b;
+		a = b;
+		b = c;
+	}
+	return a;
+}
+
+static void
+root_task_run(DL_TASK_ARGS)
+{
+	DL_TASK_ENTRY(struct root_pkg, r, task);
+
+	if (r->round > 0) {
+		r->elapsed += now_ns() - r->began;
+		if (r->fib.result != fib_expected(FIB_N)) {
+			fprintf(stderr, "C fib mismatch\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+	if (r->round ++ == FIB_ROUNDS) {
+		dlterminate();
+		return;
+	}
+
+	r->began = now_ns();
+	dlrecapture(&r->task, root_task_run);
+	r->fib.n = FIB_N;
+	r->fib.task = dlcreate(fib_task_run, &r->task);
+	dldetach(&r->fib.task);
+	dldetach(&r->task);
+}
+
+static void
+fib_task_run(DL_TASK_ARGS)
+{
+	DL_TASK_ENTRY(struct fib_pkg, f, task);
+
+	if (f->n < 2) {
+		f->result = f->n;
+		return;
+	}
+
+	f->children = malloc(2 * sizeof *f->children);
+	if (!f->children) {
+		perror("Failed allocating tasks");
+		exit(EXIT_FAILURE);
+	}
+	dlrecapture(&f->task, fib_task_sum);
+	for (int i = 0; i < 2; ++ i) {
+		f->children[i].n = f->n - 1 - i;
+		f->children[i].task = dlcreate(fib_task_run, &f->task);
+	}
+	dldetach(&f->children[0].task);
+	dldetach(&f->children[1].task);
+	dldetach(&f->task);
+}
+
+static void
+fib_task_sum(DL_TASK_ARGS)
+{
+	DL_TASK_ENTRY(struct fib_pkg, f, task);
+	f->result = f->children[0].result + f->children[1].result;
+	free(f->children);
+}
+
+unsigned long long
+now_ns(void)
+{
+	struct timespec t;
+#if _POSIX_C_SOURCE >= 199309L
+	clock_gettime(CLOCK_MONOTONIC, &t);
+#else
+	timespec_get(&t, TIME_UTC);
+#endif
+	return t.tv_sec * 1000000000ull + t.tv_nsec;
+}
@@ -0,0 +1,30 @@
+#ifndef CORO_FIB_H_
+#define CORO_FIB_H_
+
+/*
+ * Both halves of this benchmark compute fib(FIB_N) by naive fork-join
+ * recursion, one task per call, FIB_ROUNDS times. fib.c is written against
+ * the C API, splitting each call into a task and a continuation and
+ * allocating child packages with malloc(). coro.cpp is a dl::coro<long>.
+ */
+#define FIB_N      27
+#define FIB_ROUNDS 8u
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * c_fib_run() executes FIB_ROUNDS computations with num_threads workers,
+ * or dlmain() defaults if num_threads is -1, returning the average
+ * nanoseconds per computation or zero on failure.
+ */
+unsigned long long c_fib_run(int num_threads);
+unsigned long long now_ns(void);
+long               fib_expected(int n);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CORO_FIB_H_ */
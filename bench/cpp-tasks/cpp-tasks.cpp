@@ -0,0 +1,123 @@
+#include "tree.h"
+#include "deadlock/dl.hpp"
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+
+/*
+ * The same tree as tree.c, written with dl::task<> and dl::join. Aside from
+ * the wrapper every detail, including package layout, matches the C half so
+ * any difference in timing is overhead of the wrapper itself.
+ */
+
+namespace {
+
+struct node : dl::task<node> {
+	node          *nodes;
+	unsigned       index;
+	unsigned long  value;
+
+	void
+	operator()()
+	{
+		if (index >= TREE_INNER) {
+			value = 1;
+			return;
+		}
+		dl::join j = continue_with<&node::sum>();
+		j.fork(nodes[2 * index + 1]);
+		j.fork(nodes[2 * index + 2]);
+	}
+
+	void
+	sum()
+	{
+		value = nodes[2 * index + 1].value + nodes[2 * index + 2].value;
+	}
+};
+
+struct root : dl::task<root> {
+	std::unique_ptr<node[]> nodes;
+	unsigned                round = 0;
+	unsigned long long      began = 0;
+	unsigned long long      elapsed = 0;
+
+	void
+	operator()()
+	{
+		if (round > 0) {
+			elapsed += now_ns() - began;
+			if (nodes[0].value != 1ul << TREE_DEPTH) {
+				std::fprintf(stderr, "C++ tree sum mismatch\n");
+				std::exit(EXIT_FAILURE);
+			}
+		}
+		if (round ++ == TREE_ROUNDS) {
+			dlterminate();
+			return;
+		}
+
+		began = now_ns();
+		continue_with<&root::operator()>().fork(nodes[0]);
+	}
+};
+
+unsigned long long
+cpp_tree_run(int num_threads)
+{
+	root r;
+	r.nodes.reset(new node[TREE_NODES]);
+	for (unsigned i = 0; i < TREE_NODES; ++ i) {
+		r.nodes[i].nodes = r.nodes.get();
+		r.nodes[i].index = i;
+	}
+	int result = dl::run(r, num_threads);
+	if (result) std::perror("Error in dlmain");
+	return result ? 0 : r.elapsed / TREE_ROUNDS;
+}
+
+/* The package tree.c would declare, dl::task<> must not add to it */
+struct c_node_layout {
+	dltask         task;
+	node          *nodes;
+	unsigned       index;
+	unsigned long  value;
+};
+static_assert(sizeof(node) == sizeof(c_node_layout),
+              "dl::task<> adds nothing to a package");
+
+} /* namespace */
+
+int
+main(int argc, char **argv)
+{
+	int num_threads = -1;
+	if (argc > 1 && argv[1]) {
+		errno = 0;
+		num_threads = (int)std::strtoul(argv[1], NULL, 10);
+		if (num_threads == 0) errno = EINVAL;
+		if (errno) {
+			std::perror("Invalid <num-threads>");
+			std::fprintf(stderr, "Usage: ./cpp-tasks <num-threads>\n");
+			return EXIT_FAILURE;
+		}
+	}
+
+	/* Interleave to even out frequency scaling and cache warmup */
+	unsigned long long c = 0, cpp = 0;
+	for (int i = 0; i < 2; ++ i) {
+		unsigned long long ct = c_tree_run(num_threads);
+		unsigned long long cppt = cpp_tree_run(num_threads);
+		if (!ct || !cppt)
+			return EXIT_FAILURE;
+		c += ct;
+		cpp += cppt;
+	}
+
+	std::printf("Average of %u trees of %u tasks:\n"
+	            "\thand-written C: %lluns\n"
+	            "\tdl::task<>:     %lluns\n",
+	            2 * TREE_ROUNDS, TREE_NODES, c / 2, cpp / 2);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,114 @@
+#include "tree.h"
+#include "deadlock/dl.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+struct node_pkg {
+	dltask             task;
+	struct node_pkg   *nodes;
+	unsigned           index;
+	unsigned long      value;
+};
+
+struct root_pkg {
+	dltask              task;
+	struct node_pkg    *nodes;
+	unsigned            round;
+	unsigned long long  began;
+	unsigned long long  elapsed;
+};
+
+static void root_task_run(DL_TASK_ARGS);
+static void node_task_run(DL_TASK_ARGS);
+static void node_task_sum(DL_TASK_ARGS);
+
+unsigned long long
+c_tree_run(int num_threads)
+{
+	struct root_pkg root = { .nodes = calloc(TREE_NODES, sizeof *root.nodes) };
+	if (!root.nodes) {
+		perror("Failed allocating tasks");
+		return 0;
+	}
+	for (unsigned i = 0; i < TREE_NODES; ++ i) {
+		root.nodes[i].nodes = root.nodes;
+		root.nodes[i].index = i;
+	}
+	root.task = dlcreate(root_task_run, NULL);
+
+	int result;
+	if (num_threads == -1) {
+		result = dlmain(&root.task, NULL, NULL);
+	} else {
+		result = dlmainex(&root.task, NULL, NULL, num_threads);
+	}
+	if (result) perror("Error in dlmain");
+
+	free(root.nodes);
+	return result ? 0 : root.elapsed / TREE_ROUNDS;
+}
+
+static void
+root_task_run(DL_TASK_ARGS)
+{
+	DL_TASK_ENTRY(struct root_pkg, r, task);
+
+	if (r->round > 0) {
+		r->elapsed += now_ns() - r->began;
+		if (r->nodes[0].value != 1ul << TREE_DEPTH) {
+			fprintf(stderr, "C tree sum mismatch\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+	if (r->round ++ == TREE_ROUNDS) {
+		dlterminate();
+		return;
+	}
+
+	r->began = now_ns();
+	dlrecapture(&r->task, root_task_run);
+	r->nodes[0].task = dlcreate(node_task_run, &r->task);
+	dldetach(&r->nodes[0].task);
+	dldetach(&r->task);
+}
+
+static void
+node_task_run(DL_TASK_ARGS)
+{
+	DL_TASK_ENTRY(struct node_pkg, n, task);
+
+	if (n->index >= TREE_INNER) {
+		n->value = 1;
+		return;
+	}
+
+	struct node_pkg *l = &n->nodes[2 * n->index + 1];
+	struct node_pkg *r = &n->nodes[2 * n->index + 2];
+	dlrecapture(&n->task, node_task_sum);
+	l->task = dlcreate(node_task_run, &n->task);
+	r->task = dlcreate(node_task_run, &n->task);
+	dldetach(&l->task);
+	dldetach(&r->task);
+	dldetach(&n->task);
+}
+
+static void
+node_task_sum(DL_TASK_ARGS)
+{
+	DL_TASK_ENTRY(struct node_pkg, n, task);
+	n->value = n->nodes[2 * n->index + 1].value +
+	           n->nodes[2 * n->index + 2].value;
+}
+
+unsigned long long
+now_ns(void)
+{
+	struct timespec t;
+#if _POSIX_C_SOURCE >= 199309L
+	clock_gettime(CLOCK_MONOTONIC, &t);
+#else
+	timespec_get(&t, TIME_UTC);
+#endif
+	return t.tv_sec * 1000000000ull + t.tv_nsec;
+}
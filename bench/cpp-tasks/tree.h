@@ -0,0 +1,32 @@
+#ifndef CPP_TASKS_TREE_H_
+#define CPP_TASKS_TREE_H_
+
+/*
+ * Both halves of this benchmark execute the same complete binary tree of
+ * tasks, stored heap ordered so node i has children 2i+1 and 2i+2. Each
+ * inner node forks its children and recaptures itself to sum their values,
+ * each leaf counts one. tree.c is written against the C API by hand,
+ * cpp-tasks.cpp against deadlock/dl.hpp.
+ */
+#define TREE_DEPTH 18u
+#define TREE_NODES ((1u << (TREE_DEPTH + 1)) - 1)
+#define TREE_INNER ((1u << TREE_DEPTH) - 1)
+#define TREE_ROUNDS 32u
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * c_tree_run() executes TREE_ROUNDS trees with num_threads workers, or
+ * dlmain() defaults if num_threads is -1, returning the average
+ * nanoseconds per tree or zero on failure.
+ */
+unsigned long long c_tree_run(int num_threads);
+unsigned long long now_ns(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CPP_TASKS_TREE_H_ */
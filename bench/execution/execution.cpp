@@ -0,0 +1,153 @@
+#include "deadlock/execution.hpp"
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#ifdef BENCH_STDEXEC
+#include <exec/static_thread_pool.hpp>
+#include <stdexec/execution.hpp>
+#endif
+
+/*
+ * ROUNDS rounds of SAXPY over N floats, each round a single bulk sender
+ * scheduled onto Deadlock and, when built against stdexec, onto an
+ * exec::static_thread_pool with the same number of threads.
+ *
+ * Deadlock only runs within dlmain(), so rather than paying to start the
+ * runtime every round with sync_wait() the Deadlock half drives every
+ * round from one task: each round's completion releases a gate task which
+ * joins back to the driver, exactly as a C client would chain frames.
+ */
+#define N      (1u << 22)
+#define ROUNDS 64u
+
+namespace ex = dl::execution;
+
+namespace {
+
+using clock_type = std::chrono::steady_clock;
+
+std::vector<float> xs(N, 1.0f), ys(N, 0.0f);
+
+void
+saxpy(std::size_t i)
+{
+	ys[i] = 2.0f * xs[i] + ys[i];
+}
+
+struct driver;
+
+struct round_receiver {
+	driver *d;
+	void set_value() noexcept;
+	void set_error(std::exception_ptr) noexcept { std::abort(); }
+	void set_stopped() noexcept { std::abort(); }
+};
+
+using round_sender = decltype(ex::schedule(ex::get_scheduler()) | ex::bulk(N, &saxpy));
+using round_op = ex::connect_result_t<round_sender, round_receiver>;
+
+/* Operations are immovable, so construct each in place via conversion */
+struct connect_round {
+	driver *d;
+	operator round_op() const;
+};
+
+struct gate : dl::task<gate> {
+	void operator()() {}
+};
+
+struct driver : dl::task<driver> {
+	std::optional<round_op> op;
+	gate                    g;
+	unsigned                round = 0;
+
+	void
+	operator()()
+	{
+		if (round ++ == ROUNDS) {
+			dlterminate();
+			return;
+		}
+		dl::join j = continue_with<&driver::operator()>();
+		g.create(j.handle());
+		op.reset();
+		op.emplace(connect_round{ this });
+		op->start();
+	}
+};
+
+connect_round::operator round_op() const
+{
+	return (ex::schedule(ex::get_scheduler()) | ex::bulk(N, &saxpy))
+	       .connect(round_receiver{ d });
+}
+
+void
+round_receiver::set_value() noexcept
+{
+	d->g.detach();
+}
+
+double
+deadlock_run(int num_threads)
+{
+	driver d;
+	clock_type::time_point began = clock_type::now();
+	if (dl::run(d, num_threads)) {
+		std::perror("Error in dlmain");
+		std::exit(EXIT_FAILURE);
+	}
+	std::chrono::duration<double, std::micro> elapsed = clock_type::now() - began;
+	return elapsed.count() / ROUNDS;
+}
+
+#ifdef BENCH_STDEXEC
+double
+stdexec_run(int num_threads)
+{
+	exec::static_thread_pool pool(num_threads);
+	auto sch = pool.get_scheduler();
+	clock_type::time_point began = clock_type::now();
+	for (unsigned i = 0; i < ROUNDS; ++ i)
+		stdexec::sync_wait(stdexec::schedule(sch) |
+		                   stdexec::bulk(stdexec::par, N, &saxpy));
+	std::chrono::duration<double, std::micro> elapsed = clock_type::now() - began;
+	return elapsed.count() / ROUNDS;
+}
+#endif
+
+} /* namespace */
+
+int
+main(int argc, char **argv)
+{
+	int num_threads = -1;
+	if (argc > 1 && argv[1]) {
+		errno = 0;
+		num_threads = (int)std::strtoul(argv[1], NULL, 10);
+		if (num_threads == 0) errno = EINVAL;
+		if (errno) {
+			std::perror("Invalid <num-threads>");
+			std::fprintf(stderr, "Usage: ./execution <num-threads>\n");
+			return EXIT_FAILURE;
+		}
+	}
+
+	std::printf("Average of %u bulk SAXPY rounds over %u floats:\n", ROUNDS, N);
+	std::printf("\tdl::execution: %.1fus\n", deadlock_run(num_threads));
+#ifdef BENCH_STDEXEC
+	if (num_threads == -1)
+		num_threads = (int)std::thread::hardware_concurrency();
+	std::printf("\tstdexec:       %.1fus\n", stdexec_run(num_threads));
+#endif
+	if (ys[0] != 2.0f * ROUNDS) {
+		std::fprintf(stderr, "SAXPY mismatch\n");
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,155 @@
+#include "deadlock/dl.h"
+#include "deadlock/fiber.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h> /* clock_gettime */
+#endif
+
+/*
+ * Measures the cost of joining a single child ITERATIONS times, first by
+ * splitting the parent into continuations with dlrecapture(), then by
+ * blocking on the child with dlawait() from a fiber.
+ */
+#define ITERATIONS 65536u
+
+/*
+ * Very basic timing
+ */
+typedef unsigned long long time_ns;
+static time_ns now_ns(void);
+
+struct child_pkg {
+	dltask task;
+	unsigned value;
+};
+
+struct bench_pkg {
+	dltask task;
+	dltask fiber;
+	struct child_pkg child;
+	unsigned iteration;
+	unsigned sum;
+	time_ns began;
+	time_ns recapture;
+	time_ns await;
+};
+
+static void recapture_run(DL_TASK_ARGS);
+static void recapture_join(DL_TASK_ARGS);
+static void await_run(DL_TASK_ARGS);
+static void child_run(DL_TASK_ARGS);
+
+int
+main(int argc, char **argv)
+{
+	int num_threads = -1;
+	if (argc > 1 && argv[1]) {
+		errno = 0;
+		num_threads = (int)strtoul(argv[1], NULL, 10);
+		if (num_threads == 0) errno = EINVAL;
+		if (errno) {
+			perror("Invalid <num-threads>");
+			fprintf(stderr, "Usage: ./fiber <num-threads>\n");
+			return EXIT_FAILURE;
+		}
+	}
+
+	struct bench_pkg *bench = calloc(1, sizeof(*bench));
+	if (bench == NULL) {
+		perror("Failed allocating tasks");
+		return EXIT_FAILURE;
+	}
+	bench->task = dlcreate(recapture_run, NULL);
+
+	int result;
+	if (num_threads == -1) {
+		result = dlmain(&bench->task, NULL, NULL);
+	} else {
+		result = dlmainex(&bench->task, NULL, NULL, num_threads);
+	}
+	if (result) perror("Error in dlmain");
+
+	free(bench);
+
+	return result;
+}
+
+static void
+recapture_run(DL_TASK_ARGS)
+{
+	DL_TASK_ENTRY(struct bench_pkg, t, task);
+
+	if (t->iteration == 0)
+		t->began = now_ns();
+
+	if (t->iteration < ITERATIONS) {
+		dlrecapture(&t->task, recapture_join);
+		t->child.task = dlcreate(child_run, &t->task);
+		t->child.value = t->iteration;
+		dldetach(&t->child.task);
+		dldetach(&t->task);
+		return;
+	}
+
+	/* Hand over to a fiber */
+	t->recapture = now_ns() - t->began;
+	t->fiber = dlcreatefiber(await_run, NULL);
+	dldetach(&t->fiber);
+}
+
+static void
+recapture_join(DL_TASK_ARGS)
+{
+	DL_TASK_ENTRY(struct bench_pkg, t, task);
+	t->sum += t->child.value;
+	++ t->iteration;
+	recapture_run(dlw_param, dlt_param);
+}
+
+static void
+await_run(DL_TASK_ARGS)
+{
+	DL_TASK_ENTRY(struct bench_pkg, t, fiber);
+
+	time_ns began = now_ns();
+	for (unsigned i = 0; i < ITERATIONS; ++ i) {
+		t->child.task = dlcreate(child_run, NULL);
+		t->child.value = i;
+		dlawait(&t->child.task);
+		t->sum += t->child.value;
+	}
+	t->await = now_ns() - began;
+
+	printf("Average join of %u children (checksum %u):\n"
+	       "\trecapture: %lluns\n"
+	       "\tawait:     %lluns\n",
+	       ITERATIONS, t->sum,
+	       t->recapture / ITERATIONS,
+	       t->await / ITERATIONS);
+	dlterminate();
+}
+
+static void
+child_run(DL_TASK_ARGS)
+{
+	DL_TASK_ENTRY(struct child_pkg, t, task);
+	t->value *= 2;
+}
+
+static time_ns
+now_ns(void)
+{
+	struct timespec t;
+#if _POSIX_C_SOURCE >= 199309L
+	clock_gettime(CLOCK_MONOTONIC, &t);
+#else
+	timespec_get(&t, TIME_UTC);
+#endif
+	return t.tv_sec * 1000000000ull + t.tv_nsec;
+}
@@ -0,0 +1,191 @@
+#include "deadlock/dl.h"
+#include "deadlock/graph.h"
+#include "deadlock/graphfile.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h> /* clock_gettime */
+#endif
+
+/*
+ * Measures dlgraph_joinex() writing the same shape of graph, a root task
+ * forking FANOUT labelled children which join to a tail task, in the text
+ * and binary formats, and joining the same graph streamed to disk within
+ * STREAM_BUDGET bytes. Each file is then read back with dlgraphfile_open()
+ * and its nodes are walked, comparing what the reader sees.
+ */
+#define FANOUT        65536u
+#define STREAM_BUDGET (1024u * 1024u)
+
+/*
+ * Very basic timing
+ */
+typedef unsigned long long time_ns;
+static time_ns now_ns(void);
+
+struct graph_pkg {
+	dltask      root;
+	dltask      tail;
+	dltask      children[FANOUT];
+	int         format;
+	int         stream;
+	time_ns     join;
+};
+
+static void root_task_run(DL_TASK_ARGS);
+static void child_task_run(DL_TASK_ARGS);
+static void tail_task_run(DL_TASK_ARGS);
+
+static int read_graph(const char *path, time_ns *elapsed, size_t *nodes);
+
+int
+main(int argc, char **argv)
+{
+#ifndef DEADLOCK_GRAPH_EXPORT
+	(void)argc; (void)argv; (void)now_ns; (void)read_graph;
+	(void)root_task_run; (void)child_task_run; (void)tail_task_run;
+	fprintf(stderr, "graph-join requires DEADLOCK_GRAPH_EXPORT\n");
+	return EXIT_SUCCESS;
+#else
+	int num_threads = -1;
+	if (argc > 1 && argv[1]) {
+		errno = 0;
+		num_threads = (int)strtoul(argv[1], NULL, 10);
+		if (num_threads == 0) errno = EINVAL;
+		if (errno) {
+			perror("Invalid <num-threads>");
+			fprintf(stderr, "Usage: ./graph-join <num-threads>\n");
+			return EXIT_FAILURE;
+		}
+	}
+
+	struct graph_pkg *pkg = calloc(1, sizeof(*pkg));
+	if (pkg == NULL) {
+		perror("Failed allocating tasks");
+		return EXIT_FAILURE;
+	}
+
+	/* Graph IDs count up from zero, and are appended to the prefix */
+	static const struct {
+		const char *name;
+		const char *path;
+		int         format;
+		int         stream;
+	} formats[] = {
+		{ "text",   "graph-join0.dlg",  DLGRAPH_FORMAT_TEXT,   0 },
+		{ "binary", "graph-join1.dlgb", DLGRAPH_FORMAT_BINARY, 0 },
+		{ "stream", "graph-join2.dlgs", DLGRAPH_FORMAT_BINARY, 1 }
+	};
+
+	size_t expected = 0;
+	for (size_t i = 0; i < sizeof formats / sizeof *formats; ++ i) {
+		pkg->format = formats[i].format;
+		pkg->stream = formats[i].stream;
+		pkg->root = dlcreate(root_task_run, NULL);
+		int result = num_threads == -1 ? dlmain(&pkg->root, NULL, NULL)
+		                               : dlmainex(&pkg->root, NULL, NULL, num_threads);
+		if (result) {
+			perror("Error in dlmain");
+			free(pkg);
+			return EXIT_FAILURE;
+		}
+
+		time_ns read;
+		size_t nodes;
+		if (read_graph(formats[i].path, &read, &nodes)) {
+			perror("Error reading graph");
+			free(pkg);
+			return EXIT_FAILURE;
+		}
+		if (expected && nodes != expected) {
+			fprintf(stderr, "%s graph has %zu nodes, expected %zu\n",
+			        formats[i].name, nodes, expected);
+			free(pkg);
+			return EXIT_FAILURE;
+		}
+		expected = nodes;
+
+		printf("%-6s join: %9lluns, read: %9lluns, %zu nodes\n",
+		       formats[i].name, pkg->join, read, nodes);
+	}
+
+	free(pkg);
+	return EXIT_SUCCESS;
+#endif
+}
+
+static void
+root_task_run(DL_TASK_ARGS)
+{
+	DL_TASK_ENTRY(struct graph_pkg, pkg, root);
+	struct dlgraph_options options = {
+		.stream_prefix = "graph-join",
+		.budget = STREAM_BUDGET
+	};
+	dlgraph_forkex(pkg->stream ? &options : NULL);
+	dlgraph_label("root");
+	pkg->tail = dlcreate(tail_task_run, NULL);
+	for (unsigned i = 0; i < FANOUT; ++ i)
+		pkg->children[i] = dlcreate(child_task_run, &pkg->tail);
+	for (unsigned i = 0; i < FANOUT; ++ i)
+		dldetach(&pkg->children[i]);
+	dldetach(&pkg->tail);
+}
+
+static void
+child_task_run(DL_TASK_ARGS)
+{
+	DL_TASK_ENTRY_VOID;
+	dlgraph_label("child");
+}
+
+static void
+tail_task_run(DL_TASK_ARGS)
+{
+	DL_TASK_ENTRY(struct graph_pkg, pkg, tail);
+	time_ns began = now_ns();
+	dlgraph_joinex("graph-join", pkg->format);
+	pkg->join = now_ns() - began;
+	dlterminate();
+}
+
+static int
+read_graph(const char *path, time_ns *elapsed, size_t *nodes)
+{
+	time_ns began = now_ns();
+	dlgraphfile *g;
+	int result = dlgraphfile_open(&g, path);
+	if (result) return result;
+
+	const struct dlgraphfile_header *h = dlgraphfile_header(g);
+	unsigned long long work = 0;
+	*nodes = 0;
+	for (uint32_t w = 0; w < h->nworkers; ++ w) {
+		size_t count;
+		const struct dlgraphfile_node *n = dlgraphfile_nodes(g, w, &count);
+		for (size_t i = 0; i < count; ++ i)
+			work += n[i].duration_ns;
+		*nodes += count;
+	}
+	dlgraphfile_close(g);
+	*elapsed = now_ns() - began;
+	/* Keep the walk from being optimized away */
+	if (work == ~0ull) putchar('\0');
+	return 0;
+}
+
+static time_ns
+now_ns(void)
+{
+	struct timespec t;
+#if _POSIX_C_SOURCE >= 199309L
+	clock_gettime(CLOCK_MONOTONIC, &t);
+#else
+	timespec_get(&t, TIME_UTC);
+#endif
+	return t.tv_sec * 1000000000ull + t.tv_nsec;
+}
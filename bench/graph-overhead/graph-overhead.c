@@ -0,0 +1,154 @@
+#include "deadlock/dl.h"
+#include "deadlock/graph.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h> /* clock_gettime */
+#endif
+
+/*
+ * Measures the cost per task of graph capture: a root task forks FANOUT
+ * trivial children with dlforkn() which join to a tail task, and the time
+ * from the fork to the tail is divided by FANOUT. The best of ROUNDS runs of
+ * each mode is printed:
+ * uncaptured, no graph is forked;
+ * disabled, a graph is forked while dlgraph_enable(0);
+ * skipped, a graph is forked with options disabled;
+ * captured, a graph is forked and captured in memory, then discarded;
+ * histogram, a graph is forked which only records latency histograms;
+ * selected, as captured but only root_task_run is selected, so children
+ * carry the graph without recording nodes.
+ * Comparing uncaptured against a build without DEADLOCK_GRAPH_EXPORT, which
+ * only runs that mode, gives the cost of capture being available but off.
+ */
+#define FANOUT 262144u
+#define ROUNDS 5
+
+/*
+ * Very basic timing
+ */
+typedef unsigned long long time_ns;
+static time_ns now_ns(void);
+
+enum mode { UNCAPTURED, DISABLED, SKIPPED, CAPTURED, HISTOGRAM, SELECTED, MODES };
+
+struct overhead_pkg {
+	dltask      root;
+	dltask      tail;
+	dltask      children[FANOUT];
+	enum mode   mode;
+	time_ns     began;
+	time_ns     elapsed;
+};
+
+static void root_task_run(DL_TASK_ARGS);
+static void child_task_run(DL_TASK_ARGS);
+static void tail_task_run(DL_TASK_ARGS);
+
+int
+main(int argc, char **argv)
+{
+	int num_threads = -1;
+	if (argc > 1 && argv[1]) {
+		errno = 0;
+		num_threads = (int)strtoul(argv[1], NULL, 10);
+		if (num_threads == 0) errno = EINVAL;
+		if (errno) {
+			perror("Invalid <num-threads>");
+			fprintf(stderr, "Usage: ./graph-overhead <num-threads>\n");
+			return EXIT_FAILURE;
+		}
+	}
+
+	struct overhead_pkg *pkg = calloc(1, sizeof(*pkg));
+	if (pkg == NULL) {
+		perror("Failed allocating tasks");
+		return EXIT_FAILURE;
+	}
+
+	static const char *names[MODES] = {
+		"uncaptured", "disabled", "skipped", "captured", "histogram",
+		"selected"
+	};
+#ifdef DEADLOCK_GRAPH_EXPORT
+	enum mode modes = MODES;
+#else
+	enum mode modes = UNCAPTURED + 1;
+#endif
+	for (enum mode m = UNCAPTURED; m < modes; ++ m) {
+		time_ns best = ~0ull;
+		dlgraph_enable(m != DISABLED);
+		if (m == SELECTED && dlgraph_select("root_task_run")) {
+			perror("Error selecting root_task_run");
+			free(pkg);
+			return EXIT_FAILURE;
+		}
+		for (int r = 0; r < ROUNDS; ++ r) {
+			pkg->mode = m;
+			pkg->root = dlcreate(root_task_run, NULL);
+			int result = num_threads == -1 ? dlmain(&pkg->root, NULL, NULL)
+			                               : dlmainex(&pkg->root, NULL, NULL, num_threads);
+			if (result) {
+				perror("Error in dlmain");
+				free(pkg);
+				return EXIT_FAILURE;
+			}
+			if (pkg->elapsed < best)
+				best = pkg->elapsed;
+		}
+		printf("%-10s %6.2fns/task\n", names[m], (double)best / FANOUT);
+	}
+
+	free(pkg);
+	return EXIT_SUCCESS;
+}
+
+static void
+root_task_run(DL_TASK_ARGS)
+{
+	DL_TASK_ENTRY(struct overhead_pkg, pkg, root);
+	struct dlgraph_options skipped = { .disabled = 1 };
+	struct dlgraph_options histogram = { .histogram_only = 1 };
+	pkg->began = now_ns();
+	if (pkg->mode == SKIPPED)
+		dlgraph_forkex(&skipped);
+	else if (pkg->mode == HISTOGRAM)
+		dlgraph_forkex(&histogram);
+	else if (pkg->mode != UNCAPTURED)
+		dlgraph_fork();
+	pkg->tail = dlcreate(tail_task_run, NULL);
+	dlforkn(child_task_run, &pkg->tail, pkg->children, FANOUT, sizeof(dltask));
+	dldetach(&pkg->tail);
+}
+
+static void
+child_task_run(DL_TASK_ARGS)
+{
+	DL_TASK_ENTRY_VOID;
+}
+
+static void
+tail_task_run(DL_TASK_ARGS)
+{
+	DL_TASK_ENTRY(struct overhead_pkg, pkg, tail);
+	pkg->elapsed = now_ns() - pkg->began;
+	if (pkg->mode != UNCAPTURED)
+		dlgraph_join(NULL);
+	dlterminate();
+}
+
+static time_ns
+now_ns(void)
+{
+	struct timespec t;
+#if _POSIX_C_SOURCE >= 199309L
+	clock_gettime(CLOCK_MONOTONIC, &t);
+#else
+	timespec_get(&t, TIME_UTC);
+#endif
+	return t.tv_sec * 1000000000ull + t.tv_nsec;
+}
@@ -0,0 +1,190 @@
+#include "deadlock/dl.h"
+#include "deadlock/template.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h> /* clock_gettime */
+#endif
+
+/*
+ * Every frame executes the same reduction tree of tasks: LEAVES tasks join
+ * FANOUT at a time into MIDS tasks, which join into UPPERS tasks, which join
+ * into a single sink, which joins back into the frame task. The first FRAMES
+ * frames construct the tree with dlcreate() and dldetach(), the next FRAMES
+ * frames replay a dltemplate recorded once up front.
+ */
+#define FRAMES 4096u
+#define FANOUT 8u
+#define LEAVES 512u
+#define MIDS   (LEAVES / FANOUT)
+#define UPPERS (MIDS / FANOUT)
+
+/*
+ * Very basic timing
+ */
+typedef unsigned long long time_ns;
+static time_ns now_ns(void);
+
+struct node_pkg {
+	dltask task;
+	unsigned visits;
+};
+
+static struct node_pkg leaves[LEAVES];
+static struct node_pkg mids[MIDS];
+static struct node_pkg uppers[UPPERS];
+static struct node_pkg sink;
+
+struct frame_task {
+	dltask      task;
+	dltemplate *tpl;
+	unsigned    frame;
+	time_ns     frame_began;
+	time_ns     rebuild_construct;
+	time_ns     rebuild_frame;
+	time_ns     replay_construct;
+	time_ns     replay_frame;
+};
+
+static void frame_task_run(DL_TASK_ARGS);
+static void node_task_run(DL_TASK_ARGS);
+static int  record_template(dltemplate *, dltask *frame);
+
+int
+main(int argc, char **argv)
+{
+	int num_threads = -1;
+	if (argc > 1 && argv[1]) {
+		errno = 0;
+		num_threads = (int)strtoul(argv[1], NULL, 10);
+		if (num_threads == 0) errno = EINVAL;
+		if (errno) {
+			perror("Invalid <num-threads>");
+			fprintf(stderr, "Usage: ./replay <num-threads>\n");
+			return EXIT_FAILURE;
+		}
+	}
+
+	struct frame_task *frame = calloc(1, sizeof(*frame));
+	if (frame == NULL) {
+		perror("Failed allocating tasks");
+		return EXIT_FAILURE;
+	}
+	frame->task = dlcreate(frame_task_run, NULL);
+
+	frame->tpl = dltemplate_create();
+	if (!frame->tpl || record_template(frame->tpl, &frame->task)) {
+		perror("Failed recording template");
+		return EXIT_FAILURE;
+	}
+
+	int result;
+	if (num_threads == -1) {
+		result = dlmain(&frame->task, NULL, NULL);
+	} else {
+		result = dlmainex(&frame->task, NULL, NULL, num_threads);
+	}
+	if (result) perror("Error in dlmain");
+
+	dltemplate_destroy(frame->tpl);
+	free(frame);
+
+	return result;
+}
+
+static int
+record_template(dltemplate *tpl, dltask *frame)
+{
+	int rc = dltemplate_add(tpl, &sink.task, node_task_run, frame);
+	for (unsigned i = 0; !rc && i < UPPERS; ++ i)
+		rc = dltemplate_add(tpl, &uppers[i].task, node_task_run,
+		                    &sink.task);
+	for (unsigned i = 0; !rc && i < MIDS; ++ i)
+		rc = dltemplate_add(tpl, &mids[i].task, node_task_run,
+		                    &uppers[i / FANOUT].task);
+	for (unsigned i = 0; !rc && i < LEAVES; ++ i)
+		rc = dltemplate_add(tpl, &leaves[i].task, node_task_run,
+		                    &mids[i / FANOUT].task);
+	if (!rc)
+		rc = dltemplate_finalize(tpl);
+	return rc;
+}
+
+static void
+frame_task_run(DL_TASK_ARGS)
+{
+	DL_TASK_ENTRY(struct frame_task, t, task);
+
+	time_ns began = now_ns();
+	if (t->frame > 0 && t->frame <= FRAMES)
+		t->rebuild_frame += began - t->frame_began;
+	else if (t->frame > FRAMES)
+		t->replay_frame += began - t->frame_began;
+
+	if (t->frame == 2 * FRAMES) {
+		printf("Average of %u frames of %u tasks:\n"
+		       "\trebuild construct: %lluns\n"
+		       "\trebuild frame:     %lluns\n"
+		       "\treplay construct:  %lluns\n"
+		       "\treplay frame:      %lluns\n",
+		       FRAMES, 1 + UPPERS + MIDS + LEAVES,
+		       t->rebuild_construct / FRAMES,
+		       t->rebuild_frame / FRAMES,
+		       t->replay_construct / FRAMES,
+		       t->replay_frame / FRAMES);
+		dlterminate();
+		return;
+	}
+
+	dlrecapture(&t->task, frame_task_run);
+	t->frame_began = began;
+
+	if (t->frame ++ < FRAMES) {
+		sink.task = dlcreate(node_task_run, &t->task);
+		for (unsigned i = 0; i < UPPERS; ++ i)
+			uppers[i].task = dlcreate(node_task_run, &sink.task);
+		for (unsigned i = 0; i < MIDS; ++ i)
+			mids[i].task = dlcreate(node_task_run,
+			                        &uppers[i / FANOUT].task);
+		for (unsigned i = 0; i < LEAVES; ++ i)
+			leaves[i].task = dlcreate(node_task_run,
+			                          &mids[i / FANOUT].task);
+		dldetach(&sink.task);
+		for (unsigned i = 0; i < UPPERS; ++ i)
+			dldetach(&uppers[i].task);
+		for (unsigned i = 0; i < MIDS; ++ i)
+			dldetach(&mids[i].task);
+		for (unsigned i = 0; i < LEAVES; ++ i)
+			dldetach(&leaves[i].task);
+		t->rebuild_construct += now_ns() - began;
+	} else {
+		dltemplate_replay(t->tpl);
+		t->replay_construct += now_ns() - began;
+	}
+
+	dldetach(&t->task);
+}
+
+static void
+node_task_run(DL_TASK_ARGS)
+{
+	DL_TASK_ENTRY(struct node_pkg, t, task);
+	++ t->visits;
+}
+
+static time_ns
+now_ns(void)
+{
+	struct timespec t;
+#if _POSIX_C_SOURCE >= 199309L
+	clock_gettime(CLOCK_MONOTONIC, &t);
+#else
+	timespec_get(&t, TIME_UTC);
+#endif
+	return t.tv_sec * 1000000000ull + t.tv_nsec;
+}
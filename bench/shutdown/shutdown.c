@@ -0,0 +1,158 @@
+#include "deadlock/dl.h"
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h> /* clock_gettime */
+#endif
+
+/*
+ * Measures the time from calling into Deadlock until it returns, i.e. the
+ * cost of starting and tearing down the scheduler, ITERATIONS times for:
+ * 	terminate: a root task which calls dlterminate() immediately;
+ * 	quiescent: an empty root task under dlrun(), which must notice every
+ * 	           worker is idle and terminate on its own;
+ * 	fan-out:   a root task which forks FANOUT children under dlrun(),
+ * 	           none of which call dlterminate().
+ */
+#define ITERATIONS 256u
+#define FANOUT     1024u
+
+/*
+ * Very basic timing
+ */
+typedef unsigned long long time_ns;
+static time_ns now_ns(void);
+
+struct child_pkg {
+	dltask          task;
+	atomic_uint    *visits;
+};
+
+struct fanout_pkg {
+	dltask           root;
+	struct child_pkg children[FANOUT];
+	atomic_uint      visits;
+};
+
+static void terminate_task_run(DL_TASK_ARGS);
+static void empty_task_run(DL_TASK_ARGS);
+static void fanout_task_run(DL_TASK_ARGS);
+static void child_task_run(DL_TASK_ARGS);
+
+int
+main(int argc, char **argv)
+{
+	int num_threads = -1;
+	if (argc > 1 && argv[1]) {
+		errno = 0;
+		num_threads = (int)strtoul(argv[1], NULL, 10);
+		if (num_threads == 0) errno = EINVAL;
+		if (errno) {
+			perror("Invalid <num-threads>");
+			fprintf(stderr, "Usage: ./shutdown <num-threads>\n");
+			return EXIT_FAILURE;
+		}
+	}
+
+	time_ns terminate = 0, quiescent = 0, fanout = 0;
+	struct fanout_pkg *pkg = calloc(1, sizeof(*pkg));
+	if (pkg == NULL) {
+		perror("Failed allocating tasks");
+		return EXIT_FAILURE;
+	}
+
+	for (unsigned i = 0; i < ITERATIONS; ++ i) {
+		dltask t = dlcreate(terminate_task_run, NULL);
+		time_ns began = now_ns();
+		int result = num_threads == -1 ? dlmain(&t, NULL, NULL)
+		                               : dlmainex(&t, NULL, NULL, num_threads);
+		terminate += now_ns() - began;
+		if (result) goto dlmain_failed;
+
+		t = dlcreate(empty_task_run, NULL);
+		began = now_ns();
+		result = dlrun(&t, NULL, NULL, num_threads);
+		quiescent += now_ns() - began;
+		if (result) goto dlmain_failed;
+
+		pkg->root = dlcreate(fanout_task_run, NULL);
+		began = now_ns();
+		result = dlrun(&pkg->root, NULL, NULL, num_threads);
+		fanout += now_ns() - began;
+		if (result) goto dlmain_failed;
+	}
+
+	unsigned visits = atomic_load(&pkg->visits);
+	if (visits != ITERATIONS * FANOUT) {
+		fprintf(stderr, "Quiescence terminated with %u of %u tasks run\n",
+		        visits, ITERATIONS * FANOUT);
+		free(pkg);
+		return EXIT_FAILURE;
+	}
+	free(pkg);
+
+	printf("Average start to teardown of %u runs:\n"
+	       "\tterminate: %lluns\n"
+	       "\tquiescent: %lluns\n"
+	       "\tfan-out:   %lluns\n",
+	       ITERATIONS,
+	       terminate / ITERATIONS,
+	       quiescent / ITERATIONS,
+	       fanout / ITERATIONS);
+	return EXIT_SUCCESS;
+
+dlmain_failed:
+	perror("Error in dlmain");
+	free(pkg);
+	return EXIT_FAILURE;
+}
+
+static void
+terminate_task_run(DL_TASK_ARGS)
+{
+	DL_TASK_ENTRY_VOID;
+	dlterminate();
+}
+
+static void
+empty_task_run(DL_TASK_ARGS)
+{
+	DL_TASK_ENTRY_VOID;
+}
+
+static void
+fanout_task_run(DL_TASK_ARGS)
+{
+	DL_TASK_ENTRY(struct fanout_pkg, pkg, root);
+	for (unsigned i = 0; i < FANOUT; ++ i) {
+		pkg->children[i].task = dlcreate(child_task_run, NULL);
+		pkg->children[i].visits = &pkg->visits;
+	}
+	for (unsigned i = 0; i < FANOUT; ++ i)
+		dldetach(&pkg->children[i].task);
+}
+
+static void
+child_task_run(DL_TASK_ARGS)
+{
+	DL_TASK_ENTRY(struct child_pkg, pkg, task);
+	atomic_fetch_add_explicit(pkg->visits, 1, memory_order_relaxed);
+}
+
+static time_ns
+now_ns(void)
+{
+	struct timespec t;
+#if _POSIX_C_SOURCE >= 199309L
+	clock_gettime(CLOCK_MONOTONIC, &t);
+#else
+	timespec_get(&t, TIME_UTC);
+#endif
+	return t.tv_sec * 1000000000ull + t.tv_nsec;
+}
@@ -0,0 +1,329 @@
+#ifndef DEADLOCK_CORO_HPP_
+#define DEADLOCK_CORO_HPP_
+
+/*
+ * C++20 coroutines on Deadlock workers. A function returning dl::coro<T>
+ * is a task which may co_await its children rather than being split into
+ * continuations with dlrecapture(), and without the separate stacks of
+ * fibers. For example:
+ * 	dl::coro<long> fib(int n) {
+ * 		if (n < 2) co_return n;
+ * 		dl::coro<long> a = fib(n - 1), b = fib(n - 2);
+ * 		co_await dl::when_all(a, b);
+ * 		co_return a.result() + b.result();
+ * 	}
+ *
+ * Every coroutine frame embeds a dltask and is resumed by invoking it.
+ * Awaiting recaptures the awaiting coroutine's own task and joins each child
+ * to it through the usual next_/wait_ counters, so awaiting costs exactly
+ * what the equivalent dlrecapture(), dlcreate() and dldetach() calls do.
+ * Frames are allocated from per-thread pools; once warm no frame touches
+ * the global heap.
+ *
+ * dl::coro<T> is lazy: a coroutine does not start until it is awaited or
+ * passed to dl::run(). The dl::coro<T> object owns the frame, which is
+ * destroyed with it, and must outlive the coroutine's execution.
+ *
+ * result() returns the value a completed coroutine returned, rethrows any
+ * exception it threw, or throws dl::cancelled_error if it was skipped by a
+ * cancellation token (see dlcancel_attach()). Awaiting a child does the same.
+ *
+ * when_all() awaits any number of children at once, which execute in
+ * parallel. It rethrows the first failure in argument order, otherwise
+ * results are retrieved with result().
+ */
+
+#include "deadlock/dl.hpp"
+
+#include <array>
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <new>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+namespace dl {
+
+struct cancelled_error : std::exception {
+	const char *what() const noexcept override { return "dl::coro cancelled"; }
+};
+
+template <class T = void>
+class coro;
+
+namespace detail {
+
+/*
+ * frame_pool keeps freed coroutine frames on per size class free lists.
+ * Frames may be freed by a different worker than allocated them, in which
+ * case the memory simply migrates to the freeing worker's pool. Frames too
+ * large for any class, and frames beyond max_free per class, go to and from
+ * the global heap.
+ */
+class frame_pool {
+public:
+	static constexpr std::size_t granule  = 64;
+	static constexpr std::size_t classes  = 16;
+	static constexpr unsigned    max_free = 1024;
+
+	frame_pool() noexcept = default;
+	frame_pool(const frame_pool &) = delete;
+	frame_pool &operator=(const frame_pool &) = delete;
+
+	~frame_pool()
+	{
+		for (std::size_t c = 0; c < classes; ++ c) {
+			while (block *b = free_[c]) {
+				free_[c] = b->next;
+				::operator delete(b);
+			}
+		}
+	}
+
+	void *
+	allocate(std::size_t size)
+	{
+		std::size_t c = size_class(size);
+		if (c >= classes)
+			return ::operator new(size);
+		if (block *b = free_[c]) {
+			free_[c] = b->next;
+			-- count_[c];
+			return b;
+		}
+		return ::operator new((c + 1) * granule);
+	}
+
+	void
+	deallocate(void *p, std::size_t size) noexcept
+	{
+		std::size_t c = size_class(size);
+		if (c >= classes || count_[c] >= max_free) {
+			::operator delete(p);
+			return;
+		}
+		block *b = static_cast<block *>(p);
+		b->next = free_[c];
+		free_[c] = b;
+		++ count_[c];
+	}
+
+private:
+	struct block { block *next; };
+
+	static constexpr std::size_t
+	size_class(std::size_t size) noexcept
+	{
+		return size ? (size - 1) / granule : 0;
+	}
+
+	block    *free_[classes] = {};
+	unsigned  count_[classes] = {};
+};
+
+inline thread_local frame_pool this_frame_pool;
+
+/*
+ * promise_base is the part of every dl::coro<T> promise the runtime sees.
+ * task_ must remain the first member, resume() recovers the promise from
+ * the task pointer it is invoked with.
+ */
+struct promise_base {
+	dltask                  task_;
+	std::coroutine_handle<> self_;
+	std::exception_ptr      exception_;
+	bool                    completed_ = false;
+
+	static void *operator new(std::size_t size) { return this_frame_pool.allocate(size); }
+	static void  operator delete(void *p, std::size_t size) noexcept { this_frame_pool.deallocate(p, size); }
+
+	std::suspend_always initial_suspend() noexcept { return {}; }
+	std::suspend_always final_suspend() noexcept { completed_ = true; return {}; }
+	void unhandled_exception() noexcept { exception_ = std::current_exception(); }
+
+	void
+	rethrow_if_failed() const
+	{
+		if (exception_)
+			std::rethrow_exception(exception_);
+		if (!completed_)
+			throw cancelled_error();
+	}
+
+	static void
+	resume(DL_TASK_ARGS)
+	{
+		DL_TASK_ENTRY_NAMED_("dl::coro");
+		reinterpret_cast<promise_base *>(dlt_param)->self_.resume();
+	}
+};
+
+/*
+ * suspend() must be called from within await_suspend() of the coroutine
+ * owning parent, which is executing on a worker. parent's task is
+ * recaptured to resume the coroutine, each child is created joining to it
+ * and detached, then parent is detached. The awaiter, which lives in the
+ * parent frame, may be resumed and destroyed on another worker as soon as
+ * parent is detached, so nothing is touched afterwards.
+ */
+inline void
+suspend(promise_base &parent, promise_base *const *children, std::size_t n)
+{
+	dltask *self = &parent.task_;
+	dlrecapture(self, &promise_base::resume);
+	for (std::size_t i = 0; i < n; ++ i)
+		dl::create(children[i]->task_, &promise_base::resume, self);
+	for (std::size_t i = 0; i < n; ++ i)
+		dldetach(&children[i]->task_);
+	dldetach(self);
+}
+
+template <class T>
+struct promise_result {
+	std::optional<T> value_;
+
+	template <class U>
+	void return_value(U &&v) { value_.emplace(std::forward<U>(v)); }
+	T &get() { return *value_; }
+};
+
+template <>
+struct promise_result<void> {
+	void return_void() noexcept {}
+	void get() noexcept {}
+};
+
+template <std::size_t N>
+struct when_all_awaiter {
+	std::array<promise_base *, N> children;
+
+	bool await_ready() const noexcept { return N == 0; }
+
+	template <class P>
+	void
+	await_suspend(std::coroutine_handle<P> parent)
+	{
+		static_assert(std::is_base_of_v<promise_base, P>,
+		              "dl::when_all may only be awaited by dl::coro");
+		suspend(parent.promise(), children.data(), N);
+	}
+
+	void
+	await_resume() const
+	{
+		for (promise_base *c : children)
+			c->rethrow_if_failed();
+	}
+};
+
+inline void
+terminate_task(DL_TASK_ARGS)
+{
+	DL_TASK_ENTRY_NAMED_("dl::run");
+	dlterminate();
+}
+
+} /* namespace detail */
+
+template <class T>
+class coro {
+public:
+	struct promise_type : detail::promise_base, detail::promise_result<T> {
+		coro
+		get_return_object() noexcept
+		{
+			auto h = std::coroutine_handle<promise_type>::from_promise(*this);
+			self_ = h;
+			return coro(h);
+		}
+	};
+
+	coro(coro &&other) noexcept : h_(std::exchange(other.h_, nullptr)) {}
+	coro(const coro &) = delete;
+	coro &operator=(const coro &) = delete;
+	coro &operator=(coro &&) = delete;
+	~coro() { if (h_) h_.destroy(); }
+
+	promise_type &promise() const noexcept { return h_.promise(); }
+
+	decltype(auto)
+	result()
+	{
+		h_.promise().rethrow_if_failed();
+		return h_.promise().get();
+	}
+
+	auto
+	operator co_await() & noexcept
+	{
+		return awaiter{ h_ };
+	}
+
+	auto
+	operator co_await() && noexcept
+	{
+		return awaiter{ h_ };
+	}
+
+private:
+	struct awaiter {
+		std::coroutine_handle<promise_type> child;
+
+		bool await_ready() const noexcept { return false; }
+
+		template <class P>
+		void
+		await_suspend(std::coroutine_handle<P> parent)
+		{
+			static_assert(std::is_base_of_v<detail::promise_base, P>,
+			              "dl::coro may only be awaited by dl::coro");
+			detail::promise_base *c = &child.promise();
+			detail::suspend(parent.promise(), &c, 1);
+		}
+
+		T
+		await_resume()
+		{
+			child.promise().rethrow_if_failed();
+			if constexpr (!std::is_void_v<T>)
+				return std::move(child.promise().get());
+		}
+	};
+
+	explicit coro(std::coroutine_handle<promise_type> h) noexcept : h_(h) {}
+
+	std::coroutine_handle<promise_type> h_;
+};
+
+template <class... Ts>
+detail::when_all_awaiter<sizeof...(Ts)>
+when_all(coro<Ts> &... children)
+{
+	return { { &children.promise()... } };
+}
+
+/*
+ * dl::run() executes root with dlmainex(), or dlmain() if workers is not
+ * positive, and terminates once root completes. See dlmain() for return
+ * values; root's value is then available from root.result().
+ */
+template <class T>
+int
+run(coro<T> &root, int workers = 0,
+    dlwentryfn entry = nullptr, dlwexitfn exit = nullptr)
+{
+	dltask sink;
+	dl::create(sink, &detail::terminate_task);
+	dltask *t = dl::create(root.promise().task_,
+	                       &detail::promise_base::resume, &sink);
+	/* Only root holds sink now, which cannot be released until it runs */
+	dldetach(&sink);
+	return workers > 0 ? dlmainex(t, entry, exit, workers)
+	                   : dlmain(t, entry, exit);
+}
+
+} /* namespace dl */
+
+#endif /* DEADLOCK_CORO_HPP_ */
@@ -1,6 +1,12 @@
 #ifndef DEADLOCK_DL_H_
 #define DEADLOCK_DL_H_
 
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 /*
  * dltask should be treated as an opaque type by client code and only
  * manipulated by this public API. See internal.h for further explanation.
@@ -51,6 +57,58 @@ dltask dlcreate(dltaskfn fn, dltask *next);
 void   dldetach(dltask *task);
 void   dlrecapture(dltask *current_task, dltaskfn continuaton_fn);
 
+/*
+ * dlforkn() creates and releases n tasks at once, each invoking fn and each
+ * joining to next, which may be NULL. This is equivalent to calling
+ * dlcreate() and dldetach() on every task but next's wait count is updated
+ * once, every task is published to this worker's queue at once, and stalled
+ * workers are woken at most once. Like dlcreate(), next must not have been
+ * detached yet. Like dldetach(), this must be called from a worker thread.
+ *
+ * The tasks are located in a strided array: first points to the dltask of
+ * the first package and each subsequent dltask is stride bytes after the
+ * previous. For example, forking an array of packages:
+ * 	struct item_pkg {
+ * 		dltask task;
+ * 		...
+ * 	} items[N];
+ * 	dlforkn(item_run, &join, &items[0].task, N, sizeof(items[0]));
+ */
+void   dlforkn(dltaskfn fn, dltask *next, dltask *first, size_t n,
+               size_t stride);
+
+/*
+ * A dlcancel is a cancellation token which may be attached to any number of
+ * tasks, e.g. an entire subgraph serving a single request. Once cancellation
+ * is requested every attached task which has not yet begun executing is
+ * skipped: its function is not invoked but it still completes as usual,
+ * releasing its next task, so any joins remain consistent.
+ *
+ * dlcancel_init() initializes a token which has not been cancelled. A token
+ * must outlive every task it is attached to.
+ *
+ * dlcancel_request() requests cancellation. This may be called from any
+ * thread and cannot be undone, except by reinitializing the token.
+ *
+ * dlcancel_requested() returns nonzero if cancellation has been requested.
+ *
+ * dlcancel_attach() attaches a token, or NULL, to a task which has been
+ * created or recaptured but not detached. Tasks created by dlcreate() or
+ * dlforkn() from within a task inherit the creating task's token, so
+ * attaching a token to the root of a subgraph cancels the whole subgraph.
+ *
+ * dlcancelled() returns nonzero if cancellation has been requested on the
+ * token attached to the currently executing task. Long running tasks should
+ * poll this and return early.
+ */
+typedef struct dlcancel_ dlcancel;
+
+void dlcancel_init     (dlcancel *);
+void dlcancel_request  (dlcancel *);
+int  dlcancel_requested(const dlcancel *);
+void dlcancel_attach   (dltask *, dlcancel *);
+int  dlcancelled       (void);
+
 /*
  * DL_TASK_ENTRY downcasts the dltask arg to a typed structure and performs
  * static initialization of this task, registering it globally and storing
@@ -87,6 +145,12 @@ typedef void (*dlwexitfn) (int worker_index);
  * Either way the default scheduler is left uninitialized once this function
  * returns.
  *
+ * dlrun() behaves like dlmainex() but the scheduler also terminates on its
+ * own once it is quiescent: when every worker is idle and no task is queued
+ * there is nothing left to execute, so dlrun() returns. Tasks which are
+ * created but never detached do not keep dlrun() from returning. If workers
+ * is not positive one worker is started per processor.
+ *
  * dlterminate() signals the current task scheduler to terminate. Like
  * dlasync() this must be called from a worker thread.
  *
@@ -94,6 +158,7 @@ typedef void (*dlwexitfn) (int worker_index);
  */
 int dlmain(dltask *, dlwentryfn, dlwexitfn);
 int dlmainex(dltask *, dlwentryfn, dlwexitfn, int workers);
+int dlrun(dltask *, dlwentryfn, dlwexitfn, int workers);
 void dlterminate(void);
 int dlworker_index(void);
 
@@ -127,6 +192,10 @@ int dlworker_index(void);
  */
 #define DEADLOCK_CLSZ 128
 
+#ifdef __cplusplus
+}
+#endif
+
 #include "deadlock/internal.h"
 
 #endif /* DEADLOCK_DL_H_ */
@@ -0,0 +1,260 @@
+#ifndef DEADLOCK_DL_HPP_
+#define DEADLOCK_DL_HPP_
+
+/*
+ * A header-only C++17 wrapper around the C API in dl.h. Tasks are plain
+ * structs which inherit dl::task<> and are invoked through function
+ * pointers generated at compile time, so there is no type erasure and no
+ * allocation: a dl::task<> is exactly a dltask and calls compile down to the
+ * same dlcreate(), dldetach() and dlrecapture() calls a C package would make.
+ *
+ * For example a parallel reduction, which joins two children back to a
+ * continuation of itself:
+ * 	struct sum : dl::task<sum> {
+ * 		sum *left, *right;
+ * 		long result;
+ * 		void operator()() {
+ * 			if (leaf()) { result = ...; return; }
+ * 			dl::join j = continue_with<&sum::combine>();
+ * 			j.fork(*left);
+ * 			j.fork(*right);
+ * 		}
+ * 		void combine() { result = left->result + right->result; }
+ * 	};
+ *
+ * As with the C API, client code owns task storage, which must outlive the
+ * execution of the task.
+ */
+
+#include "deadlock/dl.h"
+#include "deadlock/future.h"
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+/*
+ * DL_FUNCSIG_ names the current function including template arguments,
+ * which is used to describe each instantiated task when graphing.
+ */
+#ifdef _MSC_VER
+#define DL_FUNCSIG_ __FUNCSIG__
+#else
+#define DL_FUNCSIG_ __PRETTY_FUNCTION__
+#endif
+
+namespace dl {
+
+class join;
+
+/*
+ * dl::create() initializes an existing dltask in place. dltask contains an
+ * atomic and cannot be assigned in C++, so this replaces the C idiom
+ * 	pkg->task = dlcreate(fn, next);
+ *
+ * dl::detach() is dldetach().
+ */
+inline dltask *
+create(dltask &slot, dltaskfn fn, dltask *next = nullptr)
+{
+	::new (static_cast<void *>(&slot)) dltask(dlcreate(fn, next));
+	return &slot;
+}
+
+inline void
+detach(dltask &t)
+{
+	dldetach(&t);
+}
+
+/*
+ * dl::task<Derived> is a CRTP base embedding a single dltask. Derived must
+ * define void operator()(), which is invoked when the task executes.
+ *
+ * create() creates the task, joining to next, which may be NULL, a raw
+ * dltask, or any other dl::task<>.
+ *
+ * detach() releases the task, see dldetach().
+ *
+ * continue_with<&Derived::member>() must be called from within this
+ * executing task. The task is recaptured to invoke member next, see
+ * dlrecapture(), and a dl::join is returned through which children may be
+ * forked. The task is detached when the join goes out of scope.
+ *
+ * recapture<&Derived::member>() recaptures without joining; the task must
+ * be detached explicitly.
+ *
+ * entry<&Derived::member>() returns the dltaskfn which invokes member,
+ * operator() by default, for use with the C API, e.g. dlforkn() over an
+ * array of Derived.
+ */
+template <class Derived>
+class task {
+public:
+	task() noexcept {}
+	task(const task &) = delete;
+	task &operator=(const task &) = delete;
+
+	dltask *handle() noexcept { return &dlt_; }
+
+	void create(dltask *next = nullptr) { dl::create(dlt_, &invoke<&Derived::operator()>, next); }
+	template <class Next>
+	void create(task<Next> &next) { create(next.handle()); }
+
+	void detach() { dldetach(&dlt_); }
+
+	template <void (Derived::*Member)()>
+	void recapture() { dlrecapture(&dlt_, &invoke<Member>); }
+
+	template <void (Derived::*Member)()>
+	join continue_with();
+
+	static constexpr dltaskfn entry() noexcept { return &invoke<&Derived::operator()>; }
+	template <void (Derived::*Member)()>
+	static constexpr dltaskfn entry() noexcept { return &invoke<Member>; }
+
+private:
+	template <void (Derived::*Member)()>
+	static void
+	invoke(DL_TASK_ARGS)
+	{
+		DL_TASK_ENTRY_NAMED_(DL_FUNCSIG_);
+		/* dlt_ is our only member so the pointers are interconvertible */
+		task *base = reinterpret_cast<task *>(dlt_param);
+		(static_cast<Derived *>(base)->*Member)();
+	}
+
+	dltask dlt_;
+};
+
+/*
+ * dl::closure<F> adapts any callable to a dl::task<>, storing it by value.
+ * dl::make_closure() deduces F; the result cannot be moved so it must
+ * initialize its final storage directly, e.g.
+ * 	auto c = dl::make_closure([&] { ... });
+ */
+template <class F>
+class closure : public task<closure<F>> {
+public:
+	template <class G>
+	explicit closure(G &&fn) : fn_(std::forward<G>(fn)) {}
+
+	void operator()() { fn_(); }
+
+private:
+	F fn_;
+};
+
+template <class F>
+closure<std::decay_t<F>>
+make_closure(F &&fn)
+{
+	return closure<std::decay_t<F>>(std::forward<F>(fn));
+}
+
+/*
+ * dl::join is an RAII join scope around a task which has been created or
+ * recaptured but not detached. Children forked through the join execute
+ * before the joined task, which is detached when the join is destroyed.
+ *
+ * fork() creates child joining to this scope's task and detaches it
+ * immediately; the joined task cannot execute until the scope ends.
+ */
+class join {
+public:
+	explicit join(dltask *successor) noexcept : successor_(successor) {}
+	template <class D>
+	explicit join(task<D> &successor) noexcept : successor_(successor.handle()) {}
+	join(join &&other) noexcept : successor_(std::exchange(other.successor_, nullptr)) {}
+	join(const join &) = delete;
+	join &operator=(const join &) = delete;
+	join &operator=(join &&) = delete;
+	~join() { if (successor_) dldetach(successor_); }
+
+	dltask *handle() const noexcept { return successor_; }
+
+	template <class D>
+	void fork(task<D> &child) { child.create(successor_); child.detach(); }
+
+	void fork(dltask &child, dltaskfn fn) { dl::create(child, fn, successor_); dldetach(&child); }
+
+private:
+	dltask *successor_;
+};
+
+template <class Derived>
+template <void (Derived::*Member)()>
+inline join
+task<Derived>::continue_with()
+{
+	recapture<Member>();
+	return join(&dlt_);
+}
+
+/*
+ * dl::future<T> is a typed, non-owning handle to a dlfuture holding a T,
+ * which must be trivially copyable since values are copied byte for byte.
+ * Handles are cheap to copy into as many packages as read the value.
+ *
+ * create() throws std::bad_alloc if insufficient memory exists. set()
+ * returns false if the future was already set. depend() throws
+ * std::bad_alloc if insufficient memory exists. See future.h for the rest.
+ */
+template <class T>
+class future {
+	static_assert(std::is_trivially_copyable_v<T>,
+	              "dl::future values are copied byte for byte");
+
+public:
+	future() noexcept = default;
+	explicit future(dlfuture *f) noexcept : f_(f) {}
+
+	static future
+	create()
+	{
+		dlfuture *f = dlfuture_create(sizeof(T));
+		if (!f) throw std::bad_alloc();
+		return future(f);
+	}
+
+	void destroy() noexcept { dlfuture_destroy(f_); f_ = nullptr; }
+
+	bool set(const T &value) noexcept { return dlfuture_set(f_, &value) == 0; }
+
+	void
+	depend(dltask *t)
+	{
+		if (dlfuture_depend(f_, t)) throw std::bad_alloc();
+	}
+
+	template <class D>
+	void depend(task<D> &t) { depend(t.handle()); }
+
+	bool ready() const noexcept { return dlfuture_ready(f_); }
+
+	const T &get() const noexcept { return *static_cast<const T *>(dlfuture_get(f_)); }
+
+	dlfuture *handle() const noexcept { return f_; }
+
+private:
+	dlfuture *f_ = nullptr;
+};
+
+/*
+ * dl::run() creates root and runs it with dlmainex(), or dlmain() if
+ * workers is not positive. See dlmain() for return values.
+ */
+template <class D>
+int
+run(task<D> &root, int workers = 0,
+    dlwentryfn entry = nullptr, dlwexitfn exit = nullptr)
+{
+	root.create();
+	return workers > 0 ? dlmainex(root.handle(), entry, exit, workers)
+	                   : dlmain(root.handle(), entry, exit);
+}
+
+} /* namespace dl */
+
+#endif /* DEADLOCK_DL_HPP_ */
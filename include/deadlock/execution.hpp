@@ -0,0 +1,652 @@
+#ifndef DEADLOCK_EXECUTION_HPP_
+#define DEADLOCK_EXECUTION_HPP_
+
+/*
+ * A sender/receiver (P2300, std::execution) scheduler backed by Deadlock,
+ * for C++17. Every algorithm maps directly onto dlcreate(), dldetach() and
+ * the per-worker work-stealing deques; there is no queue in between:
+ * 	schedule()  creates and detaches one task on the calling worker;
+ * 	then()      runs inline on whichever task completed its predecessor;
+ * 	bulk()      forks its chunks with dlforkn() and joins them to one task;
+ * 	when_all()  joins one arrival task per child to one task through the
+ * 	            same next_/wait_ counters dlcreate() uses.
+ *
+ * This is deliberately a small, self contained subset of P2300 shaped to
+ * match the standard interface rather than a conforming implementation:
+ * each sender has exactly one value completion, described by value_tuple,
+ * errors are always std::exception_ptr, and receivers are classes with
+ * set_value(), set_error() and set_stopped() members. Senders compose with
+ * operator|, e.g.
+ * 	auto work = dl::execution::schedule(sch)
+ * 	          | dl::execution::bulk(n, [&](std::size_t i) { ... })
+ * 	          | dl::execution::then([&] { return sum; });
+ *
+ * Operations must be started from a worker thread. sync_wait() runs a
+ * sender to completion by starting Deadlock with dlmain() and terminating
+ * once the sender completes, so it may only be called outside of Deadlock.
+ *
+ * Stop requests are Deadlock cancellation tokens: a sender started by a
+ * task whose token is requested completes with set_stopped() rather than
+ * set_value(), see dlcancel_attach().
+ */
+
+#include "deadlock/dl.hpp"
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <system_error>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace dl {
+namespace execution {
+
+template <class S, class R>
+using connect_result_t = decltype(std::declval<S>().connect(std::declval<R>()));
+
+template <class S>
+using value_tuple_t = typename std::decay_t<S>::value_tuple;
+
+/*
+ * sender_adaptor_closure is the base of every partially applied adaptor,
+ * e.g. then(f), which may be applied to a sender with operator|.
+ */
+template <class Derived>
+struct sender_adaptor_closure {};
+
+template <class S, class C,
+          class = std::enable_if_t<std::is_base_of_v<sender_adaptor_closure<std::decay_t<C>>,
+                                                     std::decay_t<C>>>>
+auto
+operator|(S &&sndr, C &&closure)
+{
+	return std::forward<C>(closure)(std::forward<S>(sndr));
+}
+
+namespace detail {
+
+/*
+ * claim_stop() takes a freshly created task away from its cancellation
+ * token, which the runtime would otherwise use to skip the task silently,
+ * and returns the token so the sender can complete with set_stopped().
+ */
+inline dlcancel *
+claim_stop(dltask &t) noexcept
+{
+	dlcancel *c = t.cancel_;
+	t.cancel_ = nullptr;
+	return c;
+}
+
+inline bool
+stop_requested(const dlcancel *c) noexcept
+{
+	return c && dlcancel_requested(const_cast<dlcancel *>(c));
+}
+
+template <class F, class Tuple>
+struct apply_result;
+
+template <class F, class... Ts>
+struct apply_result<F, std::tuple<Ts...>> {
+	using type = std::invoke_result_t<F, Ts &...>;
+};
+
+template <class T>
+using value_of_t = std::conditional_t<std::is_void_v<T>, std::tuple<>, std::tuple<T>>;
+
+} /* namespace detail */
+
+/*
+ * schedule(scheduler) completes with no values on a new task queued on the
+ * calling worker, from where it is free to be stolen.
+ */
+class schedule_sender {
+public:
+	using value_tuple = std::tuple<>;
+
+	template <class R>
+	class op : public dl::task<op<R>> {
+	public:
+		explicit op(R rcvr) : rcvr_(std::move(rcvr)) {}
+
+		void
+		start() noexcept
+		{
+			this->create();
+			stop_ = detail::claim_stop(*this->handle());
+			this->detach();
+		}
+
+		void
+		operator()()
+		{
+			if (detail::stop_requested(stop_))
+				rcvr_.set_stopped();
+			else
+				rcvr_.set_value();
+		}
+
+	private:
+		R         rcvr_;
+		dlcancel *stop_ = nullptr;
+	};
+
+	template <class R>
+	op<R> connect(R rcvr) && { return op<R>(std::move(rcvr)); }
+};
+
+class scheduler {
+public:
+	schedule_sender schedule() const noexcept { return {}; }
+
+	friend bool operator==(scheduler, scheduler) noexcept { return true; }
+	friend bool operator!=(scheduler, scheduler) noexcept { return false; }
+};
+
+inline scheduler get_scheduler() noexcept { return {}; }
+inline schedule_sender schedule(scheduler sch) noexcept { return sch.schedule(); }
+
+/*
+ * just(values...) completes inline with copies of values.
+ */
+template <class... Ts>
+class just_sender {
+public:
+	using value_tuple = std::tuple<Ts...>;
+
+	explicit just_sender(Ts... vs) : values_(std::move(vs)...) {}
+
+	template <class R>
+	class op {
+	public:
+		op(value_tuple values, R rcvr) : values_(std::move(values)), rcvr_(std::move(rcvr)) {}
+		op(const op &) = delete;
+		op &operator=(const op &) = delete;
+
+		void
+		start() noexcept
+		{
+			std::apply([this](Ts &... vs) { rcvr_.set_value(std::move(vs)...); },
+			           values_);
+		}
+
+	private:
+		value_tuple values_;
+		R           rcvr_;
+	};
+
+	template <class R>
+	op<R> connect(R rcvr) && { return op<R>(std::move(values_), std::move(rcvr)); }
+
+private:
+	value_tuple values_;
+};
+
+template <class... Ts>
+just_sender<std::decay_t<Ts>...>
+just(Ts &&... vs)
+{
+	return just_sender<std::decay_t<Ts>...>(std::forward<Ts>(vs)...);
+}
+
+/*
+ * then(sndr, f) invokes f with sndr's values, inline on the task which
+ * completed sndr, and completes with f's result. Exceptions thrown by f are
+ * forwarded to set_error().
+ */
+template <class S, class F>
+class then_sender {
+public:
+	using result_type = typename detail::apply_result<F, value_tuple_t<S>>::type;
+	using value_tuple = detail::value_of_t<result_type>;
+
+	then_sender(S sndr, F fn) : sndr_(std::move(sndr)), fn_(std::move(fn)) {}
+
+	template <class R>
+	class op {
+	public:
+		op(S &&sndr, F fn, R rcvr)
+		: fn_(std::move(fn)), rcvr_(std::move(rcvr)),
+		  inner_(std::move(sndr).connect(receiver{ this })) {}
+		op(const op &) = delete;
+		op &operator=(const op &) = delete;
+
+		void start() noexcept { inner_.start(); }
+
+	private:
+		struct receiver {
+			op *o;
+
+			template <class... As>
+			void
+			set_value(As &&... as) noexcept
+			{
+				op *self = o;
+				try {
+					if constexpr (std::is_void_v<result_type>) {
+						std::invoke(self->fn_, as...);
+					} else {
+						result_type r = std::invoke(self->fn_, as...);
+						self->rcvr_.set_value(std::move(r));
+						return;
+					}
+				} catch (...) {
+					self->rcvr_.set_error(std::current_exception());
+					return;
+				}
+				if constexpr (std::is_void_v<result_type>)
+					self->rcvr_.set_value();
+			}
+
+			void set_error(std::exception_ptr e) noexcept { o->rcvr_.set_error(std::move(e)); }
+			void set_stopped() noexcept { o->rcvr_.set_stopped(); }
+		};
+
+		F                                 fn_;
+		R                                 rcvr_;
+		connect_result_t<S, receiver>     inner_;
+	};
+
+	template <class R>
+	op<R> connect(R rcvr) && { return op<R>(std::move(sndr_), std::move(fn_), std::move(rcvr)); }
+
+private:
+	S sndr_;
+	F fn_;
+};
+
+template <class F>
+struct then_closure : sender_adaptor_closure<then_closure<F>> {
+	F fn;
+
+	template <class S>
+	then_sender<std::decay_t<S>, F>
+	operator()(S &&sndr) &&
+	{
+		return { std::forward<S>(sndr), std::move(fn) };
+	}
+};
+
+template <class F>
+then_closure<std::decay_t<F>>
+then(F &&fn)
+{
+	return { {}, std::forward<F>(fn) };
+}
+
+template <class S, class F,
+          class = std::enable_if_t<!std::is_base_of_v<sender_adaptor_closure<std::decay_t<S>>,
+                                                      std::decay_t<S>>>>
+then_sender<std::decay_t<S>, std::decay_t<F>>
+then(S &&sndr, F &&fn)
+{
+	return { std::forward<S>(sndr), std::forward<F>(fn) };
+}
+
+/*
+ * bulk(sndr, shape, f) invokes f(i, values...) for every i in [0, shape)
+ * once sndr completes, then completes with sndr's values. The shape is
+ * split into at most max_chunks contiguous chunks, each a task, which are
+ * forked with a single dlforkn() joining to one task which completes the
+ * bulk operation. The chunk tasks are allocated once, when connected.
+ * The first exception thrown by f is forwarded to set_error(), after which
+ * remaining indices are skipped.
+ */
+template <class S, class F>
+class bulk_sender {
+public:
+	using value_tuple = value_tuple_t<S>;
+
+	static constexpr std::size_t max_chunks = 256;
+
+	bulk_sender(S sndr, std::size_t shape, F fn)
+	: sndr_(std::move(sndr)), shape_(shape), fn_(std::move(fn)) {}
+
+	template <class R>
+	class op {
+	public:
+		op(S &&sndr, std::size_t shape, F fn, R rcvr)
+		: shape_(shape),
+		  nchunks_(shape < max_chunks ? shape : max_chunks),
+		  chunks_(new chunk[nchunks_ ? nchunks_ : 1]),
+		  fn_(std::move(fn)), rcvr_(std::move(rcvr)),
+		  inner_(std::move(sndr).connect(receiver{ this })) {}
+		op(const op &) = delete;
+		op &operator=(const op &) = delete;
+
+		void start() noexcept { inner_.start(); }
+
+	private:
+		struct chunk : dl::task<chunk> {
+			op          *o;
+			std::size_t  begin, end;
+			void operator()() { o->run(begin, end); }
+		};
+
+		struct join : dl::task<join> {
+			op *o;
+			void operator()() { o->finish(); }
+		};
+
+		struct receiver {
+			op *o;
+
+			template <class... As>
+			void
+			set_value(As &&... as) noexcept
+			{
+				o->values_.emplace(std::forward<As>(as)...);
+				o->fork();
+			}
+
+			void set_error(std::exception_ptr e) noexcept { o->rcvr_.set_error(std::move(e)); }
+			void set_stopped() noexcept { o->rcvr_.set_stopped(); }
+		};
+
+		void
+		fork() noexcept
+		{
+			join_.o = this;
+			join_.create();
+			stop_ = detail::claim_stop(*join_.handle());
+			if (nchunks_) {
+				std::size_t per = shape_ / nchunks_, extra = shape_ % nchunks_;
+				std::size_t begin = 0;
+				for (std::size_t i = 0; i < nchunks_; ++ i) {
+					chunk &c = chunks_[i];
+					c.o = this;
+					c.begin = begin;
+					begin += per + (i < extra);
+					c.end = begin;
+				}
+				dlforkn(chunk::entry(), join_.handle(),
+				        chunks_[0].handle(), nchunks_, sizeof(chunk));
+			}
+			join_.detach();
+		}
+
+		void
+		run(std::size_t begin, std::size_t end) noexcept
+		{
+			if (failed_.load(std::memory_order_relaxed))
+				return;
+			try {
+				std::apply([&](auto &... vs) {
+					for (std::size_t i = begin; i < end; ++ i)
+						std::invoke(fn_, i, vs...);
+				}, *values_);
+			} catch (...) {
+				if (!failed_.exchange(true))
+					error_ = std::current_exception();
+			}
+		}
+
+		void
+		finish() noexcept
+		{
+			if (detail::stop_requested(stop_))
+				rcvr_.set_stopped();
+			else if (failed_.load())
+				rcvr_.set_error(std::move(error_));
+			else
+				std::apply([this](auto &... vs) { rcvr_.set_value(std::move(vs)...); },
+				           *values_);
+		}
+
+		std::size_t                        shape_;
+		std::size_t                        nchunks_;
+		std::unique_ptr<chunk[]>           chunks_;
+		join                               join_;
+		dlcancel                          *stop_ = nullptr;
+		std::atomic<bool>                  failed_{ false };
+		std::exception_ptr                 error_;
+		std::optional<value_tuple>         values_;
+		F                                  fn_;
+		R                                  rcvr_;
+		connect_result_t<S, receiver>      inner_;
+	};
+
+	template <class R>
+	op<R>
+	connect(R rcvr) &&
+	{
+		return op<R>(std::move(sndr_), shape_, std::move(fn_), std::move(rcvr));
+	}
+
+private:
+	S           sndr_;
+	std::size_t shape_;
+	F           fn_;
+};
+
+template <class F>
+struct bulk_closure : sender_adaptor_closure<bulk_closure<F>> {
+	std::size_t shape;
+	F           fn;
+
+	template <class S>
+	bulk_sender<std::decay_t<S>, F>
+	operator()(S &&sndr) &&
+	{
+		return { std::forward<S>(sndr), shape, std::move(fn) };
+	}
+};
+
+template <class F>
+bulk_closure<std::decay_t<F>>
+bulk(std::size_t shape, F &&fn)
+{
+	return { {}, shape, std::forward<F>(fn) };
+}
+
+template <class S, class F>
+bulk_sender<std::decay_t<S>, std::decay_t<F>>
+bulk(S &&sndr, std::size_t shape, F &&fn)
+{
+	return { std::forward<S>(sndr), shape, std::forward<F>(fn) };
+}
+
+/*
+ * when_all(sndrs...) starts every sender and completes with all of their
+ * values concatenated once every one completes. Each child's completion
+ * releases an arrival task joined to a single task, so the join is the
+ * ordinary wait_ counter of that task. If any child fails or is stopped
+ * the first error, otherwise set_stopped(), is forwarded instead.
+ */
+template <class... Ss>
+class when_all_sender {
+public:
+	using value_tuple = decltype(std::tuple_cat(std::declval<value_tuple_t<Ss>>()...));
+
+	explicit when_all_sender(Ss... sndrs) : sndrs_(std::move(sndrs)...) {}
+
+	template <class R>
+	class op {
+		static constexpr std::size_t N = sizeof...(Ss);
+
+		template <std::size_t I>
+		struct receiver {
+			op *o;
+
+			template <class... As>
+			void
+			set_value(As &&... as) noexcept
+			{
+				std::get<I>(o->values_).emplace(std::forward<As>(as)...);
+				o->arrivals_[I].detach();
+			}
+
+			void
+			set_error(std::exception_ptr e) noexcept
+			{
+				if (!o->failed_.exchange(true))
+					o->error_ = std::move(e);
+				o->arrivals_[I].detach();
+			}
+
+			void
+			set_stopped() noexcept
+			{
+				o->stopped_.store(true);
+				o->arrivals_[I].detach();
+			}
+		};
+
+		/* Children are immovable so connect them in place */
+		template <class S, class Rc>
+		struct child {
+			struct connector { S &&sndr; Rc rcvr; };
+			connect_result_t<S, Rc> op;
+			child(connector c) : op(std::move(c.sndr).connect(std::move(c.rcvr))) {}
+		};
+
+		template <class Is>
+		struct children_of;
+
+		template <std::size_t... Is>
+		struct children_of<std::index_sequence<Is...>> {
+			using type = std::tuple<child<Ss, receiver<Is>>...>;
+		};
+
+		using children = typename children_of<std::index_sequence_for<Ss...>>::type;
+
+		struct arrival : dl::task<arrival> {
+			void operator()() {}
+		};
+
+		struct join : dl::task<join> {
+			op *o;
+			void operator()() { o->finish(); }
+		};
+
+	public:
+		op(std::tuple<Ss...> &&sndrs, R rcvr)
+		: op(std::move(sndrs), std::move(rcvr), std::index_sequence_for<Ss...>{}) {}
+		op(const op &) = delete;
+		op &operator=(const op &) = delete;
+
+		void
+		start() noexcept
+		{
+			join_.o = this;
+			join_.create();
+			stop_ = detail::claim_stop(*join_.handle());
+			for (arrival &a : arrivals_)
+				a.create(join_);
+			std::apply([](auto &... c) { (c.op.start(), ...); }, children_);
+			join_.detach();
+		}
+
+	private:
+		template <std::size_t... Is>
+		op(std::tuple<Ss...> &&sndrs, R rcvr, std::index_sequence<Is...>)
+		: rcvr_(std::move(rcvr)),
+		  children_(typename child<Ss, receiver<Is>>::connector{
+		            std::move(std::get<Is>(sndrs)), receiver<Is>{ this } }...) {}
+
+		void
+		finish() noexcept
+		{
+			if (failed_.load())
+				rcvr_.set_error(std::move(error_));
+			else if (stopped_.load() || detail::stop_requested(stop_))
+				rcvr_.set_stopped();
+			else
+				std::apply([this](auto &&... vs) { rcvr_.set_value(std::move(vs)...); },
+				           std::apply([](auto &... opt) { return std::tuple_cat(std::move(*opt)...); },
+				                      values_));
+		}
+
+		R                                               rcvr_;
+		std::tuple<std::optional<value_tuple_t<Ss>>...> values_;
+		std::array<arrival, N>                          arrivals_;
+		join                                            join_;
+		dlcancel                                       *stop_ = nullptr;
+		std::atomic<bool>                               failed_{ false };
+		std::atomic<bool>                               stopped_{ false };
+		std::exception_ptr                              error_;
+		children                                        children_;
+	};
+
+	template <class R>
+	op<R> connect(R rcvr) && { return op<R>(std::move(sndrs_), std::move(rcvr)); }
+
+private:
+	std::tuple<Ss...> sndrs_;
+};
+
+template <class... Ss>
+when_all_sender<std::decay_t<Ss>...>
+when_all(Ss &&... sndrs)
+{
+	return when_all_sender<std::decay_t<Ss>...>(std::forward<Ss>(sndrs)...);
+}
+
+/*
+ * sync_wait(sndr) runs Deadlock with dlmainex(), or dlmain() if workers is
+ * not positive, starts sndr on the first task and terminates once it
+ * completes. Its values are returned, or std::nullopt if it was stopped.
+ * An error is rethrown, and if Deadlock fails to start std::system_error is
+ * thrown with errno.
+ */
+namespace detail {
+
+template <class Values>
+struct sync_wait_state {
+	std::optional<Values> result;
+	std::exception_ptr    error;
+};
+
+template <class Values>
+struct sync_wait_receiver {
+	sync_wait_state<Values> *s;
+
+	template <class... As>
+	void
+	set_value(As &&... as) noexcept
+	{
+		s->result.emplace(std::forward<As>(as)...);
+		dlterminate();
+	}
+
+	void set_error(std::exception_ptr e) noexcept { s->error = std::move(e); dlterminate(); }
+	void set_stopped() noexcept { dlterminate(); }
+};
+
+} /* namespace detail */
+
+template <class S>
+std::optional<value_tuple_t<S>>
+sync_wait(S &&sndr, int workers = 0)
+{
+	using values = value_tuple_t<S>;
+	using op_t = connect_result_t<std::decay_t<S>, detail::sync_wait_receiver<values>>;
+
+	struct starter : dl::task<starter> {
+		op_t *op;
+		void operator()() { op->start(); }
+	};
+
+	detail::sync_wait_state<values> s;
+	op_t op = std::decay_t<S>(std::forward<S>(sndr)).connect(
+	                detail::sync_wait_receiver<values>{ &s });
+	starter root;
+	root.op = &op;
+	if (dl::run(root, workers))
+		throw std::system_error(errno, std::generic_category(), "dlmain");
+	if (s.error)
+		std::rethrow_exception(s.error);
+	return std::move(s.result);
+}
+
+} /* namespace execution */
+} /* namespace dl */
+
+#endif /* DEADLOCK_EXECUTION_HPP_ */
@@ -0,0 +1,38 @@
+#ifndef DEADLOCK_FIBER_H_
+#define DEADLOCK_FIBER_H_
+
+#include "deadlock/dl.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef DEADLOCK_FIBERS
+
+/*
+ * When compiled with DEADLOCK_FIBERS a task may run on its own stack, a
+ * fiber, and block on its children rather than being split into a chain of
+ * continuations with dlrecapture(). Fiber stacks are pooled by each worker
+ * and guarded by an inaccessible page to catch overflows.
+ *
+ * dlcreatefiber() behaves exactly like dlcreate() except the task is
+ * invoked on a fiber and may call dlawait().
+ *
+ * dlawait() must be called from a task created by dlcreatefiber(). child
+ * must have been created by dlcreate() or dlcreatefiber() with a NULL next
+ * pointer and must not have been detached. child is detached and the
+ * calling fiber is suspended, leaving the worker free to execute other
+ * tasks, until child completes. The fiber may be resumed on a different
+ * worker thread, so dlw_param must not be used after dlawait() returns and
+ * thread local state should be treated with care.
+ */
+dltask dlcreatefiber(dltaskfn fn, dltask *next);
+void   dlawait(dltask *child);
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DEADLOCK_FIBER_H_ */
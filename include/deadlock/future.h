@@ -0,0 +1,59 @@
+#ifndef DEADLOCK_FUTURE_H_
+#define DEADLOCK_FUTURE_H_
+
+#include "deadlock/dl.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * A dlfuture is a write-once value which tasks may depend on just like
+ * their children, so results flow between tasks without sharing mutable
+ * packages. Setting a future releases every task depending on it.
+ *
+ * Futures are allocated from the calling worker's pool. Values of up to
+ * DLFUTURE_INLINE_MAX bytes are stored inline, larger values are allocated
+ * once when the future is created.
+ *
+ * dlfuture_create() must be called from a worker thread and returns a new
+ * unset future holding size bytes, otherwise NULL is returned and errno is
+ * set to ENOMEM.
+ *
+ * dlfuture_destroy() frees a future. No task may depend on or read it
+ * anymore, which is usually guaranteed by destroying it from the last task
+ * that depends on it.
+ *
+ * dlfuture_set() must be called from a worker thread. The size bytes at
+ * value are copied into the future and every task depending on it is
+ * released, as if by dldetach(). Zero is returned on success, otherwise
+ * errno is set and:
+ * EBUSY shall be returned if the future was already set.
+ *
+ * dlfuture_depend() adds the future as a dependency of task, which must
+ * have been created and not yet detached. task will not be invoked until
+ * the future is set; if it is already set this does nothing. Zero is
+ * returned on success, otherwise errno is set and:
+ * ENOMEM shall be returned if insufficient memory exists.
+ *
+ * dlfuture_ready() returns nonzero if the future is set.
+ *
+ * dlfuture_get() returns the value of a set future. A task which depends on
+ * the future may always read it; otherwise dlfuture_ready() must be checked.
+ */
+#define DLFUTURE_INLINE_MAX 96
+
+typedef struct dlfuture_ dlfuture;
+
+dlfuture   *dlfuture_create (size_t size);
+void        dlfuture_destroy(dlfuture *);
+int         dlfuture_set    (dlfuture *, const void *value);
+int         dlfuture_depend (dlfuture *, dltask *task);
+int         dlfuture_ready  (const dlfuture *);
+const void *dlfuture_get    (const dlfuture *);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DEADLOCK_FUTURE_H_ */
@@ -1,33 +1,221 @@
 #ifndef DEADLOCK_GRAPH_H_
 #define DEADLOCK_GRAPH_H_
 
+/*
+ * Graph file formats accepted by dlgraph_joinex(). DLGRAPH_FORMAT_TEXT is
+ * the original human readable .dlg format; DLGRAPH_FORMAT_BINARY is the
+ * compact .dlgb format described in deadlock/graphfile.h, which is much
+ * faster to write and read; DLGRAPH_FORMAT_CHROME is Chrome Trace Event
+ * JSON (.json), with a track per worker and flow arrows for edges and
+ * continuations, which chrome://tracing and Perfetto open directly.
+ * DLGRAPH_FORMAT_JSON is only accepted by dlgraph_latency_dump().
+ */
+#define DLGRAPH_FORMAT_TEXT   0
+#define DLGRAPH_FORMAT_BINARY 1
+#define DLGRAPH_FORMAT_CHROME 2
+#define DLGRAPH_FORMAT_JSON   3
+
+#include <stddef.h>
+
+/*
+ * struct dlgraph_options configures a graph created by dlgraph_forkex().
+ *
+ * budget bounds the memory, in bytes, a graph may hold in record chunks.
+ * Records are appended to fixed size per worker chunks which are never
+ * copied. If budget is zero an unstreamed graph is unbounded, otherwise
+ * records which do not fit are dropped and counted when the graph is joined.
+ *
+ * stream_prefix, if not NULL, streams the graph to a file named by
+ * stream_prefix, the graph ID and .dlgs as it is captured, in the format
+ * described in deadlock/graphfile.h. Full chunks are handed to a background
+ * writer thread, so a graph may run indefinitely in bounded memory. A task
+ * which fills a chunk while budget is exhausted waits for the writer rather
+ * than dropping records. A zero budget holds up to 16 chunks per worker, and
+ * every budget is raised to at least one chunk of each kind per worker.
+ *
+ * sample, if greater than one, captures the graph with probability
+ * 1 / sample, so roughly one in sample forks is captured, and otherwise
+ * behaves as if disabled. The choice is made once per fork, so a graph is
+ * either captured whole or not at all and tasks of uncaptured graphs cost no
+ * more than with capture disabled. Since forks are chosen at random the
+ * nodes of captured graphs are an unbiased sample, e.g. per description
+ * mean and distribution of task durations, while totals are one sample'th.
+ *
+ * histogram_only, if nonzero, records nothing but the latency histograms
+ * described below: no node, label or dependency is kept, so the graph holds
+ * no memory however long it runs, and its join writes no file.
+ *
+ * disabled, if nonzero, forks no graph: the forking task and its children
+ * are captured as if dlgraph_forkex() had not been called, that is only by
+ * an enclosing graph if there is one, and the matching dlgraph_join() does
+ * nothing, exactly as when capture is disabled by dlgraph_enable().
+ */
+struct dlgraph_options {
+	const char *stream_prefix;
+	size_t      budget;
+	unsigned    sample;
+	int         histogram_only;
+	int         disabled;
+};
+
+/*
+ * struct dlgraph_latency summarizes the durations of every task of one node
+ * description, that is one task function, recorded by any graph: count
+ * tasks took mean_ns on average, between min_ns and max_ns, and p50_ns,
+ * p90_ns, p99_ns and p999_ns are the 50th, 90th, 99th and 99.9th
+ * percentiles. func, file and line describe the task function. A task
+ * which forks or joins a nested graph, or suspends its fiber, is counted
+ * once for each node it records. struct dlgraph_latencies holds count
+ * latencies in descs.
+ */
+struct dlgraph_latency {
+	const char        *func;
+	const char        *file;
+	unsigned long      line;
+	unsigned long long count;
+	unsigned long long mean_ns;
+	unsigned long long min_ns;
+	unsigned long long p50_ns;
+	unsigned long long p90_ns;
+	unsigned long long p99_ns;
+	unsigned long long p999_ns;
+	unsigned long long max_ns;
+};
+
+struct dlgraph_latencies {
+	size_t                  count;
+	struct dlgraph_latency *descs;
+};
+
 #ifdef DEADLOCK_GRAPH_EXPORT
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 /*
  * Deadlock exposes a simple graph visualization API.
  *
  * dlgraph_fork() may be invoked from within a task to create a new graph
  * which begins recording child tasks: "next" tasks and tasks invoked by
- * dlasync(). A graph must be joined by calling dlgraph_join().
+ * dlasync(). A graph must be joined by calling dlgraph_join(). The forking
+ * task is recorded from the point it called dlgraph_fork(), under that
+ * function and line.
+ *
+ * Graphs may be forked by tasks already captured by another graph, e.g. a
+ * library profiling its own work within an application which is profiling
+ * too. The nested graph records the forking task's children until it is
+ * joined, and the joining task carries on in the enclosing graph. The
+ * enclosing graph records the forking task up to the fork, then continues
+ * from it to the joining task, while the nested graph's header names the
+ * enclosing graph as its parent. Each task is only recorded into its
+ * innermost graph, so nesting costs tasks nothing. Nested graphs must be
+ * joined before the graphs enclosing them. Any number of graphs forked by
+ * unrelated tasks may be captured at once.
+ *
+ * dlgraph_forkex() behaves like dlgraph_fork() but configures the graph with
+ * options, see struct dlgraph_options. NULL options are the defaults
+ * dlgraph_fork() uses: an unbounded graph held in memory until it is joined.
  *
  * dlgraph_join() must be called to free the current graph. filename_prefix is
  * an optional file to write graph data into. If filename_prefix is NULL no
  * file is created. Otherwise, a file is created using filename_prefix as the
  * beginnings of a filename. TODO: This makes no sense
+ *
+ * dlgraph_joinex() behaves like dlgraph_join() but writes the graph in
+ * format, one of the DLGRAPH_FORMAT_ values above. dlgraph_join() writes
+ * text. When the graph is streamed both instead write any remaining records
+ * and complete the stream, ignoring their arguments.
+ *
+ * dlgraph_enable() enables or disables capture at runtime for graphs forked
+ * afterwards; graphs already forked are captured until they are joined.
+ * While disabled dlgraph_fork() and its dlgraph_join() do nothing and tasks
+ * outside any graph are not captured, which costs a task one predictable
+ * branch on entry and one once it returns. Capture is enabled unless the
+ * DEADLOCK_GRAPH environment variable is 0. dlgraph_enabled() returns
+ * nonzero if capture is enabled.
  */
-void dlgraph_fork(void);
+#define dlgraph_fork() dlgraph_forkex_(NULL, __FILE__, __func__, __LINE__)
+#define dlgraph_forkex(options) \
+	dlgraph_forkex_((options), __FILE__, __func__, __LINE__)
+void dlgraph_forkex_(const struct dlgraph_options *,
+                     const char *file, const char *func, unsigned long line);
 void dlgraph_join(const char *filename_prefix);
+void dlgraph_joinex(const char *filename_prefix, int format);
 
 /*
  * glgraph_label() sets the label of the current task, using printf like args.
  */
 void dlgraph_label(const char *format, ...);
 
+/*
+ * dlgraph_select() restricts capture to tasks whose function, as recorded
+ * in graph descriptions, is func. Each call selects another function; a
+ * NULL func clears the selection so every task is captured again. Tasks
+ * which are not selected still carry their graph to their children, but
+ * record no node, label or dependency, so a graph holds only selected
+ * nodes and dependencies on other tasks are unresolved. Selection applies
+ * to every graph, from the next task to begin. Zero is returned on success,
+ * otherwise errno is set and:
+ * ENOMEM shall be returned if insufficient memory exists.
+ */
+int dlgraph_select(const char *func);
+
+void dlgraph_enable(int enabled);
+int  dlgraph_enabled(void);
+
+/*
+ * Every worker counts the duration of each node it records, of any graph,
+ * in a log-linear histogram of its description, so the distribution of each
+ * task function's duration is known without keeping the graph. Histograms
+ * cost a task a few increments once it returns and accumulate across
+ * graphs and schedulers. Percentiles are accurate to about 3%, while count,
+ * mean, min and max are exact. Sampled graphs count one sample'th of tasks
+ * but their percentiles are unbiased.
+ *
+ * dlgraph_latency_snapshot() merges the histograms of every worker into
+ * latencies, one per description recorded, without stopping any worker, so
+ * it may be called from tasks or from any other thread. Zero is returned on
+ * success, otherwise errno is set and:
+ * ENOMEM shall be returned if insufficient memory exists.
+ *
+ * dlgraph_latency_free() frees the latencies of a successful snapshot.
+ *
+ * dlgraph_latency_reset() zeroes every histogram. Tasks completing
+ * meanwhile may be counted in part.
+ *
+ * dlgraph_latency_dump() writes a snapshot to filename, or to stdout if
+ * filename is NULL, in format, either DLGRAPH_FORMAT_TEXT, a table, or
+ * DLGRAPH_FORMAT_JSON, an array of objects named like the members of
+ * struct dlgraph_latency. Zero is returned on success, otherwise errno is
+ * set and:
+ * EINVAL shall be returned if format is neither;
+ * ENOMEM shall be returned if insufficient memory exists;
+ * or any error of fopen(), fclose() or fflush() shall be returned.
+ */
+int  dlgraph_latency_snapshot(struct dlgraph_latencies *);
+void dlgraph_latency_free(struct dlgraph_latencies *);
+void dlgraph_latency_reset(void);
+int  dlgraph_latency_dump(const char *filename, int format);
+
+#ifdef __cplusplus
+}
+#endif
+
 #else
 
 static inline void dlgraph_fork(void) {}
+static inline void dlgraph_forkex(const struct dlgraph_options *options) { (void)options; }
 static inline void dlgraph_join(const char *filename) { (void)filename; }
+static inline void dlgraph_joinex(const char *filename, int format) { (void)filename; (void)format; }
 static inline void dlgraph_label(const char *format, ...) { (void) format; }
+static inline void dlgraph_enable(int enabled) { (void)enabled; }
+static inline int  dlgraph_enabled(void) { return 0; }
+static inline int  dlgraph_select(const char *func) { (void)func; return 0; }
+static inline int  dlgraph_latency_snapshot(struct dlgraph_latencies *l) { l->count = 0; l->descs = NULL; return 0; }
+static inline void dlgraph_latency_free(struct dlgraph_latencies *l) { (void)l; }
+static inline void dlgraph_latency_reset(void) {}
+static inline int  dlgraph_latency_dump(const char *filename, int format) { (void)filename; (void)format; return 0; }
 
 #endif
 
@@ -0,0 +1,186 @@
+#ifndef DEADLOCK_GRAPHFILE_H_
+#define DEADLOCK_GRAPHFILE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * The binary graph format written by dlgraph_joinex() with
+ * DLGRAPH_FORMAT_BINARY, and a small library to read it back. Every record
+ * is fixed size and naturally aligned so a reader may mmap a file and use
+ * the record arrays in place. Values are in the byte order of the machine
+ * which wrote the file, recorded in the header.
+ *
+ * A file consists of:
+ * 	struct dlgraphfile_header;
+ * 	ndescs struct dlgraphfile_desc, at descs_offset;
+ * 	nworkers struct dlgraphfile_worker, at workers_offset;
+ * 	the string table, at strings_offset, holding NUL terminated file and
+ * 	function names referred to by descriptions;
+ * 	then for each worker, at the offsets in its dlgraphfile_worker, its
+ * 	nodes, edges and continuations, and its label buffer holding NUL
+ * 	terminated node labels.
+ *
+ * Timestamps are nanoseconds relative to the header's base_ns, the earliest
+ * timestamp in the graph, and nodes store their duration rather than their
+ * end time. Offsets are from the start of the file and are 8 byte aligned.
+ *
+ * Task IDs are 64 bit. Their most significant 16 bits are the index + 1 of
+ * the worker which created the task, or zero if it was created outside the
+ * scheduler, and the rest count that worker's tasks. Version 1 files hold
+ * 32 bit IDs whose most significant byte is the worker.
+ *
+ * A graph forked while another was being captured is nested within it, and
+ * its header's parent_id is the ID of that graph, otherwise
+ * DLGRAPHFILE_NO_PARENT. Version 1 and 2 headers end before parent_id.
+ * Readers accept every version.
+ */
+#define DLGRAPHFILE_MAGIC      "DLGRAPH"
+#define DLGRAPHFILE_VERSION    3
+#define DLGRAPHFILE_BYTE_ORDER 0x01020304u
+#define DLGRAPHFILE_NO_LABEL   UINT32_MAX
+#define DLGRAPHFILE_NO_PARENT  UINT64_MAX
+
+/*
+ * A graph forked with a stream prefix, see dlgraph_forkex(), is written as
+ * it is captured rather than laid out as above. A stream begins with a
+ * struct dlgraphfile_header whose magic is DLGRAPHFILE_STREAM_MAGIC, in
+ * which only version, byte_order, id, base_ns, nworkers and parent_id are
+ * set. Chunks follow, each a struct dlgraphfile_chunk then size bytes of
+ * records of one kind, padded to 8 bytes. Chunks of one kind from one worker
+ * appear in order, so a worker's labels are the concatenation of its label
+ * chunks. Descriptions and the string table are the last chunks, written
+ * once the graph is joined. dlgraphfile_open() reads streams as if they were
+ * binary graphs, including streams cut short, which lack descriptions.
+ */
+#define DLGRAPHFILE_STREAM_MAGIC        "DLGSTRM"
+#define DLGRAPHFILE_CHUNK_NODES         0
+#define DLGRAPHFILE_CHUNK_EDGES         1
+#define DLGRAPHFILE_CHUNK_CONTINUATIONS 2
+#define DLGRAPHFILE_CHUNK_LABELS        3
+#define DLGRAPHFILE_CHUNK_DESCS         4
+#define DLGRAPHFILE_CHUNK_STRINGS       5
+
+struct dlgraphfile_chunk {
+	uint32_t kind;
+	uint32_t worker;
+	uint64_t size;
+};
+
+struct dlgraphfile_header {
+	char     magic[8];
+	uint32_t version;
+	uint32_t byte_order;
+	uint64_t id;
+	uint64_t base_ns;
+	uint32_t nworkers;
+	uint32_t ndescs;
+	uint64_t descs_offset;
+	uint64_t workers_offset;
+	uint64_t strings_offset;
+	uint64_t strings_size;
+	uint64_t parent_id;
+};
+
+/* file and func are offsets into the string table */
+struct dlgraphfile_desc {
+	uint32_t file;
+	uint32_t func;
+	uint32_t line;
+	uint32_t reserved;
+};
+
+struct dlgraphfile_worker {
+	uint64_t nodes_offset;
+	uint64_t nodes_count;
+	uint64_t edges_offset;
+	uint64_t edges_count;
+	uint64_t continuations_offset;
+	uint64_t continuations_count;
+	uint64_t labels_offset;
+	uint64_t labels_size;
+};
+
+/* label is an offset into the worker's label buffer or DLGRAPHFILE_NO_LABEL */
+struct dlgraphfile_node {
+	uint64_t task;
+	uint32_t desc;
+	uint32_t label;
+	uint64_t begin_ns;
+	uint64_t duration_ns;
+};
+
+/* Edges and continuations join task IDs, *NOT* node indices */
+struct dlgraphfile_edge {
+	uint64_t ts_ns;
+	uint64_t head;
+	uint64_t tail;
+};
+
+struct dlgraphfile_continuation {
+	uint64_t head;
+	uint64_t tail;
+};
+
+/*
+ * dlgraphfile_open() opens a graph written by Deadlock in the binary, stream
+ * or text format. Binary files are mapped into memory; streams and text
+ * files are parsed into the same records, with every edge and continuation assigned
+ * to worker zero since the text format does not record which worker added
+ * them. Zero is returned on success and *out is set, otherwise errno is set
+ * and:
+ * EINVAL shall be returned if the file is not a graph, is truncated, or was
+ * written with an unsupported version or byte order;
+ * ENOMEM shall be returned if insufficient memory exists;
+ * or any error returned by opening, reading or mapping the file.
+ *
+ * dlgraphfile_close() unmaps or frees a graph.
+ *
+ * dlgraphfile_header() returns the header of a graph, as of the current
+ * version whatever the version of the file. For text files id is unknown
+ * and is zero, and parent_id is unknown and is DLGRAPHFILE_NO_PARENT.
+ *
+ * dlgraphfile_desc() returns the i-th node description; dlgraphfile_string()
+ * returns a string from the string table.
+ *
+ * dlgraphfile_nodes(), dlgraphfile_edges() and dlgraphfile_continuations()
+ * return the records of a worker and store their count in count.
+ *
+ * dlgraphfile_label() returns a node's label or NULL if it has none.
+ *
+ * dlgraphfile_task_worker() returns the worker index + 1 encoded in a task
+ * ID, or zero for tasks created outside the scheduler, according to the
+ * graph's version. If seq is not NULL the rest of the ID, which counts that
+ * worker's tasks, is stored in it.
+ */
+typedef struct dlgraphfile_ dlgraphfile;
+
+int  dlgraphfile_open (dlgraphfile **out, const char *path);
+void dlgraphfile_close(dlgraphfile *);
+
+const struct dlgraphfile_header *dlgraphfile_header(const dlgraphfile *);
+const struct dlgraphfile_desc   *dlgraphfile_desc  (const dlgraphfile *,
+                                                    uint32_t i);
+const char *dlgraphfile_string(const dlgraphfile *, uint32_t offset);
+
+const struct dlgraphfile_node *
+dlgraphfile_nodes(const dlgraphfile *, uint32_t worker, size_t *count);
+const struct dlgraphfile_edge *
+dlgraphfile_edges(const dlgraphfile *, uint32_t worker, size_t *count);
+const struct dlgraphfile_continuation *
+dlgraphfile_continuations(const dlgraphfile *, uint32_t worker, size_t *count);
+const char *
+dlgraphfile_label(const dlgraphfile *, uint32_t worker,
+                  const struct dlgraphfile_node *);
+uint32_t
+dlgraphfile_task_worker(const dlgraphfile *, uint64_t task, uint64_t *seq);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DEADLOCK_GRAPHFILE_H_ */
@@ -0,0 +1,76 @@
+#ifndef DEADLOCK_HOOKS_H_
+#define DEADLOCK_HOOKS_H_
+
+#include "deadlock/dl.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Hooks let an external profiler, e.g. Tracy or Optick, observe every task
+ * without instrumenting task bodies. Each hook is called on the worker
+ * thread where the event happens, and worker is that worker's index.
+ *
+ * task_begin is called as a task begins, or a fiber resumes. A task
+ * captured by a graph begins in DL_TASK_ENTRY(), once its description is
+ * known, otherwise just before its function is invoked.
+ *
+ * task_end is called once a task's function returns, its fiber suspends,
+ * or it is skipped because it was cancelled. The task may be freed or
+ * reused as soon as it returns, so only its address should be used after.
+ *
+ * spawn is called as a task becomes ready and is queued, or invoked
+ * immediately because its worker's queue is full. A task released by the
+ * task it waited on is invoked directly by that worker without spawning.
+ *
+ * steal is called when thief steals task from victim's queue.
+ *
+ * park is called before a worker with no work blocks, and unpark once it
+ * is woken.
+ *
+ * struct dlhook_task describes a task to task_begin and task_end: fn is the
+ * task's function, desc its node description and label its graph label, if
+ * the task is captured by a graph and has one, otherwise NULL. A label is
+ * only known by task_end. cancelled is nonzero if task_end follows a task
+ * which was skipped. ctx is passed back to every hook.
+ *
+ * dlhooks_register() registers hooks, replacing any registered before, or
+ * unregisters them if hooks is NULL. Any hook may be NULL. hooks must
+ * remain valid until replaced and every worker has returned from its
+ * hooks, e.g. until its scheduler exits. Hooks may be registered while
+ * tasks run, and are seen by each worker at its next event. Zero is
+ * returned on success, otherwise errno is set and:
+ * ENOTSUP shall be returned if deadlock was built without DEADLOCK_HOOKS.
+ *
+ * Hooks are only compiled in with DEADLOCK_HOOKS, so otherwise they cost
+ * nothing. With DEADLOCK_HOOKS each event costs a load and a predictable
+ * branch while no hooks are registered.
+ */
+struct dlgraph_node_description;
+
+struct dlhook_task {
+	dltask                                *task;
+	dltaskfn                               fn;
+	const struct dlgraph_node_description *desc;
+	const char                            *label;
+	int                                    cancelled;
+};
+
+struct dlhooks {
+	void *ctx;
+	void (*task_begin)(void *ctx, int worker, const struct dlhook_task *);
+	void (*task_end)  (void *ctx, int worker, const struct dlhook_task *);
+	void (*spawn)     (void *ctx, int worker, dltask *);
+	void (*steal)     (void *ctx, int thief, int victim, dltask *);
+	void (*park)      (void *ctx, int worker);
+	void (*unpark)    (void *ctx, int worker);
+};
+
+int dlhooks_register(const struct dlhooks *hooks);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DEADLOCK_HOOKS_H_ */
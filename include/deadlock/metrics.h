@@ -0,0 +1,77 @@
+#ifndef DEADLOCK_METRICS_H_
+#define DEADLOCK_METRICS_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * A running scheduler may publish live metrics of its workers into a POSIX
+ * shared memory object, which other processes such as tools/dltop map read
+ * only to watch it, like top.
+ *
+ * dlmetrics_publish() publishes the metrics of every scheduler started
+ * afterwards to the shared memory object name, e.g. "/myservice". The
+ * object is created when a scheduler starts, replacing any object of that
+ * name, and is unlinked once it exits. A NULL name stops publishing. Unless
+ * dlmetrics_publish() is called, the DEADLOCK_METRICS environment variable
+ * names the object, if it is set. A scheduler which fails to create the
+ * object prints why and runs without publishing. Zero is returned on
+ * success, otherwise errno is set and:
+ * ENAMETOOLONG shall be returned if name is longer than DLMETRICS_NAME_MAX;
+ * ENOTSUP shall be returned if shared memory is not supported, on Windows.
+ *
+ * The object holds a struct dlmetrics_header followed by nworkers struct
+ * dlmetrics_worker, each 64 bytes. Readers should check magic, version and
+ * worker_size before trusting the rest. Layouts of later versions only
+ * append members. Every member is an aligned integer written with a single
+ * store, so readers see each member whole, but may see members of one
+ * worker from slightly different moments. running is nonzero while the
+ * scheduler runs and cleared before the object is unlinked. pid is the
+ * publishing process.
+ *
+ * Each worker writes only its own struct dlmetrics_worker, as it changes
+ * state: state is one of the DLMETRICS_ states below; queued is how many
+ * tasks were in its queue, head - tail, when it last took a task; executed,
+ * steal_attempts, steals, stalls and parked_ns are its counters, see
+ * deadlock/stats.h. Rates are found by sampling counters twice.
+ */
+#define DLMETRICS_NAME_MAX 255
+#define DLMETRICS_MAGIC    UINT64_C(0x43495254454d4c44) /* "DLMETRIC" */
+#define DLMETRICS_VERSION  1
+
+#define DLMETRICS_IDLE   0 /* looking for a task */
+#define DLMETRICS_BUSY   1 /* executing tasks */
+#define DLMETRICS_PARKED 2 /* blocked waiting for a task */
+#define DLMETRICS_EXITED 3 /* the worker has exited */
+
+struct dlmetrics_header {
+	uint64_t magic;
+	uint32_t version;
+	uint32_t worker_size;
+	uint64_t pid;
+	uint32_t nworkers;
+	uint32_t running;
+	uint64_t reserved[4];
+};
+
+struct dlmetrics_worker {
+	uint64_t state;
+	uint64_t queued;
+	uint64_t executed;
+	uint64_t steal_attempts;
+	uint64_t steals;
+	uint64_t stalls;
+	uint64_t parked_ns;
+	uint64_t reserved;
+};
+
+int dlmetrics_publish(const char *name);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DEADLOCK_METRICS_H_ */
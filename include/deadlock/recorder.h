@@ -0,0 +1,58 @@
+#ifndef DEADLOCK_RECORDER_H_
+#define DEADLOCK_RECORDER_H_
+
+#include "deadlock/dl.h"
+
+#ifdef DEADLOCK_FLIGHT_RECORDER
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * When compiled with DEADLOCK_FLIGHT_RECORDER each worker records task
+ * begin and end, steal, stall and wake events into a fixed size ring,
+ * keeping only its most recent events. Recording costs a timestamp and a
+ * few stores per event, and the rings can be dumped at any moment to see
+ * what the scheduler was doing just before, e.g., a latency spike.
+ *
+ * Dumps are text, one event per line, oldest first for each worker:
+ * 	<worker> <ns> <event> <argument>
+ * where event is begin or end, with the task's address as argument; steal,
+ * with the victim worker's index; or stall or wake. Timestamps are those of
+ * graph export. Rings are read while workers continue to write them, so
+ * the oldest few events of a busy worker may be torn.
+ *
+ * Only the most recently started scheduler is recorded. Nothing is dumped
+ * outside dlmain() and friends.
+ *
+ * dlrecorder_dump() writes every worker's ring to the file path. Zero is
+ * returned on success, otherwise errno is set and returned:
+ * ENODATA shall be returned if no scheduler is running;
+ * or any error returned by opening or writing the file.
+ *
+ * dlrecorder_install() dumps the rings to path whenever the process aborts,
+ * and whenever signal signo is raised unless signo is zero. Dumping only
+ * uses async-signal-safe calls. The abort handler dumps then restores the
+ * default action and raises SIGABRT again. Zero is returned on success,
+ * otherwise errno is set and:
+ * EINVAL shall be returned if path is too long or signo is invalid;
+ * or any error returned by installing a signal handler.
+ */
+int dlrecorder_dump(const char *path);
+int dlrecorder_install(const char *path, int signo);
+
+#ifdef __cplusplus
+}
+#endif
+
+#else
+
+#include <errno.h>
+
+static inline int dlrecorder_dump(const char *path) { (void)path; return errno = ENOSYS; }
+static inline int dlrecorder_install(const char *path, int signo) { (void)path; (void)signo; return errno = ENOSYS; }
+
+#endif
+
+#endif /* DEADLOCK_RECORDER_H_ */
@@ -0,0 +1,77 @@
+#ifndef DEADLOCK_STATS_H_
+#define DEADLOCK_STATS_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Every worker counts what its scheduler loop does. Counters are per-worker
+ * atomics written only by their worker, with a relaxed load and store rather
+ * than a locked read-modify-write, so counting costs a plain increment and is
+ * always enabled. They are meant for tuning task grain size and worker count:
+ * e.g. many stalls and steal attempts per task executed suggest tasks too
+ * fine to keep workers busy, while many inline executions suggest queues
+ * overflowing.
+ *
+ * Only the most recently started scheduler is counted. Counters start at
+ * zero with each scheduler.
+ *
+ * struct dlstats_worker holds one worker's counters, or their sum:
+ * executed counts tasks invoked, including cancelled tasks and each resume
+ * of a fiber; taken counts tasks taken from the worker's own queue;
+ * steal_attempts, steals and steal_retries count attempts to steal from
+ * another worker's queue, those which succeeded, and those which lost a race
+ * for the last task and were retried; stalls and wakes count the times the
+ * worker parked waiting for work and was woken; inline_executions counts
+ * tasks executed immediately because the worker's queue was full; and
+ * parked_ns is the time spent parked.
+ *
+ * struct dlstats_victim holds the steal counters of one thief and victim
+ * pair, which sum to the steal counters of the thief.
+ *
+ * dlstats_snapshot() reads the counters of every worker of the running
+ * scheduler into stats without stopping it, so each counter is current but
+ * counters are not read at one instant. total is the sum of workers, which
+ * holds nworkers entries, and victims holds nworkers * nworkers entries
+ * indexed by thief * nworkers + victim. Snapshots may be taken from tasks or
+ * from any other thread. Zero is returned on success, otherwise errno is set
+ * and:
+ * ENODATA shall be returned if no scheduler is running;
+ * ENOMEM shall be returned if insufficient memory exists.
+ *
+ * dlstats_free() frees the arrays of a successful snapshot.
+ */
+struct dlstats_worker {
+	unsigned long long executed;
+	unsigned long long taken;
+	unsigned long long steal_attempts;
+	unsigned long long steals;
+	unsigned long long steal_retries;
+	unsigned long long stalls;
+	unsigned long long wakes;
+	unsigned long long inline_executions;
+	unsigned long long parked_ns;
+};
+
+struct dlstats_victim {
+	unsigned long long steal_attempts;
+	unsigned long long steals;
+	unsigned long long steal_retries;
+};
+
+struct dlstats {
+	int                    nworkers;
+	struct dlstats_worker  total;
+	struct dlstats_worker *workers;
+	struct dlstats_victim *victims;
+};
+
+int  dlstats_snapshot(struct dlstats *);
+void dlstats_free    (struct dlstats *);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DEADLOCK_STATS_H_ */
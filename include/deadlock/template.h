@@ -0,0 +1,61 @@
+#ifndef DEADLOCK_TEMPLATE_H_
+#define DEADLOCK_TEMPLATE_H_
+
+#include "deadlock/dl.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * A dltemplate records the shape of a task graph once so that it may be
+ * replayed many times, e.g. once per frame, without paying for dlcreate()
+ * and dldetach() on every task. Recording stores each task's function and
+ * next pointer; finalizing precomputes every task's wait count, the root
+ * tasks which wait on nothing, and how many recorded tasks join to each
+ * task outside of the template. Replaying resets every task with plain
+ * stores and releases the roots in one go.
+ *
+ * The tasks themselves are still owned by client code, usually embedded in
+ * packages just like any other task, and must outlive the template.
+ *
+ * dltemplate_create() returns a new empty template, otherwise NULL is
+ * returned and errno is set.
+ *
+ * dltemplate_destroy() frees a template. It must not be replaying.
+ *
+ * dltemplate_add() records a task which invokes fn and joins to next, just
+ * like dlcreate(). next may be NULL, another recorded task, or any task
+ * outside of the template which has not been detached when the template is
+ * replayed. Zero is returned on success, otherwise errno is set and:
+ * EBUSY shall be returned if the template was already finalized;
+ * ENOMEM shall be returned if insufficient memory exists to record the task.
+ *
+ * dltemplate_finalize() must be called once after every task is recorded.
+ * Zero is returned on success, otherwise errno is set and:
+ * EBUSY shall be returned if the template was already finalized;
+ * EINVAL shall be returned if a task was recorded twice, no task is a
+ * root, or any task is on or only reachable through a cycle of next, in
+ * which case the template could never complete;
+ * ENOMEM shall be returned if insufficient memory exists.
+ *
+ * dltemplate_replay() must be called from a worker thread. Every recorded
+ * task is reset and every root is released, as if every task had been
+ * created with dlcreate() and detached with dldetach(). A template must not
+ * be replayed again until every one of its tasks has been invoked, which is
+ * usually guaranteed by joining the template to a task outside of it.
+ */
+typedef struct dltemplate_ dltemplate;
+
+dltemplate *dltemplate_create  (void);
+void        dltemplate_destroy (dltemplate *);
+int         dltemplate_add     (dltemplate *, dltask *task, dltaskfn fn,
+                                dltask *next);
+int         dltemplate_finalize(dltemplate *);
+void        dltemplate_replay  (dltemplate *);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DEADLOCK_TEMPLATE_H_ */
@@ -0,0 +1,72 @@
+#ifndef DEADLOCK_WATCHDOG_H_
+#define DEADLOCK_WATCHDOG_H_
+
+#include "deadlock/dl.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * A task which runs for a long time occupies its worker and starves every
+ * task queued behind it. The watchdog is a thread which reports each task
+ * that has run for longer than a threshold, once, while it is still running,
+ * without capturing a graph.
+ *
+ * Each worker stamps the time the task it executes began, and the watchdog
+ * checks every stamp a few times per threshold, but at least every 10ms.
+ * Only the outermost task on a worker is stamped: a task invoked within
+ * another, because a queue was full, is part of its time.
+ *
+ * dlwatchdog_configure() configures the watchdog of every scheduler started
+ * afterwards, which starts and exits with it. The configuration is copied,
+ * and a NULL configuration disables the watchdog. Unless
+ * dlwatchdog_configure() is called, the DEADLOCK_WATCHDOG environment
+ * variable enables it, set to the threshold in milliseconds, logging to
+ * stderr. Zero is returned on success, otherwise errno is set and:
+ * EINVAL shall be returned if threshold_ns is zero;
+ * ENOTSUP shall be returned if deadlock was built without DEADLOCK_WATCHDOG.
+ *
+ * struct dlwatchdog: threshold_ns is how long a task may run before it is
+ * reported. report is called on the watchdog thread with ctx and the
+ * worker executing the task, or if NULL a line is logged to stderr. Reports
+ * are made in turn, and no worker is checked while one is made, so a report
+ * should return quickly.
+ *
+ * struct dlwatchdog_task describes a task which has run for running_ns: fn
+ * is its function. desc is its node description, with its function, file
+ * and line, if it is captured by a graph, e.g. one only keeping histograms,
+ * see deadlock/graph.h. label is the last label it set by dlgraph_label(),
+ * whether or not it is captured. Otherwise each is NULL. Without
+ * DEADLOCK_GRAPH_EXPORT tasks are neither described nor labelled, so desc
+ * and label are always NULL and only task and fn identify a task. The
+ * task may complete while it is reported, so task should only be used as
+ * an address, and label is only valid until report returns.
+ *
+ * With DEADLOCK_WATCHDOG each task costs a load and a predictable branch
+ * while no watchdog runs, and reading the clock while one does. Labelling a
+ * task also formats the label for the watchdog.
+ */
+struct dlgraph_node_description;
+
+struct dlwatchdog_task {
+	dltask                                *task;
+	dltaskfn                               fn;
+	const struct dlgraph_node_description *desc;
+	const char                            *label;
+	unsigned long long                     running_ns;
+};
+
+struct dlwatchdog {
+	unsigned long long threshold_ns;
+	void *ctx;
+	void (*report)(void *ctx, int worker, const struct dlwatchdog_task *);
+};
+
+int dlwatchdog_configure(const struct dlwatchdog *watchdog);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DEADLOCK_WATCHDOG_H_ */
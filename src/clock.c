@@ -0,0 +1,76 @@
+#include "clock.h"
+#include <stdatomic.h>
+
+#ifdef DLCLOCK_TSC_
+#ifdef _MSC_VER
+#include <intrin.h> /* __cpuid */
+#else
+#include <cpuid.h>  /* __get_cpuid */
+#endif
+#endif
+
+struct dlclock dlclock;
+
+/* Calibrate for 5ms, enough to make bracketing error a few parts per million */
+#define DLCLOCK_CALIBRATION_NS 5000000
+
+#ifdef DLCLOCK_TSC_
+/*
+ * dlclock_invariant_tsc() returns non-zero if CPUID reports an invariant
+ * time stamp counter, bit 8 of EDX in extended leaf 0x80000007.
+ */
+static int
+dlclock_invariant_tsc(void)
+{
+#ifdef _MSC_VER
+	int r[4];
+	__cpuid(r, (int)0x80000000);
+	if ((unsigned)r[0] < 0x80000007)
+		return 0;
+	__cpuid(r, (int)0x80000007);
+	return (r[3] >> 8) & 1;
+#else
+	unsigned a, b, c, d;
+	if (!__get_cpuid(0x80000007, &a, &b, &c, &d))
+		return 0;
+	return (d >> 8) & 1;
+#endif
+}
+#endif
+
+void
+dlclock_init(void)
+{
+	static atomic_int state = 0; /* 0 uncalibrated, 1 calibrating, 2 done */
+	int expected = 0;
+	if (!atomic_compare_exchange_strong(&state, &expected, 1)) {
+		while (atomic_load(&state) != 2)
+			;
+		return;
+	}
+
+#ifdef DLCLOCK_TSC_
+	if (dlclock_invariant_tsc()) {
+		/* Bracket each clock_gettime between two TSC reads */
+		unsigned long long t0 = __rdtsc();
+		unsigned long long n0 = dlclock_now();
+		unsigned long long t0b = __rdtsc();
+		unsigned long long t1, n1, t1b;
+		do {
+			t1 = __rdtsc();
+			n1 = dlclock_now();
+			t1b = __rdtsc();
+		} while (n1 - n0 < DLCLOCK_CALIBRATION_NS);
+		unsigned long long ticks = (t1 + t1b) / 2 - (t0 + t0b) / 2;
+		/* Sub-GHz counters would overflow the conversion, never seen */
+		if (ticks > n1 - n0) {
+			dlclock.mult = (uint64_t)(((n1 - n0) << 32) / ticks);
+			dlclock.tick0 = (t0 + t0b) / 2;
+			dlclock.ns0 = n0;
+			dlclock.tsc = 1;
+		}
+	}
+#endif
+
+	atomic_store(&state, 2);
+}
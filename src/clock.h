@@ -0,0 +1,119 @@
+#ifndef DEADLOCK_CLOCK_H_
+#define DEADLOCK_CLOCK_H_
+
+#include <stdint.h>
+
+/*
+ * dlclock_now() returns a monotonic timestamp in nanoseconds.
+ *
+ * dlclock_ticks() returns a timestamp in clock ticks, which is far cheaper
+ * than dlclock_now() and is what graph export and the flight recorder
+ * record, converting to nanoseconds only once records are written. Ticks
+ * are read from the time stamp counter when the processor reports it
+ * invariant, that is it runs at a constant rate in every power state and is
+ * synchronized across cores. Otherwise, or until dlclock_init() is called,
+ * ticks are nanoseconds from dlclock_now().
+ *
+ * dlclock_init() measures the rate of the time stamp counter against
+ * dlclock_now(), which takes a few milliseconds on the first call in a
+ * process. Later calls return immediately.
+ *
+ * dlclock_ns() converts a timestamp in ticks to nanoseconds on the
+ * dlclock_now() timeline. dlclock_ticks_ns() converts a duration in ticks to
+ * nanoseconds. Neither allocates or calls into libc, so both may be used in
+ * signal handlers.
+ */
+static unsigned long long dlclock_now(void);
+static unsigned long long dlclock_ticks(void);
+static unsigned long long dlclock_ns(unsigned long long ticks);
+static unsigned long long dlclock_ticks_ns(unsigned long long ticks);
+void                      dlclock_init(void);
+
+/*
+ * dlclock is the calibration shared by every translation unit. tsc is set
+ * once the time stamp counter has been calibrated, after which a tick is
+ * mult / 2^32 nanoseconds, and tick0 and ns0 are one moment on each clock.
+ */
+struct dlclock {
+	int      tsc;
+	uint64_t mult;
+	uint64_t tick0;
+	uint64_t ns0;
+};
+extern struct dlclock dlclock;
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define DLCLOCK_TSC_
+#ifdef _MSC_VER
+#include <intrin.h>    /* __rdtsc */
+#else
+#include <x86intrin.h> /* __rdtsc */
+#endif
+#endif
+
+#ifdef _WIN32
+
+#include <windows.h>
+#include <sysinfoapi.h> /* GetSystemTimeAsFileTime */
+
+static inline unsigned long long
+dlclock_now(void)
+{
+	ULARGE_INTEGER t;
+	GetSystemTimeAsFileTime((FILETIME*)&t);
+	return t.QuadPart * 100; /* 100ns resolution */
+}
+
+#else
+
+#include <time.h> /* clock_gettime */
+
+static inline unsigned long long
+dlclock_now(void)
+{
+	struct timespec t;
+	if (clock_gettime(CLOCK_MONOTONIC, &t) != 0) {
+		perror("dlclock_now failed to call clock_gettime");
+		exit(errno);
+	}
+	return (unsigned long long)t.tv_sec * 1000000000 +
+	       (unsigned long long)t.tv_nsec;
+}
+
+#endif
+
+static inline unsigned long long
+dlclock_ticks(void)
+{
+#ifdef DLCLOCK_TSC_
+	if (dlclock.tsc)
+		return __rdtsc();
+#endif
+	return dlclock_now();
+}
+
+static inline unsigned long long
+dlclock_ticks_ns(unsigned long long ticks)
+{
+	if (!dlclock.tsc)
+		return ticks;
+	/* Split to multiply by a 32.32 fixed point rate without overflow */
+	return (ticks >> 32) * dlclock.mult +
+	       (((ticks & 0xFFFFFFFF) * dlclock.mult) >> 32);
+}
+
+static inline unsigned long long
+dlclock_ns(unsigned long long ticks)
+{
+	if (!dlclock.tsc)
+		return ticks;
+	if (ticks < dlclock.tick0)
+		return dlclock.ns0 - dlclock_ticks_ns(dlclock.tick0 - ticks);
+	return dlclock.ns0 + dlclock_ticks_ns(ticks - dlclock.tick0);
+}
+
+#endif /* DEADLOCK_CLOCK_H_ */
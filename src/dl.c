@@ -5,6 +5,7 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <limits.h>
 #include <stdlib.h>
 
 dltask
@@ -16,6 +17,7 @@ dlcreate(dltaskfn fn, dltask *next)
 
 	return (dltask) {
 		.next_ = next,
+		.cancel_ = dl_this_worker ? dl_this_worker->cancel : NULL,
 		.fn_ = fn,
 		.wait_ = 1,
 #ifdef DEADLOCK_GRAPH_EXPORT
@@ -41,6 +43,44 @@ dldetach(dltask *task)
 	}
 }
 
+void
+dlforkn(dltaskfn fn, dltask *next, dltask *first, size_t n, size_t stride)
+{
+	assert(dl_this_worker);
+	assert(n <= UINT_MAX);
+	assert(stride >= sizeof(dltask) || n <= 1);
+	if (n == 0)
+		return;
+
+	if (next) {
+		atomic_fetch_add(&next->wait_, (unsigned)n);
+	}
+
+	struct dlworker *w = dl_this_worker;
+#ifdef DEADLOCK_GRAPH_EXPORT
+	int graphed = w->current_graph != NULL;
+#endif
+	char *tsk = (char *)first;
+	for (size_t i = 0; i < n; ++ i, tsk += stride) {
+		dltask *t = (dltask *)tsk;
+		t->next_ = next;
+		t->cancel_ = w->cancel;
+		t->fn_ = fn;
+		/* Published by the release fence in dltqueue_pushn */
+		atomic_init(&t->wait_, 0);
+#ifdef DEADLOCK_FIBERS
+		t->fiber_ = NULL;
+#endif
+#ifdef DEADLOCK_GRAPH_EXPORT
+		t->graph_ = NULL;
+		t->tid_ = dltask_next_id();
+		if (graphed)
+			dlworker_add_edge_from_current(w, t);
+#endif
+	}
+	dlworker_asyncn(w, first, n, stride);
+}
+
 void
 dlrecapture(dltask *task, dltaskfn continuefn)
 {
@@ -57,6 +97,43 @@ dlrecapture(dltask *task, dltaskfn continuefn)
 #endif
 }
 
+void
+dlcancel_init(dlcancel *c)
+{
+	assert(c);
+	atomic_init(&c->requested_, 0);
+}
+
+void
+dlcancel_request(dlcancel *c)
+{
+	assert(c);
+	atomic_store_explicit(&c->requested_, 1, memory_order_relaxed);
+}
+
+int
+dlcancel_requested(const dlcancel *c)
+{
+	assert(c);
+	return atomic_load_explicit((atomic_int *)&c->requested_,
+	                            memory_order_relaxed);
+}
+
+void
+dlcancel_attach(dltask *task, dlcancel *c)
+{
+	assert(task);
+	task->cancel_ = c;
+}
+
+int
+dlcancelled(void)
+{
+	assert(dl_this_worker);
+	dlcancel *c = dl_this_worker->cancel;
+	return c && dlcancel_requested(c);
+}
+
 int
 dlmain(dltask *task, dlwentryfn entry, dlwexitfn exit)
 {
@@ -67,8 +144,12 @@ dlmain(dltask *task, dlwentryfn entry, dlwexitfn exit)
 	return dlmainex(task, entry, exit, ncpu);
 }
 
-int
-dlmainex(dltask *task, dlwentryfn entry, dlwexitfn exit, int workers)
+/*
+ * dlmain_start() runs a scheduler to termination for dlmainex() and dlrun().
+ */
+static int
+dlmain_start(dltask *task, dlwentryfn entry, dlwexitfn exit, int workers,
+             int quiesce)
 {
 	assert(task);
 
@@ -83,7 +164,7 @@ dlmainex(dltask *task, dlwentryfn entry, dlwexitfn exit, int workers)
 		goto malloc_failed;
 	}
 
-	result = dlsched_init(sched, workers, task, entry, exit);
+	result = dlsched_init(sched, workers, task, entry, exit, quiesce);
 	if (result)
 		goto dlsched_init_failed;
 
@@ -99,6 +180,24 @@ malloc_failed:
 	return errno = result;
 }
 
+int
+dlmainex(dltask *task, dlwentryfn entry, dlwexitfn exit, int workers)
+{
+	return dlmain_start(task, entry, exit, workers, 0);
+}
+
+int
+dlrun(dltask *task, dlwentryfn entry, dlwexitfn exit, int workers)
+{
+	assert(task);
+	if (workers <= 0) {
+		errno = 0;
+		workers = dlprocessorcount();
+		if (errno) return errno;
+	}
+	return dlmain_start(task, entry, exit, workers, 1);
+}
+
 void
 dlterminate(void)
 {
@@ -0,0 +1,270 @@
+/* MAP_ANONYMOUS and MAP_STACK */
+#define _DEFAULT_SOURCE
+
+#include "fiber.h"
+#include "sched.h"
+
+#ifdef DEADLOCK_FIBERS
+
+#include <assert.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <sys/mman.h> /* mmap, mprotect */
+#include <unistd.h>   /* sysconf */
+
+/*
+ * DLFIBER_STACK_SIZE is the usable stack of each fiber, not including its
+ * guard page. DLFIBER_POOL_MAX is the number of free fibers each worker
+ * keeps around before returning stacks to the operating system.
+ */
+#define DLFIBER_STACK_SIZE (256 * 1024)
+#define DLFIBER_POOL_MAX   64
+
+struct dlfiber dlfiber_unstarted;
+
+/*
+ * dlfiber_switch() saves the callee-saved registers, floating point control
+ * words and stack pointer of the calling context into *save_sp and resumes
+ * the context saved at load_sp. It returns when the calling context is
+ * resumed in turn.
+ *
+ * dlfiber_trampoline() is where a fresh fiber's first dlfiber_switch()
+ * returns to, and forwards the fiber, stashed in r12, to dlfiber_main().
+ *
+ * This is the x86-64 System V calling convention, which is all Deadlock
+ * supports anyway (see _mm_pause).
+ */
+void dlfiber_switch(void **save_sp, void *load_sp);
+void dlfiber_trampoline(void);
+__asm__(
+	".text\n"
+	".globl dlfiber_switch\n"
+	".hidden dlfiber_switch\n"
+	".type dlfiber_switch, @function\n"
+	"dlfiber_switch:\n"
+	"	pushq %rbp\n"
+	"	pushq %rbx\n"
+	"	pushq %r12\n"
+	"	pushq %r13\n"
+	"	pushq %r14\n"
+	"	pushq %r15\n"
+	"	subq $8, %rsp\n"
+	"	stmxcsr (%rsp)\n"
+	"	fnstcw 4(%rsp)\n"
+	"	movq %rsp, (%rdi)\n"
+	"	movq %rsi, %rsp\n"
+	"	ldmxcsr (%rsp)\n"
+	"	fldcw 4(%rsp)\n"
+	"	addq $8, %rsp\n"
+	"	popq %r15\n"
+	"	popq %r14\n"
+	"	popq %r13\n"
+	"	popq %r12\n"
+	"	popq %rbx\n"
+	"	popq %rbp\n"
+	"	ret\n"
+	".size dlfiber_switch, .-dlfiber_switch\n"
+	".globl dlfiber_trampoline\n"
+	".hidden dlfiber_trampoline\n"
+	".type dlfiber_trampoline, @function\n"
+	"dlfiber_trampoline:\n"
+	"	movq %r12, %rdi\n"
+	"	call dlfiber_main\n"
+	"	ud2\n"
+	".size dlfiber_trampoline, .-dlfiber_trampoline\n"
+);
+
+/*
+ * dlfiber_main() runs a fiber's task function and switches back to whoever
+ * resumed it last, never to return.
+ *
+ * dlfiber_acquire() pops a fiber from a worker's pool, mapping a new one if
+ * the pool is empty, and prepares its stack to enter dlfiber_main().
+ *
+ * dlfiber_release() returns a finished fiber to a worker's pool.
+ *
+ * dlfiber_current_worker() returns dl_this_worker, never inlined so the
+ * address of the thread local cannot be cached across a dlfiber_switch()
+ * which may resume us on a different thread.
+ */
+void dlfiber_main(struct dlfiber *) __attribute__((used, noreturn));
+static struct dlfiber  *dlfiber_acquire(struct dlworker *);
+static void             dlfiber_release(struct dlworker *, struct dlfiber *);
+static struct dlworker *dlfiber_current_worker(void) __attribute__((noinline));
+
+dltask
+dlcreatefiber(dltaskfn fn, dltask *next)
+{
+	dltask t = dlcreate(fn, next);
+	t.fiber_ = &dlfiber_unstarted;
+	return t;
+}
+
+void
+dlawait(dltask *child)
+{
+	struct dlworker *w = dlfiber_current_worker();
+	assert(w);
+	assert(child);
+	assert(!child->next_);
+
+	struct dlfiber *f = w->fiber;
+	if (!f) {
+		errno = EINVAL;
+		perror("dlawait called outside of a fiber task");
+		exit(errno);
+	}
+
+	/*
+	 * Wait on the child as well as a hold, which dlfiber_run() releases
+	 * once this fiber is switched out and safe to resume elsewhere.
+	 */
+	dltask *self = f->task;
+	atomic_fetch_add(&self->wait_, 2);
+	child->next_ = self;
+	dldetach(child);
+
+	dlfiber_switch(&f->sp, f->caller_sp);
+}
+
+int
+dlfiber_run(struct dlworker *w, dltask *t)
+{
+	struct dlfiber *f = t->fiber_;
+	assert(f);
+
+	if (f == &dlfiber_unstarted) {
+		f = dlfiber_acquire(w);
+		f->task = t;
+		t->fiber_ = f;
+	}
+#ifdef DEADLOCK_GRAPH_EXPORT
+	else if (t->graph_) {
+		/* Resumed fibers don't pass through DL_TASK_ENTRY again */
+		dlworker_set_current_node(w, t, f->desc);
+	}
+#endif
+
+	struct dlfiber *outer = w->fiber;
+	w->fiber = f;
+	f->worker = w;
+	dlfiber_switch(&f->caller_sp, f->sp);
+	w->fiber = outer;
+
+	if (f->finished) {
+		t->fiber_ = &dlfiber_unstarted;
+		dlfiber_release(w, f);
+		return 1;
+	}
+
+	/* Suspended in dlawait() */
+#ifdef DEADLOCK_GRAPH_EXPORT
+	if (w->current_graph) {
+		f->desc = w->current_node->desc;
+		dlworker_add_current_node(w);
+		dlworker_add_continuation_from_current(w, t);
+	}
+#endif
+	dldetach(t);
+	return 0;
+}
+
+void
+dlfiber_pool_destroy(struct dlworker *w)
+{
+	while (w->fiber_pool) {
+		struct dlfiber *f = w->fiber_pool;
+		w->fiber_pool = f->next;
+		munmap(f->mapping, f->mapping_size);
+	}
+	w->fiber_pool_count = 0;
+}
+
+void
+dlfiber_main(struct dlfiber *f)
+{
+	dltask *t = f->task;
+	t->fn_(f->worker, t);
+	/* caller_sp is whichever worker resumed us most recently */
+	f->finished = 1;
+	dlfiber_switch(&f->sp, f->caller_sp);
+	abort(); /* unreachable */
+}
+
+static struct dlfiber *
+dlfiber_acquire(struct dlworker *w)
+{
+	struct dlfiber *f = w->fiber_pool;
+	if (f) {
+		w->fiber_pool = f->next;
+		-- w->fiber_pool_count;
+	} else {
+		size_t page = (size_t)sysconf(_SC_PAGESIZE);
+		size_t size = page + DLFIBER_STACK_SIZE;
+		char *mapping = mmap(NULL, size, PROT_READ | PROT_WRITE,
+		                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK,
+		                     -1, 0);
+		if (mapping == MAP_FAILED) {
+			perror("dlfiber_acquire failed to map fiber stack");
+			exit(errno);
+		}
+		/* Stacks grow down, guard the lowest page */
+		if (mprotect(mapping, page, PROT_NONE)) {
+			perror("dlfiber_acquire failed to guard fiber stack");
+			exit(errno);
+		}
+		uintptr_t top = (uintptr_t)(mapping + size) - sizeof *f;
+		top &= ~(uintptr_t)(_Alignof(struct dlfiber) - 1);
+		f = (struct dlfiber *)top;
+		f->mapping = mapping;
+		f->mapping_size = size;
+	}
+
+	/*
+	 * Build the frame the first dlfiber_switch() into this fiber pops:
+	 * MXCSR and x87 control words, r15, r14, r13, r12 (the fiber), rbx,
+	 * rbp, then the return address. The trampoline is entered with a 16
+	 * byte aligned stack, as if it had been called.
+	 */
+	uintptr_t sp = ((uintptr_t)f - 64) & ~(uintptr_t)15;
+	uint64_t *frame = (uint64_t *)sp;
+	frame[0] = 0x1F80 | ((uint64_t)0x037F << 32);
+	frame[1] = 0;
+	frame[2] = 0;
+	frame[3] = 0;
+	frame[4] = (uint64_t)(uintptr_t)f;
+	frame[5] = 0;
+	frame[6] = 0;
+	frame[7] = (uint64_t)(uintptr_t)dlfiber_trampoline;
+	f->sp = frame;
+	f->caller_sp = NULL;
+	f->next = NULL;
+	f->worker = w;
+	f->task = NULL;
+	f->finished = 0;
+	return f;
+}
+
+static void
+dlfiber_release(struct dlworker *w, struct dlfiber *f)
+{
+	if (w->fiber_pool_count >= DLFIBER_POOL_MAX) {
+		munmap(f->mapping, f->mapping_size);
+		return;
+	}
+	f->next = w->fiber_pool;
+	w->fiber_pool = f;
+	++ w->fiber_pool_count;
+}
+
+static struct dlworker *
+dlfiber_current_worker(void)
+{
+	__asm__ volatile ("" ::: "memory");
+	return dl_this_worker;
+}
+
+#endif /* DEADLOCK_FIBERS */
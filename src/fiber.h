@@ -0,0 +1,52 @@
+#ifndef DEADLOCK_FIBER_PRIVATE_H_
+#define DEADLOCK_FIBER_PRIVATE_H_
+
+#include "deadlock/fiber.h"
+
+#ifdef DEADLOCK_FIBERS
+
+/*
+ * A dlfiber is a guard paged stack and the saved context of a task running
+ * on it. The struct itself lives at the top of its own stack mapping.
+ *
+ * dlfiber_run() runs or resumes task t, which must have been created by
+ * dlcreatefiber(), on the calling worker. One is returned if the task
+ * function completed, otherwise zero is returned if the task is suspended
+ * in dlawait() and will be invoked again once its child completes.
+ *
+ * dlfiber_started() returns nonzero if task t is suspended on a fiber.
+ *
+ * dlfiber_pool_destroy() unmaps every pooled fiber of a worker.
+ */
+
+struct dlworker;
+
+struct dlfiber {
+	void            *sp;        /* saved stack pointer while switched out */
+	void            *caller_sp; /* context which most recently resumed us */
+	struct dlfiber  *next;      /* next free fiber in a worker's pool */
+	struct dlworker *worker;    /* worker currently running this fiber */
+	dltask          *task;
+	void            *mapping;
+	size_t           mapping_size;
+	int              finished;
+#ifdef DEADLOCK_GRAPH_EXPORT
+	struct dlgraph_node_description *desc; /* node description to resume with */
+#endif
+};
+
+/* See fiber.c, marks a fiber task which has not started yet */
+extern struct dlfiber dlfiber_unstarted;
+
+int  dlfiber_run         (struct dlworker *, dltask *t);
+void dlfiber_pool_destroy(struct dlworker *);
+
+static inline int
+dlfiber_started(const dltask *t)
+{
+	return t->fiber_ && t->fiber_ != &dlfiber_unstarted;
+}
+
+#endif /* DEADLOCK_FIBERS */
+
+#endif /* DEADLOCK_FIBER_PRIVATE_H_ */
@@ -0,0 +1,151 @@
+#include "deadlock/future.h"
+
+#include "pool.h"
+#include "sched.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <stdalign.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Tasks depending on a future form a lock-free stack. Setting the future
+ * swaps the stack for dlfuture_fulfilled, after which no waiter is pushed.
+ */
+struct dlfuture_waiter {
+	struct dlfuture_waiter *next;
+	dltask                 *task;
+};
+
+static struct dlfuture_waiter dlfuture_fulfilled;
+
+struct dlfuture_ {
+	_Atomic(struct dlfuture_waiter *) waiters;
+	atomic_int    set;
+	size_t        size;
+	void         *value;
+	alignas(16) unsigned char storage[DLFUTURE_INLINE_MAX];
+};
+
+/*
+ * dlfuture_pool() and dlfuture_waiter_pool() return the calling worker's
+ * pools, or NULL outside of a worker.
+ */
+static struct dlpool *
+dlfuture_pool(void)
+{
+	return dl_this_worker ? &dl_this_worker->future_pool : NULL;
+}
+
+static struct dlpool *
+dlfuture_waiter_pool(void)
+{
+	return dl_this_worker ? &dl_this_worker->waiter_pool : NULL;
+}
+
+dlfuture *
+dlfuture_create(size_t size)
+{
+	assert(dl_this_worker);
+
+	dlfuture *f = dlpool_alloc(dlfuture_pool(), sizeof *f);
+	if (!f) goto alloc_failed;
+
+	f->value = f->storage;
+	if (size > DLFUTURE_INLINE_MAX) {
+		f->value = malloc(size);
+		if (!f->value) goto value_alloc_failed;
+	}
+	atomic_init(&f->waiters, NULL);
+	atomic_init(&f->set, 0);
+	f->size = size;
+	return f;
+
+value_alloc_failed:
+	dlpool_free(dlfuture_pool(), f);
+alloc_failed:
+	errno = ENOMEM;
+	return NULL;
+}
+
+void
+dlfuture_destroy(dlfuture *f)
+{
+	assert(f);
+	struct dlfuture_waiter *w = atomic_load(&f->waiters);
+	assert(w == NULL || w == &dlfuture_fulfilled);
+	(void) w;
+	if (f->value != f->storage)
+		free(f->value);
+	dlpool_free(dlfuture_pool(), f);
+}
+
+int
+dlfuture_set(dlfuture *f, const void *value)
+{
+	assert(f);
+	assert(dl_this_worker);
+
+	if (atomic_exchange(&f->set, 1))
+		return errno = EBUSY;
+	memcpy(f->value, value, f->size);
+
+	struct dlfuture_waiter *w = atomic_exchange_explicit(
+	                              &f->waiters, &dlfuture_fulfilled,
+	                              memory_order_acq_rel);
+	while (w) {
+		struct dlfuture_waiter *next = w->next;
+		dldetach(w->task);
+		dlpool_free(dlfuture_waiter_pool(), w);
+		w = next;
+	}
+	return 0;
+}
+
+int
+dlfuture_depend(dlfuture *f, dltask *task)
+{
+	assert(f);
+	assert(task);
+
+	struct dlfuture_waiter *w = atomic_load_explicit(&f->waiters,
+	                                                 memory_order_acquire);
+	if (w == &dlfuture_fulfilled)
+		return 0;
+
+	struct dlfuture_waiter *node = dlpool_alloc(dlfuture_waiter_pool(),
+	                                            sizeof *node);
+	if (!node)
+		return errno = ENOMEM;
+	node->task = task;
+
+	/* task is held by its creator so this cannot release it */
+	atomic_fetch_add(&task->wait_, 1);
+	do {
+		if (w == &dlfuture_fulfilled) {
+			atomic_fetch_sub(&task->wait_, 1);
+			dlpool_free(dlfuture_waiter_pool(), node);
+			return 0;
+		}
+		node->next = w;
+	} while (!atomic_compare_exchange_weak_explicit(
+	           &f->waiters, &w, node,
+	           memory_order_acq_rel, memory_order_acquire));
+	return 0;
+}
+
+int
+dlfuture_ready(const dlfuture *f)
+{
+	assert(f);
+	return atomic_load_explicit(&((dlfuture *)f)->waiters,
+	                            memory_order_acquire) == &dlfuture_fulfilled;
+}
+
+const void *
+dlfuture_get(const dlfuture *f)
+{
+	assert(dlfuture_ready(f));
+	return f->value;
+}
@@ -1,28 +1,111 @@
 #include "deadlock/dl.h"
 #include "deadlock/graph.h"
 #include "sched.h"
+#include "clock.h"
+#include "graphfile.h"
+#include "histogram.h"
+#include "trace.h"
 
 #ifdef DEADLOCK_GRAPH_EXPORT
 
 #include <assert.h>
 #include <errno.h>
+#include <limits.h>
 #include <stdarg.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-
-#ifdef _WIN32
-#include <sysinfoapi.h> /* GetSystemTimeAsFileTime */
-#else
-#include <time.h> /* clock_gettime */
-#endif
+/*
+ * A stream hands full chunks from workers to a background writer thread.
+ * queue holds chunks waiting to be written, oldest first; written chunks are
+ * kept on free for reuse. held is the memory in chunks, which workers wait
+ * on written to bring under budget. closing tells the writer to exit once
+ * queue is empty.
+ */
+struct dlgraph_stream {
+	struct dlthread       thread;
+	struct dlmutex        mtx;
+	struct dlcond         submitted;
+	struct dlcond         written;
+	struct dlgraph_chunk *queue_head;
+	struct dlgraph_chunk *queue_tail;
+	struct dlgraph_chunk *free;
+	size_t                held;
+	size_t                budget;
+	int                   closing;
+	FILE                 *f;
+};
 
 /*
- * dlgraph_dump() writes the graph to a file in a format accepted by the
+ * dlgraph_open() creates the file prefix, graph ID, extension.
+ *
+ * dlgraph_dump_text() writes the graph to a file in a format accepted by the
  * deadlock-graph utility program.
+ *
+ * dlgraph_dump_binary() writes the graph in the format described by
+ * deadlock/graphfile.h. Chunks already hold records in that format so each
+ * is written with a single fwrite().
+ *
+ * dlgraph_dump_trace() writes the graph as Chrome Trace Event JSON, see
+ * trace.h.
+ */
+static FILE *dlgraph_open(struct dlgraph *, const char *prefix, const char *ext);
+static void  dlgraph_dump_text(struct dlgraph *, const char *prefix);
+static void  dlgraph_dump_binary(struct dlgraph *, const char *prefix);
+static void  dlgraph_dump_trace(struct dlgraph *, const char *prefix);
+
+/*
+ * dlgraph_append() reserves size bytes for a record of kind in worker's
+ * fragment, starting a new chunk if the current one is full. NULL is
+ * returned, and the record counted as dropped, if the graph's budget is
+ * exhausted.
+ *
+ * dlgraph_chunk_alloc() returns a new chunk, or NULL if an unstreamed
+ * graph's budget is exhausted. Streamed graphs wait for the writer instead.
+ */
+static void                 *dlgraph_append(struct dlgraph *, int worker, unsigned kind, size_t size);
+static struct dlgraph_chunk *dlgraph_chunk_alloc(struct dlgraph *, int worker, unsigned kind);
+
+/*
+ * dlgraph_chunk_to_ns() converts the times of a chunk's records from clock
+ * ticks to nanoseconds in place, once, just before the chunk is written.
+ * dlgraph_to_ns() converts every chunk of an unstreamed graph.
+ */
+static void dlgraph_chunk_to_ns(struct dlgraph_chunk *);
+static void dlgraph_to_ns(struct dlgraph *);
+
+/*
+ * dlgraph_stream_open() creates the stream file, writes its header and
+ * starts the writer thread.
+ *
+ * dlgraph_stream_submit() queues a chunk for the writer.
+ *
+ * dlgraph_stream_close() queues every fragment's remaining chunks, the node
+ * descriptions and string table, then waits for the writer to exit and
+ * frees the stream.
+ *
+ * dlgraph_stream_writer() is the writer thread's entry point.
+ */
+static void dlgraph_stream_open(struct dlgraph *, const struct dlgraph_options *);
+static void dlgraph_stream_submit(struct dlgraph_stream *, struct dlgraph_chunk *);
+static void dlgraph_stream_close(struct dlgraph *);
+static void dlgraph_stream_writer(void *);
+
+/*
+ * dlgraph_descriptions() allocates and fills the node descriptions and
+ * string table of the format described by deadlock/graphfile.h, returning
+ * the number of descriptions.
+ */
+static uint32_t dlgraph_descriptions(struct dlgraphfile_desc **descs,
+                                     char **strings, uint64_t *strings_size);
+
+/*
+ * dlgraph_label_at() returns the label at offset in a worker's labels, or
+ * NULL. Labels never span chunks, so each is found by walking the chunks.
  */
-static void dlgraph_dump(struct dlgraph *, const char *prefix);
+static const char *dlgraph_label_at(void *graph, uint32_t worker, uint32_t offset);
 
 /*
  * dlgraph_free() destroys and frees a graph.
@@ -37,52 +120,117 @@ static void write_node_descriptions_reverse(FILE *, struct dlgraph_node_descript
 
 /*
  * See internal.h this is the head of the linked list of static node
- * descriptions set up by DL_TASK_ENTRY() upon first invocation.
+ * descriptions set up by DL_TASK_ENTRY() upon first invocation. The
+ * description lock is held while one is linked.
  */
 _Atomic(struct dlgraph_node_description *) dl_node_description_lst_head = NULL;
+static struct dlspinlock dlgraph_description_lock = DLSPINLOCK_INIT;
 
 /*
  * dl_next_task_id is declared in internal.h to semi-uniquely identify every
  * task created for graphing purposes.
  */
-_Thread_local unsigned long dl_next_task_id = 0;
+_Thread_local unsigned long long dl_next_task_id = 0;
 
 /*
- * MAYBE_GROW_GEOMETRICALLY() is used to generically define geometric growth
- * functions for graph buffers.
+ * A zero budget holds up to DLGRAPH_STREAM_CHUNKS chunks per worker when
+ * streaming.
  */
-#define MAYBE_GROW_GEOMETRICALLY(T) \
-	static void                                                          \
-	dlgraph_fragment_maybegrow_##T(struct dlgraph_fragment *frag,        \
-	                               size_t avail) {                       \
-		if (frag->T##_count + avail < frag->T##_size) return;        \
-		while (frag->T##_count + avail >= frag->T##_size) {          \
-			frag->T##_size = frag->T##_size * 2;                 \
-			if (frag->T##_size == 0) {                           \
-				frag->T##_size = 1024; /* TODO arbitrary */  \
-			}                                                    \
-		}                                                            \
-		frag->T = realloc(frag->T, sizeof(*frag->T) *                \
-		                             frag->T##_size);                \
-		if (!frag->T) {                                              \
-			perror("dlgraph_fragment_maybegrow failed to grow"); \
-			exit(errno);                                         \
-		}                                                            \
-	}
-MAYBE_GROW_GEOMETRICALLY(continuations)
-MAYBE_GROW_GEOMETRICALLY(edges)
-MAYBE_GROW_GEOMETRICALLY(nodes)
-MAYBE_GROW_GEOMETRICALLY(label_buffer)
-#undef MAYBE_GROW_GEOMETRICALLY
+#define DLGRAPH_STREAM_CHUNKS 16
+
+/*
+ * dlgraph_state is 1 while capture is enabled, 0 while it is disabled, and
+ * -1 until DEADLOCK_GRAPH has been read.
+ */
+static atomic_int dlgraph_state = -1;
+
+/*
+ * dlgraph_selection lists the function names passed to dlgraph_select(),
+ * or is empty if every description is selected. The description lock is
+ * also held while it changes, so every description's unselected flag
+ * follows it.
+ */
+struct dlgraph_selected {
+	struct dlgraph_selected *next;
+	char func[];
+};
+static struct dlgraph_selected *dlgraph_selection = NULL;
+
+/*
+ * dlgraph_excluded() returns nonzero if a description is excluded by the
+ * selection. The description lock must be held.
+ */
+static int dlgraph_excluded(const struct dlgraph_node_description *);
+
+/*
+ * dlgraph_sampled() decides whether a fork with options is captured, at
+ * random with probability 1 / sample. Each thread draws from its own
+ * xorshift generator, dlgraph_rng, seeded on first use.
+ */
+static _Thread_local uint64_t dlgraph_rng = 0;
+static int dlgraph_sampled(const struct dlgraph_options *);
+
+/*
+ * dlgraph_site_description() returns the description of a
+ * dlgraph_fork() call site, linking a new description the first time a site
+ * forks. Sites are rare so the list is searched by the addresses of their
+ * file and function names.
+ */
+static struct dlgraph_node_description *dlgraph_site_description(const char *file, const char *func, unsigned long line);
+
+/*
+ * dlgraph_skip_join() returns nonzero, consuming one, if graph has skipped
+ * joins left by disabled forks nested within it.
+ */
+static int dlgraph_skip_join(struct dlgraph *graph);
 
 void
-dlgraph_fork(void)
+dlgraph_forkex_(const struct dlgraph_options *options,
+                const char *file, const char *func, unsigned long line)
 {
 	static atomic_ulong global_graph_id = 0;
 
 	assert(dl_this_worker);
-	assert(!dl_this_worker->current_graph); /* TODO: No recursive graph */
-	int nw = dl_this_worker->sched->nworkers;
+	assert(dl_this_worker->current_node);
+	struct dlworker *w = dl_this_worker;
+	struct dlgraph *parent = w->current_graph;
+	if ((options && options->disabled) || !dlgraph_enabled() ||
+	    !dlgraph_sampled(options))
+	{
+		/* Tasks stay in the enclosing graph, which skips a join */
+		if (parent)
+			atomic_fetch_add(&parent->skipped, 1);
+		return;
+	}
+
+	if (parent) {
+		/*
+		 * The forking task's node ends in the enclosing graph where it
+		 * begins in the nested one. Its label belongs to the former.
+		 */
+		if (!dlgraph_node_unselected(w->current_node)) {
+			dlgraph_add_node(parent, w->index, w->current_node);
+			w->current_node->begin = w->current_node->end;
+		}
+		w->current_node->label_offset = ULONG_MAX;
+	} else {
+		/*
+		 * The forking task was not captured, so its node begins here.
+		 * It is added to the graph once the task returns, or when it
+		 * joins.
+		 */
+		struct dlgraph_node_description *desc;
+		desc = dlgraph_site_description(file, func, line);
+		*w->current_node = (struct dlgraph_node) {
+			.begin = atomic_load_explicit(&desc->unselected, memory_order_relaxed)
+			         ? 0 : dlgraph_now(),
+			.task = dltask_next_id(),
+			.desc = desc,
+			.label_offset = ULONG_MAX
+		};
+	}
+
+	int nw = w->sched->nworkers;
 	size_t wgsize = sizeof(struct dlgraph) + sizeof(struct dlgraph_fragment) * (size_t)nw;
 	struct dlgraph *wg = malloc(wgsize);
 	if (!wg) {
@@ -93,20 +241,80 @@ dlgraph_fork(void)
 	wg->id = atomic_fetch_add_explicit(&global_graph_id, 1,
 	                                   memory_order_relaxed);
 	wg->nworkers = nw;
-	dl_this_worker->current_graph = wg;
+	wg->parent = parent;
+	wg->fork_task = w->current_node->task;
+	/* Every graphed task descends from this one */
+	wg->base_ticks = dlgraph_node_unselected(w->current_node)
+	                 ? dlgraph_now() : w->current_node->begin;
+	wg->base_ns = dlclock_ns(wg->base_ticks);
+	atomic_init(&wg->held, 0);
+	atomic_init(&wg->skipped, 0);
+
+	size_t min_budget = (size_t)nw * DLGRAPH_CHUNK_KINDS * DLGRAPH_CHUNK_SIZE;
+	size_t budget = options ? options->budget : 0;
+	if (options && options->stream_prefix && budget == 0)
+		budget = (size_t)nw * DLGRAPH_STREAM_CHUNKS * DLGRAPH_CHUNK_SIZE;
+	if (budget && budget < min_budget)
+		budget = min_budget;
+	wg->budget = budget;
+	wg->histogram_only = options && options->histogram_only;
+
+	if (options && options->stream_prefix && !wg->histogram_only)
+		dlgraph_stream_open(wg, options);
+	w->current_graph = wg;
 }
 
 void
 dlgraph_join(const char *filename_prefix)
+{
+	dlgraph_joinex(filename_prefix, DLGRAPH_FORMAT_TEXT);
+}
+
+void
+dlgraph_joinex(const char *filename_prefix, int format)
 {
 	assert(dl_this_worker);
-	struct dlgraph *graph = dl_this_worker->current_graph;
+	assert(format == DLGRAPH_FORMAT_TEXT || format == DLGRAPH_FORMAT_BINARY ||
+	       format == DLGRAPH_FORMAT_CHROME);
+	struct dlworker *w = dl_this_worker;
+	struct dlgraph *graph = w->current_graph;
+	if (graph && dlgraph_skip_join(graph))
+		return;
 	if (graph) {
 		/* TODO: This is an ugly hack to include joining node */
-		dlworker_add_current_node(dl_this_worker);
-		if (filename_prefix)
-			dlgraph_dump(graph, filename_prefix);
-		dl_this_worker->current_graph = NULL;
+		dlworker_add_current_node(w);
+		if (graph->stream) {
+			dlgraph_stream_close(graph);
+		} else if (filename_prefix && !graph->histogram_only) {
+			dlgraph_to_ns(graph);
+			if (format == DLGRAPH_FORMAT_BINARY)
+				dlgraph_dump_binary(graph, filename_prefix);
+			else if (format == DLGRAPH_FORMAT_CHROME)
+				dlgraph_dump_trace(graph, filename_prefix);
+			else
+				dlgraph_dump_text(graph, filename_prefix);
+		}
+
+		unsigned long dropped = 0;
+		for (int w = 0; w < graph->nworkers; ++ w)
+			dropped += graph->fragments[w].dropped;
+		if (dropped)
+			fprintf(stderr, "dlgraph dropped %lu records over budget\n", dropped);
+
+		/*
+		 * The joining task carries on in the enclosing graph, if any,
+		 * once the nested graph, which it sees as the forking task's
+		 * continuation, completes.
+		 */
+		struct dlgraph *parent = graph->parent;
+		if (parent) {
+			dlgraph_add_continuation(parent, w->index, graph->fork_task,
+			                         w->current_node->task);
+			if (!dlgraph_node_unselected(w->current_node))
+				w->current_node->begin = w->current_node->end;
+			w->current_node->label_offset = ULONG_MAX;
+		}
+		w->current_graph = parent;
 		dlgraph_free(graph);
 	}
 }
@@ -119,106 +327,526 @@ void
 dlgraph_label(const char *fmt, ...)
 {
 	assert(dl_this_worker);
-	struct dlgraph_fragment *frag = dl_this_worker->current_graph->fragments +
-	                                  dl_this_worker->index;
-	va_list args;
+#ifdef DEADLOCK_WATCHDOG
+	/* Labels are kept for the watchdog whether or not tasks are captured */
+	va_list watch;
+	va_start(watch, fmt);
+	dlwatch_label(&dl_this_worker->watch, fmt, watch);
+	va_end(watch);
+#endif
+	struct dlgraph *graph = dl_this_worker->current_graph;
+	if (!graph || graph->histogram_only ||
+	    dlgraph_node_unselected(dl_this_worker->current_node))
+		return;
+	struct dlgraph_fragment *frag = graph->fragments + dl_this_worker->index;
+	va_list args, copy;
 	va_start(args, fmt);
+	va_copy(copy, args);
 	int writes = vsnprintf(NULL, 0, fmt, args);
 	if (writes < 0)
 		goto cleanup;
-	unsigned long length = 1 + (unsigned long)writes;
-	dlgraph_fragment_maybegrow_label_buffer(frag, length);
-	int written = vsnprintf(frag->label_buffer + frag->label_buffer_count, length, fmt, args);
-	if (written != writes)
+	/* Labels may not span chunks, longer labels are truncated */
+	size_t length = 1 + (size_t)writes;
+	if (length > DLGRAPH_CHUNK_CAPACITY)
+		length = DLGRAPH_CHUNK_CAPACITY;
+	char *label = dlgraph_append(graph, dl_this_worker->index,
+	                             DLGRAPHFILE_CHUNK_LABELS, length);
+	if (!label)
 		goto cleanup;
-	dl_this_worker->current_node.label_offset = frag->label_buffer_count;
-	frag->label_buffer_count += length;
+	unsigned long long offset = frag->size[DLGRAPHFILE_CHUNK_LABELS] - length;
+	vsnprintf(label, length, fmt, copy);
+	dl_this_worker->current_node->label_offset = (unsigned long)offset;
 cleanup:
 	/* Silently ignore error */
+	va_end(copy);
 	va_end(args);
 }
 #ifdef __clang__
 #pragma clang diagnostic pop
 #endif
 
+void
+dlgraph_enable(int enabled)
+{
+	atomic_store(&dlgraph_state, enabled != 0);
+}
+
+int
+dlgraph_enabled(void)
+{
+	int state = atomic_load_explicit(&dlgraph_state, memory_order_relaxed);
+	if (state < 0) {
+		const char *env = getenv("DEADLOCK_GRAPH");
+		int enabled = !env || strcmp(env, "0") != 0;
+		/* Lose to any dlgraph_enable() called meanwhile */
+		atomic_compare_exchange_strong(&dlgraph_state, &state, enabled);
+		state = atomic_load(&dlgraph_state);
+	}
+	return state;
+}
+
+int
+dlgraph_select(const char *func)
+{
+	struct dlgraph_selected *selected = NULL;
+	if (func) {
+		size_t length = strlen(func) + 1;
+		selected = malloc(sizeof(*selected) + length);
+		if (!selected)
+			return errno = ENOMEM;
+		memcpy(selected->func, func, length);
+	}
+
+	dlspinlock_lock(&dlgraph_description_lock);
+	if (selected) {
+		selected->next = dlgraph_selection;
+		dlgraph_selection = selected;
+	} else {
+		while (dlgraph_selection) {
+			struct dlgraph_selected *s = dlgraph_selection;
+			dlgraph_selection = s->next;
+			free(s);
+		}
+	}
+	struct dlgraph_node_description *d = atomic_load(&dl_node_description_lst_head);
+	for (; d; d = d->next)
+		atomic_store_explicit(&d->unselected, dlgraph_excluded(d), memory_order_relaxed);
+	dlspinlock_unlock(&dlgraph_description_lock);
+	return 0;
+}
+
 unsigned long
 dlgraph_link_node_description(struct dlgraph_node_description *desc)
 {
-	do {
+	dlspinlock_lock(&dlgraph_description_lock);
+	if (!desc->linked) {
+		atomic_store_explicit(&desc->unselected, dlgraph_excluded(desc), memory_order_relaxed);
 		desc->next = atomic_load_explicit(&dl_node_description_lst_head,
 		                                  memory_order_relaxed);
 		desc->id = desc->next ? desc->next->id + 1 : 0;
-	} while (!atomic_compare_exchange_strong_explicit(
-	            &dl_node_description_lst_head,
-	            &desc->next,
-	            desc,
-	            memory_order_seq_cst,
-	            memory_order_relaxed));
+		desc->linked = 1;
+		atomic_store(&dl_node_description_lst_head, desc);
+	}
+	dlspinlock_unlock(&dlgraph_description_lock);
 	return desc->id;
 }
 
-void
-dlgraph_add_continuation(struct dlgraph_fragment *frag, unsigned long head, unsigned long tail)
+static int
+dlgraph_excluded(const struct dlgraph_node_description *desc)
 {
-	dlgraph_fragment_maybegrow_continuations(frag, 1);
-	frag->continuations[frag->continuations_count ++] = (struct dlgraph_edge) {
-		/* unused: .ts_ns */
-		.head = head,
-		.tail = tail
+	if (!dlgraph_selection)
+		return 0;
+	for (struct dlgraph_selected *s = dlgraph_selection; s; s = s->next) {
+		if (strcmp(s->func, desc->func) == 0)
+			return 0;
+	}
+	return 1;
+}
+
+static int
+dlgraph_sampled(const struct dlgraph_options *options)
+{
+	if (!options || options->sample <= 1)
+		return 1;
+	uint64_t x = dlgraph_rng;
+	if (!x) {
+		/* Any nonzero seed, differing between workers */
+		x = dlclock_ticks() ^ (uint64_t)(dl_this_worker->index + 1) * 0x9E3779B97F4A7C15ull;
+		x = x ? x : 1;
+	}
+	x ^= x << 13;
+	x ^= x >> 7;
+	x ^= x << 17;
+	dlgraph_rng = x;
+	return x % options->sample == 0;
+}
+
+static int
+dlgraph_skip_join(struct dlgraph *graph)
+{
+	unsigned skipped = atomic_load(&graph->skipped);
+	while (skipped) {
+		if (atomic_compare_exchange_weak(&graph->skipped, &skipped, skipped - 1))
+			return 1;
+	}
+	return 0;
+}
+
+static struct dlgraph_node_description *
+dlgraph_site_description(const char *file, const char *func, unsigned long line)
+{
+	struct dlgraph_node_description *d;
+	d = atomic_load_explicit(&dl_node_description_lst_head, memory_order_acquire);
+	for (; d; d = d->next) {
+		if (d->file == file && d->func == func && d->line == line)
+			return d;
+	}
+	/* Like static descriptions, these are never freed */
+	d = malloc(sizeof(*d));
+	if (!d) {
+		perror("dlgraph_fork failed to allocate description");
+		exit(errno);
+	}
+	*d = (struct dlgraph_node_description) {
+		.file = file,
+		.func = func,
+		.line = line
 	};
+	dlgraph_link_node_description(d);
+	return d;
 }
 
 void
-dlgraph_add_edge(struct dlgraph_fragment *frag, unsigned long head, unsigned long tail)
+dlgraph_add_continuation(struct dlgraph *graph, int worker, unsigned long long head, unsigned long long tail)
 {
-	dlgraph_fragment_maybegrow_edges(frag, 1);
-	frag->edges[frag->edges_count ++] = (struct dlgraph_edge) {
-		.ts_ns = dlgraph_now(),
-		.head = head,
-		.tail = tail
-	};
+	if (graph->histogram_only)
+		return;
+	struct dlgraphfile_continuation *c;
+	c = dlgraph_append(graph, worker, DLGRAPHFILE_CHUNK_CONTINUATIONS, sizeof(*c));
+	if (c) {
+		*c = (struct dlgraphfile_continuation) {
+			.head = head,
+			.tail = tail
+		};
+	}
+}
+
+void
+dlgraph_add_edge(struct dlgraph *graph, int worker, unsigned long long head, unsigned long long tail)
+{
+	if (graph->histogram_only)
+		return;
+	unsigned long long now = dlgraph_now();
+	struct dlgraphfile_edge *e;
+	e = dlgraph_append(graph, worker, DLGRAPHFILE_CHUNK_EDGES, sizeof(*e));
+	if (e) {
+		*e = (struct dlgraphfile_edge) {
+			.ts_ns = now > graph->base_ticks ? now - graph->base_ticks : 0,
+			.head = head,
+			.tail = tail
+		};
+	}
 }
 
 void
-dlgraph_add_node(struct dlgraph_fragment *frag, struct dlgraph_node *node)
+dlgraph_add_node(struct dlgraph *graph, int worker, struct dlgraph_node *node)
 {
-	dlgraph_fragment_maybegrow_nodes(frag, 1);
-	node->end_ns = dlgraph_now();
-	frag->nodes[frag->nodes_count ++] = *node;
+	node->end = dlgraph_now();
+	dlhist_record(worker, node->desc->id, dlclock_ticks_ns(node->end - node->begin));
+	if (graph->histogram_only)
+		return;
+	struct dlgraphfile_node *n;
+	n = dlgraph_append(graph, worker, DLGRAPHFILE_CHUNK_NODES, sizeof(*n));
+	if (n) {
+		unsigned long long begin = node->begin > graph->base_ticks
+		                           ? node->begin - graph->base_ticks : 0;
+		*n = (struct dlgraphfile_node) {
+			.task = node->task,
+			.desc = (uint32_t)node->desc->id,
+			.label = node->label_offset < DLGRAPHFILE_NO_LABEL
+			         ? (uint32_t)node->label_offset
+			         : DLGRAPHFILE_NO_LABEL,
+			.begin_ns = begin,
+			.duration_ns = node->end - node->begin
+		};
+	}
+}
+
+const char *
+dlgraph_node_label(struct dlgraph *graph, int worker, const struct dlgraph_node *node)
+{
+	if (node->label_offset == ULONG_MAX)
+		return NULL;
+	/* A task's label is usually the last, in the chunk being appended to */
+	struct dlgraph_fragment *frag = graph->fragments + worker;
+	const struct dlgraph_chunk *tail = frag->tail[DLGRAPHFILE_CHUNK_LABELS];
+	unsigned long long start = frag->size[DLGRAPHFILE_CHUNK_LABELS] - (tail ? tail->used : 0);
+	if (tail && node->label_offset >= start)
+		return (const char *)tail->data + (node->label_offset - start);
+	/* Streamed chunks may already be written and reused */
+	if (graph->stream)
+		return NULL;
+	return dlgraph_label_at(graph, (uint32_t)worker, (uint32_t)node->label_offset);
 }
 
 unsigned long long
 dlgraph_now(void)
 {
-#ifdef _WIN32
-	ULARGE_INTEGER t;
-	GetSystemTimeAsFileTime((FILETIME*)&t);
-	return t.QuadPart * 100; /* 100ns resolution */
-#else
-	struct timespec t;
-	if (clock_gettime(CLOCK_MONOTONIC, &t) != 0) {
-		perror("dlgraph_now failed to call clock_gettime");
+	return dlclock_ticks();
+}
+
+static void
+dlgraph_chunk_to_ns(struct dlgraph_chunk *c)
+{
+	if (c->kind == DLGRAPHFILE_CHUNK_NODES) {
+		struct dlgraphfile_node *n = (void *)c->data;
+		for (size_t i = 0; i < c->used / sizeof(*n); ++ i) {
+			n[i].begin_ns = dlclock_ticks_ns(n[i].begin_ns);
+			n[i].duration_ns = dlclock_ticks_ns(n[i].duration_ns);
+		}
+	} else if (c->kind == DLGRAPHFILE_CHUNK_EDGES) {
+		struct dlgraphfile_edge *e = (void *)c->data;
+		for (size_t i = 0; i < c->used / sizeof(*e); ++ i)
+			e[i].ts_ns = dlclock_ticks_ns(e[i].ts_ns);
+	}
+}
+
+static void
+dlgraph_to_ns(struct dlgraph *graph)
+{
+	for (int w = 0; w < graph->nworkers; ++ w) {
+		struct dlgraph_fragment *frag = graph->fragments + w;
+		for (unsigned k = 0; k < DLGRAPH_CHUNK_KINDS; ++ k)
+			for (struct dlgraph_chunk *c = frag->head[k]; c; c = c->next)
+				dlgraph_chunk_to_ns(c);
+	}
+}
+
+static void *
+dlgraph_append(struct dlgraph *graph, int worker, unsigned kind, size_t size)
+{
+	struct dlgraph_fragment *frag = graph->fragments + worker;
+	struct dlgraph_chunk *c = frag->tail[kind];
+	if (!c || c->used + size > DLGRAPH_CHUNK_CAPACITY) {
+		if (c && graph->stream) {
+			frag->tail[kind] = NULL;
+			dlgraph_stream_submit(graph->stream, c);
+		}
+		struct dlgraph_chunk *n = dlgraph_chunk_alloc(graph, worker, kind);
+		if (!n) {
+			++ frag->dropped;
+			return NULL;
+		}
+		if (!graph->stream) {
+			if (c) c->next = n;
+			else   frag->head[kind] = n;
+		}
+		frag->tail[kind] = c = n;
+	}
+	void *record = c->data + c->used;
+	c->used += size;
+	frag->size[kind] += size;
+	return record;
+}
+
+static struct dlgraph_chunk *
+dlgraph_chunk_alloc(struct dlgraph *graph, int worker, unsigned kind)
+{
+	struct dlgraph_chunk *c = NULL;
+	struct dlgraph_stream *s = graph->stream;
+	if (s) {
+		dlmutex_lock(&s->mtx);
+		while (!s->free && s->held + DLGRAPH_CHUNK_SIZE > s->budget)
+			dlcond_wait(&s->written, &s->mtx);
+		if ((c = s->free))
+			s->free = c->next;
+		else
+			s->held += DLGRAPH_CHUNK_SIZE;
+		dlmutex_unlock(&s->mtx);
+	} else {
+		size_t held = atomic_fetch_add_explicit(&graph->held, DLGRAPH_CHUNK_SIZE,
+		                                        memory_order_relaxed);
+		if (graph->budget && held + DLGRAPH_CHUNK_SIZE > graph->budget) {
+			atomic_fetch_sub_explicit(&graph->held, DLGRAPH_CHUNK_SIZE,
+			                          memory_order_relaxed);
+			return NULL;
+		}
+	}
+
+	if (!c && !(c = malloc(DLGRAPH_CHUNK_SIZE))) {
+		perror("dlgraph_chunk_alloc failed to allocate chunk");
 		exit(errno);
 	}
-	return (unsigned long long)t.tv_sec * 1000000000 +
-	       (unsigned long long)t.tv_nsec;
-#endif
+	c->next = NULL;
+	c->used = 0;
+	c->kind = kind;
+	c->worker = (unsigned)worker;
+	return c;
 }
 
 static void
-dlgraph_dump(struct dlgraph *graph, const char *prefix)
+dlgraph_stream_open(struct dlgraph *graph, const struct dlgraph_options *options)
 {
-	int writes = snprintf(NULL, 0, "%s%lu.dlg", prefix, graph->id);
-	if (writes < 0)
+	struct dlgraph_stream *s = calloc(1, sizeof(*s));
+	if (!s)
 		goto panic;
+	s->budget = graph->budget;
+	s->f = dlgraph_open(graph, options->stream_prefix, ".dlgs");
+	if (!s->f)
+		goto panic;
+
+	struct dlgraphfile_header h = {
+		.magic = DLGRAPHFILE_STREAM_MAGIC,
+		.version = DLGRAPHFILE_VERSION,
+		.byte_order = DLGRAPHFILE_BYTE_ORDER,
+		.id = graph->id,
+		.base_ns = graph->base_ns,
+		.nworkers = (uint32_t)graph->nworkers,
+		.parent_id = graph->parent ? graph->parent->id : DLGRAPHFILE_NO_PARENT
+	};
+	if (fwrite(&h, sizeof h, 1, s->f) != 1)
+		goto panic;
+
+	int result;
+	if ((result = dlmutex_init(&s->mtx)) ||
+	    (result = dlcond_init(&s->submitted)) ||
+	    (result = dlcond_init(&s->written)) ||
+	    (result = dlthread_create(&s->thread, dlgraph_stream_writer, s, -1)))
+	{
+		errno = result;
+		goto panic;
+	}
+	graph->stream = s;
+	return;
+
+panic:
+	perror("dlgraph_forkex failed to open stream");
+	exit(errno);
+}
+
+static void
+dlgraph_stream_submit(struct dlgraph_stream *s, struct dlgraph_chunk *c)
+{
+	c->next = NULL;
+	dlmutex_lock(&s->mtx);
+	if (s->queue_tail) s->queue_tail->next = c;
+	else               s->queue_head = c;
+	s->queue_tail = c;
+	dlmutex_unlock(&s->mtx);
+	dlcond_broadcast(&s->submitted);
+}
+
+static void
+dlgraph_stream_close(struct dlgraph *graph)
+{
+	struct dlgraph_stream *s = graph->stream;
+	for (int w = 0; w < graph->nworkers; ++ w) {
+		struct dlgraph_fragment *frag = graph->fragments + w;
+		for (unsigned k = 0; k < DLGRAPH_CHUNK_KINDS; ++ k) {
+			if (frag->tail[k])
+				dlgraph_stream_submit(s, frag->tail[k]);
+			frag->tail[k] = NULL;
+		}
+	}
+
+	/*
+	 * Descriptions and strings are written from the end of oversized
+	 * chunks, which the writer frees rather than reusing.
+	 */
+	struct dlgraphfile_desc *descs;
+	char *strings;
+	uint64_t strings_size;
+	uint32_t ndescs = dlgraph_descriptions(&descs, &strings, &strings_size);
+	size_t descs_size = ndescs * sizeof(*descs);
+	struct dlgraph_chunk *dc = malloc(sizeof(*dc) + descs_size);
+	struct dlgraph_chunk *sc = malloc(sizeof(*sc) + (size_t)strings_size);
+	if (!dc || !sc) {
+		perror("dlgraph_join failed to allocate descriptions");
+		exit(errno);
+	}
+	*dc = (struct dlgraph_chunk) { .used = descs_size, .kind = DLGRAPHFILE_CHUNK_DESCS };
+	*sc = (struct dlgraph_chunk) { .used = (size_t)strings_size, .kind = DLGRAPHFILE_CHUNK_STRINGS };
+	if (descs_size)
+		memcpy(dc->data, descs, descs_size);
+	if (strings_size)
+		memcpy(sc->data, strings, (size_t)strings_size);
+	free(descs);
+	free(strings);
+	dlgraph_stream_submit(s, dc);
+	dlgraph_stream_submit(s, sc);
+
+	dlmutex_lock(&s->mtx);
+	s->closing = 1;
+	dlmutex_unlock(&s->mtx);
+	dlcond_broadcast(&s->submitted);
+	if (dlthread_join(&s->thread)) {
+		perror("dlgraph_join failed to join stream writer");
+		exit(errno);
+	}
+	if (ferror(s->f) || fclose(s->f) != 0) {
+		perror("dlgraph_join failed to write to stream");
+		exit(errno);
+	}
+
+	while (s->free) {
+		struct dlgraph_chunk *c = s->free;
+		s->free = c->next;
+		free(c);
+	}
+	dlcond_destroy(&s->written);
+	dlcond_destroy(&s->submitted);
+	dlmutex_destroy(&s->mtx);
+	free(s);
+	graph->stream = NULL;
+}
+
+static void
+dlgraph_stream_writer(void *xstream)
+{
+	static const unsigned char padding[8];
+	struct dlgraph_stream *s = xstream;
+	for (;;) {
+		dlmutex_lock(&s->mtx);
+		while (!s->queue_head && !s->closing)
+			dlcond_wait(&s->submitted, &s->mtx);
+		struct dlgraph_chunk *c = s->queue_head;
+		s->queue_head = s->queue_tail = NULL;
+		dlmutex_unlock(&s->mtx);
+		if (!c)
+			return;
+
+		while (c) {
+			struct dlgraph_chunk *next = c->next;
+			dlgraph_chunk_to_ns(c);
+			struct dlgraphfile_chunk frame = {
+				.kind = c->kind,
+				.worker = c->worker,
+				.size = c->used
+			};
+			size_t pad = (size_t)(dlgraphfile_align(c->used) - c->used);
+			if (fwrite(&frame, sizeof frame, 1, s->f) != 1 ||
+			    fwrite(c->data, 1, c->used, s->f) != c->used ||
+			    fwrite(padding, 1, pad, s->f) != pad)
+			{
+				perror("dlgraph stream writer failed to write to file");
+				exit(errno);
+			}
+
+			if (c->kind < DLGRAPH_CHUNK_KINDS) {
+				dlmutex_lock(&s->mtx);
+				c->next = s->free;
+				s->free = c;
+				dlmutex_unlock(&s->mtx);
+				dlcond_broadcast(&s->written);
+			} else {
+				free(c);
+			}
+			c = next;
+		}
+	}
+}
+
+static FILE *
+dlgraph_open(struct dlgraph *graph, const char *prefix, const char *ext)
+{
+	int writes = snprintf(NULL, 0, "%s%lu%s", prefix, graph->id, ext);
+	if (writes < 0)
+		return NULL;
 
 	size_t fnlen = 1 + (size_t)writes;
 	char *filename = calloc(fnlen, sizeof(*filename));
 	if (!filename)
-		goto panic;
-	sprintf(filename, "%s%lu.dlg", prefix, graph->id);
-	FILE *f = fopen(filename, "w");
+		return NULL;
+	sprintf(filename, "%s%lu%s", prefix, graph->id, ext);
+	FILE *f = fopen(filename, "wb");
 	free(filename);
+	return f;
+}
+
+static void
+dlgraph_dump_text(struct dlgraph *graph, const char *prefix)
+{
+	FILE *f = dlgraph_open(graph, prefix, ".dlg");
 	if (!f)
 		goto panic;
 
@@ -228,44 +856,57 @@ dlgraph_dump(struct dlgraph *graph, const char *prefix)
 	write_node_descriptions_reverse(f, head);
 
 	int nw = graph->nworkers;
-	size_t total_continuations = 0;
-	size_t total_edges = 0;
-	size_t total_nodes = 0;
+	unsigned long long total_continuations = 0;
+	unsigned long long total_edges = 0;
+	unsigned long long total_nodes = 0;
 	for (int w = 0; w < nw; ++ w) {
 		struct dlgraph_fragment *frag = graph->fragments + w;
-		total_continuations += frag->continuations_count;
-		total_edges += frag->edges_count;
-		total_nodes += frag->nodes_count;
+		total_continuations += frag->size[DLGRAPHFILE_CHUNK_CONTINUATIONS] /
+		                       sizeof(struct dlgraphfile_continuation);
+		total_edges += frag->size[DLGRAPHFILE_CHUNK_EDGES] /
+		               sizeof(struct dlgraphfile_edge);
+		total_nodes += frag->size[DLGRAPHFILE_CHUNK_NODES] /
+		               sizeof(struct dlgraphfile_node);
 	}
 
-	fprintf(f, "%zu continuations\n", total_continuations);
+	fprintf(f, "%llu continuations\n", total_continuations);
 	for (int w = 0; w < nw; ++ w) {
-		struct dlgraph_fragment *frag = graph->fragments + w;
-		for (size_t i = 0; i < frag->continuations_count; ++ i) {
-			struct dlgraph_edge e = frag->continuations[i];
-			fprintf(f, "%lu %lu\n", e.head, e.tail);
+		struct dlgraph_chunk *c = graph->fragments[w].head[DLGRAPHFILE_CHUNK_CONTINUATIONS];
+		for (; c; c = c->next) {
+			struct dlgraphfile_continuation *e = (void *)c->data;
+			for (size_t i = 0; i < c->used / sizeof(*e); ++ i)
+				fprintf(f, "%llu %llu\n", (unsigned long long)e[i].head,
+				        (unsigned long long)e[i].tail);
 		}
 	}
 
-	fprintf(f, "%zu edges\n", total_edges);
+	fprintf(f, "%llu edges\n", total_edges);
 	for (int w = 0; w < nw; ++ w) {
-		struct dlgraph_fragment *frag = graph->fragments + w;
-		for (size_t i = 0; i < frag->edges_count; ++ i) {
-			struct dlgraph_edge e = frag->edges[i];
-			fprintf(f, "%llu %lu %lu\n", e.ts_ns, e.head, e.tail);
+		struct dlgraph_chunk *c = graph->fragments[w].head[DLGRAPHFILE_CHUNK_EDGES];
+		for (; c; c = c->next) {
+			struct dlgraphfile_edge *e = (void *)c->data;
+			for (size_t i = 0; i < c->used / sizeof(*e); ++ i)
+				fprintf(f, "%llu %llu %llu\n",
+				        (unsigned long long)(graph->base_ns + e[i].ts_ns),
+				        (unsigned long long)e[i].head,
+				        (unsigned long long)e[i].tail);
 		}
 	}
 
-	fprintf(f, "%zu nodes\n", total_nodes);
+	fprintf(f, "%llu nodes\n", total_nodes);
 	for (int w = 0; w < nw; ++ w) {
-		struct dlgraph_fragment *frag = graph->fragments + w;
-		for (size_t i = 0; i < frag->nodes_count; ++ i) {
-			struct dlgraph_node n = frag->nodes[i];
-			const char *label = NULL;
-			if (n.label_offset != ULONG_MAX) {
-				label = frag->label_buffer + n.label_offset;
+		struct dlgraph_chunk *c = graph->fragments[w].head[DLGRAPHFILE_CHUNK_NODES];
+		for (; c; c = c->next) {
+			struct dlgraphfile_node *n = (void *)c->data;
+			for (size_t i = 0; i < c->used / sizeof(*n); ++ i) {
+				const char *label = NULL;
+				if (n[i].label != DLGRAPHFILE_NO_LABEL)
+					label = dlgraph_label_at(graph, (uint32_t)w, n[i].label);
+				unsigned long long begin = graph->base_ns + n[i].begin_ns;
+				fprintf(f, "%s\n%d %llu %lu %llu %llu\n", label, w,
+				        (unsigned long long)n[i].task, (unsigned long)n[i].desc,
+				        begin, begin + (unsigned long long)n[i].duration_ns);
 			}
-			fprintf(f, "%s\n%d %lu %lu %llu %llu\n", label, w, n.task, n.desc, n.begin_ns, n.end_ns);
 		}
 	}
 
@@ -278,15 +919,189 @@ panic:
 	exit(errno);
 }
 
+static void
+dlgraph_dump_binary(struct dlgraph *graph, const char *prefix)
+{
+	uint32_t nw = (uint32_t)graph->nworkers;
+	struct dlgraphfile_desc *descs;
+	char *strings;
+	uint64_t strings_size;
+	uint32_t ndescs = dlgraph_descriptions(&descs, &strings, &strings_size);
+
+	struct dlgraphfile_header h = {
+		.magic = DLGRAPHFILE_MAGIC,
+		.version = DLGRAPHFILE_VERSION,
+		.byte_order = DLGRAPHFILE_BYTE_ORDER,
+		.id = graph->id,
+		.base_ns = graph->base_ns,
+		.nworkers = nw,
+		.ndescs = ndescs,
+		.strings_size = strings_size,
+		.parent_id = graph->parent ? graph->parent->id : DLGRAPHFILE_NO_PARENT
+	};
+
+	/* Header, descriptions, workers and strings are written at once */
+	struct dlgraphfile_worker *workers = calloc(nw, sizeof(*workers));
+	if (!workers)
+		goto panic;
+	for (uint32_t w = 0; w < nw; ++ w) {
+		struct dlgraph_fragment *frag = graph->fragments + w;
+		workers[w].nodes_count = frag->size[DLGRAPHFILE_CHUNK_NODES] /
+		                         sizeof(struct dlgraphfile_node);
+		workers[w].edges_count = frag->size[DLGRAPHFILE_CHUNK_EDGES] /
+		                         sizeof(struct dlgraphfile_edge);
+		workers[w].continuations_count = frag->size[DLGRAPHFILE_CHUNK_CONTINUATIONS] /
+		                                 sizeof(struct dlgraphfile_continuation);
+		workers[w].labels_size = frag->size[DLGRAPHFILE_CHUNK_LABELS];
+	}
+	dlgraphfile_layout(&h, workers);
+
+	size_t meta_size = (size_t)dlgraphfile_align(h.strings_offset + strings_size);
+	unsigned char *meta = calloc(1, meta_size);
+	if (!meta)
+		goto panic;
+	memcpy(meta, &h, sizeof h);
+	memcpy(meta + h.workers_offset, workers, nw * sizeof(*workers));
+	if (ndescs)
+		memcpy(meta + h.descs_offset, descs, ndescs * sizeof(*descs));
+	if (strings_size)
+		memcpy(meta + h.strings_offset, strings, (size_t)strings_size);
+
+	FILE *f = dlgraph_open(graph, prefix, ".dlgb");
+	if (!f)
+		goto panic;
+	fwrite(meta, 1, meta_size, f);
+
+	/* Sections of each worker follow in the order of the chunk kinds */
+	static const unsigned char padding[8];
+	for (uint32_t w = 0; w < nw; ++ w) {
+		struct dlgraph_fragment *frag = graph->fragments + w;
+		for (unsigned k = 0; k < DLGRAPH_CHUNK_KINDS; ++ k)
+			for (struct dlgraph_chunk *c = frag->head[k]; c; c = c->next)
+				fwrite(c->data, 1, c->used, f);
+		size_t labels = (size_t)frag->size[DLGRAPHFILE_CHUNK_LABELS];
+		fwrite(padding, 1, (size_t)dlgraphfile_align(labels) - labels, f);
+	}
+
+	free(meta);
+	free(workers);
+	free(descs);
+	free(strings);
+	if (ferror(f) || fclose(f) != 0)
+		goto panic;
+
+	return;
+panic:
+	perror("dlgraph_write failed to write to file");
+	exit(errno);
+}
+
+/*
+ * dlgraph_trace_segment() and dlgraph_label_at() expose a graph's chunks as
+ * a dltrace_source.
+ */
+static const void *
+dlgraph_trace_segment(void *ctx, uint32_t worker, unsigned kind,
+                      const void **cursor, size_t *size)
+{
+	struct dlgraph *graph = ctx;
+	const struct dlgraph_chunk *c = *cursor;
+	c = c ? c->next : graph->fragments[worker].head[kind];
+	*cursor = c;
+	if (!c)
+		return NULL;
+	*size = c->used;
+	return c->data;
+}
+
+static const char *
+dlgraph_label_at(void *ctx, uint32_t worker, uint32_t offset)
+{
+	struct dlgraph *graph = ctx;
+	const struct dlgraph_chunk *c = graph->fragments[worker].head[DLGRAPHFILE_CHUNK_LABELS];
+	while (c && offset >= c->used) {
+		offset -= (uint32_t)c->used;
+		c = c->next;
+	}
+	return c ? (const char *)c->data + offset : NULL;
+}
+
+static void
+dlgraph_dump_trace(struct dlgraph *graph, const char *prefix)
+{
+	struct dlgraphfile_desc *descs;
+	char *strings;
+	uint64_t strings_size;
+	uint32_t ndescs = dlgraph_descriptions(&descs, &strings, &strings_size);
+	struct dltrace_source src = {
+		.ctx = graph,
+		.nworkers = (uint32_t)graph->nworkers,
+		.ndescs = ndescs,
+		.descs = descs,
+		.strings = strings,
+		.strings_size = strings_size,
+		.segment = dlgraph_trace_segment,
+		.label = dlgraph_label_at
+	};
+
+	FILE *f = dlgraph_open(graph, prefix, ".json");
+	if (!f || dltrace_write(f, &src) || fclose(f) != 0) {
+		perror("dlgraph_write failed to write to file");
+		exit(errno);
+	}
+	free(descs);
+	free(strings);
+}
+
+static uint32_t
+dlgraph_descriptions(struct dlgraphfile_desc **descs, char **strings,
+                     uint64_t *strings_size)
+{
+	struct dlgraph_node_description *head;
+	head = atomic_load(&dl_node_description_lst_head);
+	uint32_t ndescs = head ? (uint32_t)head->id + 1 : 0;
+
+	size_t size = 0;
+	for (struct dlgraph_node_description *d = head; d; d = d->next)
+		size += strlen(d->file) + strlen(d->func) + 2;
+
+	*descs = calloc(ndescs ? ndescs : 1, sizeof(**descs));
+	*strings = malloc(size ? size : 1);
+	if (!*descs || !*strings) {
+		perror("dlgraph failed to allocate node descriptions");
+		exit(errno);
+	}
+
+	uint32_t offset = 0;
+	for (struct dlgraph_node_description *d = head; d; d = d->next) {
+		size_t flen = strlen(d->file) + 1;
+		size_t fnlen = strlen(d->func) + 1;
+		(*descs)[d->id] = (struct dlgraphfile_desc) {
+			.file = offset,
+			.func = offset + (uint32_t)flen,
+			.line = (uint32_t)d->line
+		};
+		memcpy(*strings + offset, d->file, flen);
+		memcpy(*strings + offset + flen, d->func, fnlen);
+		offset += (uint32_t)(flen + fnlen);
+	}
+	*strings_size = size;
+	return ndescs;
+}
+
 static void
 dlgraph_free(struct dlgraph *graph)
 {
 	size_t nw = (size_t)graph->nworkers;
 	for (size_t i = 0; i < nw; ++ i) {
-		free(graph->fragments[i].label_buffer);
-		free(graph->fragments[i].continuations);
-		free(graph->fragments[i].edges);
-		free(graph->fragments[i].nodes);
+		for (unsigned k = 0; k < DLGRAPH_CHUNK_KINDS; ++ k) {
+			struct dlgraph_chunk *c = graph->fragments[i].head[k];
+			while (c) {
+				struct dlgraph_chunk *next = c->next;
+				free(c);
+				c = next;
+			}
+		}
 	}
 	free(graph);
 }
@@ -0,0 +1,773 @@
+#if !defined(_WIN32)
+/* fstat, mmap */
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "graphfile.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if !defined(_WIN32)
+#include <fcntl.h>    /* open */
+#include <sys/mman.h> /* mmap, munmap */
+#include <sys/stat.h> /* fstat */
+#include <unistd.h>   /* close */
+#endif
+
+/*
+ * Binary graphs are used in place, either mapped or, on Windows, read into
+ * memory. Text graphs are parsed into a binary image in memory so every
+ * accessor only ever deals with one layout. header is a copy of the image's
+ * header as of the current version, since older headers are shorter.
+ */
+struct dlgraphfile_ {
+	unsigned char *image;
+	size_t         size;
+	int            mapped;
+	struct dlgraphfile_header header;
+};
+
+/*
+ * dlgraphfile_read_binary() maps or reads a whole binary graph.
+ *
+ * dlgraphfile_read_stream() reads a stream and gathers its chunks into a
+ * binary image.
+ *
+ * dlgraphfile_read_text() parses a text graph into a binary image.
+ *
+ * dlgraphfile_read_header() copies the header at the start of an image of
+ * size bytes into h, filling fields its version lacks, and stores the size
+ * of the header in the image in *hsize. Zero is returned on success,
+ * otherwise EINVAL if the image is too small or its version unsupported.
+ *
+ * dlgraphfile_validate() checks that every section of an image lies within
+ * it. Zero is returned if so, otherwise EINVAL.
+ */
+static int dlgraphfile_read_binary(dlgraphfile *, const char *path);
+static int dlgraphfile_read_stream(dlgraphfile *, const char *path);
+static int dlgraphfile_read_text  (dlgraphfile *, FILE *);
+static int dlgraphfile_read_header(struct dlgraphfile_header *h, size_t *hsize,
+                                   const unsigned char *image, size_t size);
+static int dlgraphfile_validate   (const dlgraphfile *);
+
+/*
+ * dlgraphfile_close_image() unmaps or frees a graph's image.
+ */
+static void dlgraphfile_close_image(dlgraphfile *);
+
+int
+dlgraphfile_open(dlgraphfile **out, const char *path)
+{
+	int result = 0;
+
+	dlgraphfile *g = calloc(1, sizeof(*g));
+	if (!g) return errno = ENOMEM;
+
+	FILE *f = fopen(path, "rb");
+	if (!f) {
+		result = errno;
+		goto open_failed;
+	}
+	char magic[sizeof(DLGRAPHFILE_MAGIC)] = { 0 };
+	size_t got = fread(magic, 1, sizeof magic, f);
+	int binary = got == sizeof magic &&
+	             memcmp(magic, DLGRAPHFILE_MAGIC, sizeof magic) == 0;
+	int stream = got == sizeof magic &&
+	             memcmp(magic, DLGRAPHFILE_STREAM_MAGIC, sizeof magic) == 0;
+	if (binary) {
+		fclose(f);
+		result = dlgraphfile_read_binary(g, path);
+		if (!result) {
+			size_t hsize;
+			result = dlgraphfile_read_header(&g->header, &hsize,
+			                                 g->image, g->size);
+			if (result)
+				dlgraphfile_close_image(g);
+		}
+	} else if (stream) {
+		fclose(f);
+		result = dlgraphfile_read_stream(g, path);
+	} else {
+		rewind(f);
+		result = dlgraphfile_read_text(g, f);
+		fclose(f);
+	}
+	if (result)
+		goto open_failed;
+
+	result = dlgraphfile_validate(g);
+	if (result) {
+		dlgraphfile_close(g);
+		return errno = result;
+	}
+	*out = g;
+	return 0;
+
+open_failed:
+	free(g);
+	return errno = result;
+}
+
+void
+dlgraphfile_close(dlgraphfile *g)
+{
+	if (!g) return;
+	dlgraphfile_close_image(g);
+	free(g);
+}
+
+const struct dlgraphfile_header *
+dlgraphfile_header(const dlgraphfile *g)
+{
+	return &g->header;
+}
+
+const struct dlgraphfile_desc *
+dlgraphfile_desc(const dlgraphfile *g, uint32_t i)
+{
+	const struct dlgraphfile_header *h = dlgraphfile_header(g);
+	if (i >= h->ndescs) return NULL;
+	return (const struct dlgraphfile_desc *)(g->image + h->descs_offset) + i;
+}
+
+const char *
+dlgraphfile_string(const dlgraphfile *g, uint32_t offset)
+{
+	const struct dlgraphfile_header *h = dlgraphfile_header(g);
+	if (offset >= h->strings_size) return NULL;
+	return (const char *)g->image + h->strings_offset + offset;
+}
+
+static const struct dlgraphfile_worker *
+dlgraphfile_worker(const dlgraphfile *g, uint32_t worker)
+{
+	const struct dlgraphfile_header *h = dlgraphfile_header(g);
+	if (worker >= h->nworkers) return NULL;
+	return (const struct dlgraphfile_worker *)(g->image + h->workers_offset) + worker;
+}
+
+const struct dlgraphfile_node *
+dlgraphfile_nodes(const dlgraphfile *g, uint32_t worker, size_t *count)
+{
+	const struct dlgraphfile_worker *w = dlgraphfile_worker(g, worker);
+	*count = w ? (size_t)w->nodes_count : 0;
+	return w ? (const void *)(g->image + w->nodes_offset) : NULL;
+}
+
+const struct dlgraphfile_edge *
+dlgraphfile_edges(const dlgraphfile *g, uint32_t worker, size_t *count)
+{
+	const struct dlgraphfile_worker *w = dlgraphfile_worker(g, worker);
+	*count = w ? (size_t)w->edges_count : 0;
+	return w ? (const void *)(g->image + w->edges_offset) : NULL;
+}
+
+const struct dlgraphfile_continuation *
+dlgraphfile_continuations(const dlgraphfile *g, uint32_t worker, size_t *count)
+{
+	const struct dlgraphfile_worker *w = dlgraphfile_worker(g, worker);
+	*count = w ? (size_t)w->continuations_count : 0;
+	return w ? (const void *)(g->image + w->continuations_offset) : NULL;
+}
+
+const char *
+dlgraphfile_label(const dlgraphfile *g, uint32_t worker,
+                  const struct dlgraphfile_node *n)
+{
+	const struct dlgraphfile_worker *w = dlgraphfile_worker(g, worker);
+	if (!w || n->label == DLGRAPHFILE_NO_LABEL || n->label >= w->labels_size)
+		return NULL;
+	return (const char *)g->image + w->labels_offset + n->label;
+}
+
+uint32_t
+dlgraphfile_task_worker(const dlgraphfile *g, uint64_t task, uint64_t *seq)
+{
+	unsigned bits = dlgraphfile_header(g)->version == 1 ? 24 : 48;
+	if (seq)
+		*seq = task & ((1ull << bits) - 1);
+	return (uint32_t)(task >> bits) & (bits == 24 ? 0xFF : 0xFFFF);
+}
+
+static void
+dlgraphfile_close_image(dlgraphfile *g)
+{
+#if !defined(_WIN32)
+	if (g->mapped)
+		munmap(g->image, g->size);
+	else
+#endif
+		free(g->image);
+	g->image = NULL;
+}
+
+static int
+dlgraphfile_read_binary(dlgraphfile *g, const char *path)
+{
+#if !defined(_WIN32)
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) return errno;
+	struct stat st;
+	if (fstat(fd, &st)) {
+		int result = errno;
+		close(fd);
+		return result;
+	}
+	if ((size_t)st.st_size < sizeof(struct dlgraphfile_header)) {
+		close(fd);
+		return EINVAL;
+	}
+	void *image = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE,
+	                   fd, 0);
+	int result = errno;
+	close(fd);
+	if (image == MAP_FAILED) return result;
+	g->image = image;
+	g->size = (size_t)st.st_size;
+	g->mapped = 1;
+	return 0;
+#else
+	FILE *f = fopen(path, "rb");
+	if (!f) return errno;
+	int result = 0;
+	if (fseek(f, 0, SEEK_END) || (g->size = (size_t)ftell(f)) == (size_t)-1 ||
+	    fseek(f, 0, SEEK_SET))
+	{
+		result = errno;
+		goto read_failed;
+	}
+	if (g->size < sizeof(struct dlgraphfile_header)) {
+		result = EINVAL;
+		goto read_failed;
+	}
+	g->image = malloc(g->size);
+	if (!g->image) {
+		result = ENOMEM;
+		goto read_failed;
+	}
+	if (fread(g->image, 1, g->size, f) != g->size) {
+		result = EINVAL;
+		free(g->image);
+		g->image = NULL;
+	}
+read_failed:
+	fclose(f);
+	return result;
+#endif
+}
+
+static int
+dlgraphfile_read_stream(dlgraphfile *g, const char *path)
+{
+	dlgraphfile in = { 0 };
+	int result = dlgraphfile_read_binary(&in, path);
+	if (result) return result;
+
+	struct dlgraphfile_header h;
+	size_t hsize;
+	result = dlgraphfile_read_header(&h, &hsize, in.image, in.size);
+	if (result)
+		goto cleanup;
+	if (h.byte_order != DLGRAPHFILE_BYTE_ORDER || h.nworkers == 0) {
+		result = EINVAL;
+		goto cleanup;
+	}
+	struct dlgraphfile_worker *workers = calloc(h.nworkers, sizeof(*workers));
+	if (!workers) {
+		result = ENOMEM;
+		goto cleanup;
+	}
+
+	/*
+	 * The first pass sizes every section and the second copies chunks
+	 * into place. A chunk cut short ends the stream.
+	 */
+	uint64_t *filled = NULL;
+	for (int pass = 0; pass < 2; ++ pass) {
+		uint64_t off = hsize;
+		while (off + sizeof(struct dlgraphfile_chunk) <= in.size) {
+			struct dlgraphfile_chunk c;
+			memcpy(&c, in.image + off, sizeof c);
+			off += sizeof c;
+			if (c.size > in.size - off)
+				break;
+			const unsigned char *data = in.image + off;
+			off = dlgraphfile_align(off + c.size);
+			if (c.kind == DLGRAPHFILE_CHUNK_DESCS) {
+				h.ndescs = (uint32_t)(c.size / sizeof(struct dlgraphfile_desc));
+				if (pass)
+					memcpy(g->image + h.descs_offset, data,
+					       h.ndescs * sizeof(struct dlgraphfile_desc));
+				continue;
+			}
+			if (c.kind == DLGRAPHFILE_CHUNK_STRINGS) {
+				h.strings_size = c.size;
+				if (pass)
+					memcpy(g->image + h.strings_offset, data, c.size);
+				continue;
+			}
+			if (c.worker >= h.nworkers || c.kind > DLGRAPHFILE_CHUNK_LABELS) {
+				result = EINVAL;
+				goto sections_failed;
+			}
+			struct dlgraphfile_worker *w = workers + c.worker;
+			uint64_t *counts[] = {
+				&w->nodes_count, &w->edges_count,
+				&w->continuations_count, &w->labels_size
+			};
+			uint64_t *offsets[] = {
+				&w->nodes_offset, &w->edges_offset,
+				&w->continuations_offset, &w->labels_offset
+			};
+			static const size_t sizes[] = {
+				sizeof(struct dlgraphfile_node),
+				sizeof(struct dlgraphfile_edge),
+				sizeof(struct dlgraphfile_continuation),
+				1
+			};
+			uint64_t records = c.size / sizes[c.kind];
+			if (pass == 0) {
+				*counts[c.kind] += records;
+			} else {
+				uint64_t *at = filled + c.worker * 4 + c.kind;
+				memcpy(g->image + *offsets[c.kind] + *at * sizes[c.kind],
+				       data, records * sizes[c.kind]);
+				*at += records;
+			}
+		}
+
+		if (pass == 0) {
+			memcpy(h.magic, DLGRAPHFILE_MAGIC, sizeof h.magic);
+			g->size = (size_t)dlgraphfile_layout(&h, workers);
+			g->image = calloc(1, g->size);
+			filled = calloc(h.nworkers * 4ull, sizeof(*filled));
+			if (!g->image || !filled) {
+				result = ENOMEM;
+				goto sections_failed;
+			}
+			memcpy(g->image, &h, sizeof h);
+			memcpy(g->image + h.workers_offset, workers,
+			       h.nworkers * sizeof(*workers));
+			g->header = h;
+		}
+	}
+
+sections_failed:
+	if (result) {
+		free(g->image);
+		g->image = NULL;
+	}
+	free(filled);
+	free(workers);
+cleanup:
+	dlgraphfile_close_image(&in);
+	return result;
+}
+
+/*
+ * dlgraphfile_section_ok() returns nonzero if count elements of size bytes
+ * at offset lie within an image of image_size bytes.
+ */
+static int
+dlgraphfile_section_ok(uint64_t offset, uint64_t count, uint64_t size,
+                       uint64_t image_size)
+{
+	if (offset > image_size || offset % 8) return 0;
+	if (size && count > (image_size - offset) / size) return 0;
+	return 1;
+}
+
+static int
+dlgraphfile_read_header(struct dlgraphfile_header *h, size_t *hsize,
+                        const unsigned char *image, size_t size)
+{
+	uint32_t version;
+	if (size < offsetof(struct dlgraphfile_header, byte_order))
+		return EINVAL;
+	memcpy(&version, image + offsetof(struct dlgraphfile_header, version),
+	       sizeof version);
+	if (version < 1 || version > DLGRAPHFILE_VERSION)
+		return EINVAL;
+	*hsize = version < 3 ? offsetof(struct dlgraphfile_header, parent_id)
+	                     : sizeof *h;
+	if (size < *hsize)
+		return EINVAL;
+	h->parent_id = DLGRAPHFILE_NO_PARENT;
+	memcpy(h, image, *hsize);
+	return 0;
+}
+
+static int
+dlgraphfile_validate(const dlgraphfile *g)
+{
+	const struct dlgraphfile_header *h = dlgraphfile_header(g);
+	if (memcmp(h->magic, DLGRAPHFILE_MAGIC, sizeof h->magic) ||
+	    h->byte_order != DLGRAPHFILE_BYTE_ORDER)
+	{
+		return EINVAL;
+	}
+
+	uint64_t n = g->size;
+	if (!dlgraphfile_section_ok(h->descs_offset, h->ndescs,
+	                            sizeof(struct dlgraphfile_desc), n) ||
+	    !dlgraphfile_section_ok(h->workers_offset, h->nworkers,
+	                            sizeof(struct dlgraphfile_worker), n) ||
+	    !dlgraphfile_section_ok(h->strings_offset, h->strings_size, 1, n))
+	{
+		return EINVAL;
+	}
+	/* Strings must be terminated so they can be used in place */
+	if (h->strings_size && g->image[h->strings_offset + h->strings_size - 1])
+		return EINVAL;
+
+	for (uint32_t i = 0; i < h->ndescs; ++ i) {
+		const struct dlgraphfile_desc *d = dlgraphfile_desc(g, i);
+		if (d->file >= h->strings_size || d->func >= h->strings_size)
+			return EINVAL;
+	}
+
+	for (uint32_t i = 0; i < h->nworkers; ++ i) {
+		const struct dlgraphfile_worker *w = dlgraphfile_worker(g, i);
+		if (!dlgraphfile_section_ok(w->nodes_offset, w->nodes_count,
+		                            sizeof(struct dlgraphfile_node), n) ||
+		    !dlgraphfile_section_ok(w->edges_offset, w->edges_count,
+		                            sizeof(struct dlgraphfile_edge), n) ||
+		    !dlgraphfile_section_ok(w->continuations_offset,
+		                            w->continuations_count,
+		                            sizeof(struct dlgraphfile_continuation), n) ||
+		    !dlgraphfile_section_ok(w->labels_offset, w->labels_size, 1, n))
+		{
+			return EINVAL;
+		}
+		if (w->labels_size && g->image[w->labels_offset + w->labels_size - 1])
+			return EINVAL;
+	}
+	return 0;
+}
+
+/*
+ * Everything below parses the text format, see dlgraph_dump_text() in
+ * graph.c, into growable arrays before laying them out as a binary image.
+ */
+struct dlgraphfile_text_worker {
+	struct dlgraphfile_node *nodes;
+	size_t                   nodes_count;
+	size_t                   nodes_size;
+	char                    *labels;
+	size_t                   labels_count;
+	size_t                   labels_size;
+};
+
+struct dlgraphfile_text {
+	char                            *line;
+	size_t                           line_size;
+	char                            *label;
+	size_t                           label_size;
+	char                            *strings;
+	size_t                           strings_count;
+	size_t                           strings_size;
+	struct dlgraphfile_desc         *descs;
+	size_t                           ndescs;
+	struct dlgraphfile_continuation *continuations;
+	size_t                           continuations_count;
+	struct dlgraphfile_edge         *edges;
+	size_t                           edges_count;
+	struct dlgraphfile_text_worker  *workers;
+	size_t                           nworkers;
+};
+
+/*
+ * dlgraphfile_grow() ensures an array of elements of size bytes with
+ * capacity *cap can hold need elements. Zero is returned on success,
+ * otherwise ENOMEM.
+ */
+static int
+dlgraphfile_grow(void *array, size_t *cap, size_t need, size_t size)
+{
+	if (need <= *cap) return 0;
+	size_t ncap = *cap ? *cap : 64;
+	while (ncap < need) ncap *= 2;
+	void *grown = realloc(*(void **)array, ncap * size);
+	if (!grown) return ENOMEM;
+	*(void **)array = grown;
+	*cap = ncap;
+	return 0;
+}
+
+/*
+ * dlgraphfile_line() reads the next line without its line terminator,
+ * returning NULL at the end of the file or on error.
+ */
+static char *
+dlgraphfile_line(struct dlgraphfile_text *t, FILE *f)
+{
+	size_t len = 0;
+	for (;;) {
+		if (dlgraphfile_grow(&t->line, &t->line_size, len + 256, 1))
+			return NULL;
+		if (!fgets(t->line + len, (int)(t->line_size - len), f))
+			return len ? t->line : NULL;
+		len += strlen(t->line + len);
+		if (len && t->line[len - 1] == '\n') {
+			t->line[-- len] = '\0';
+			if (len && t->line[len - 1] == '\r')
+				t->line[-- len] = '\0';
+			return t->line;
+		}
+	}
+}
+
+/*
+ * dlgraphfile_fields() parses a line of exactly n unsigned decimal fields
+ * separated by spaces, which is much faster than sscanf() over millions of
+ * lines. Zero is returned on success, otherwise EINVAL.
+ */
+static int
+dlgraphfile_fields(const char *line, unsigned long long *v, int n)
+{
+	const char *p = line;
+	for (int i = 0; i < n; ++ i) {
+		if (i && *p ++ != ' ')
+			return EINVAL;
+		if (*p < '0' || *p > '9')
+			return EINVAL;
+		unsigned long long x = 0;
+		for (; *p >= '0' && *p <= '9'; ++ p)
+			x = x * 10 + (unsigned long long)(*p - '0');
+		v[i] = x;
+	}
+	return *p ? EINVAL : 0;
+}
+
+/*
+ * dlgraphfile_append() copies a string and its terminator into a growable
+ * buffer, storing its offset in offset.
+ */
+static int
+dlgraphfile_append(char **buf, size_t *count, size_t *size, const char *s,
+                   uint32_t *offset)
+{
+	size_t len = strlen(s) + 1;
+	if (dlgraphfile_grow(buf, size, *count + len, 1)) return ENOMEM;
+	memcpy(*buf + *count, s, len);
+	*offset = (uint32_t)*count;
+	*count += len;
+	return 0;
+}
+
+/*
+ * dlgraphfile_count() parses a section header line such as "12 edges".
+ */
+static int
+dlgraphfile_count(struct dlgraphfile_text *t, FILE *f, const char *what,
+                  size_t *count)
+{
+	char *line = dlgraphfile_line(t, f);
+	char *end;
+	if (!line) return EINVAL;
+	errno = 0;
+	unsigned long long n = strtoull(line, &end, 10);
+	if (errno || end == line || strcmp(end + (*end == ' '), what))
+		return EINVAL;
+	*count = (size_t)n;
+	return 0;
+}
+
+static int
+dlgraphfile_parse_text(struct dlgraphfile_text *t, FILE *f,
+                       unsigned long long *base)
+{
+	size_t n, cap = 0;
+	if (dlgraphfile_count(t, f, "node descriptions", &n)) return EINVAL;
+	if (dlgraphfile_grow(&t->descs, &cap, n, sizeof(*t->descs))) return ENOMEM;
+	for (t->ndescs = 0; t->ndescs < n; ++ t->ndescs) {
+		struct dlgraphfile_desc *d = t->descs + t->ndescs;
+		memset(d, 0, sizeof *d);
+		char *line = dlgraphfile_line(t, f);
+		if (!line) return EINVAL;
+		if (dlgraphfile_append(&t->strings, &t->strings_count,
+		                       &t->strings_size, line, &d->file))
+			return ENOMEM;
+		if (!(line = dlgraphfile_line(t, f))) return EINVAL;
+		d->line = (uint32_t)strtoul(line, NULL, 10);
+		if (!(line = dlgraphfile_line(t, f))) return EINVAL;
+		if (dlgraphfile_append(&t->strings, &t->strings_count,
+		                       &t->strings_size, line, &d->func))
+			return ENOMEM;
+	}
+
+	cap = 0;
+	if (dlgraphfile_count(t, f, "continuations", &n)) return EINVAL;
+	if (dlgraphfile_grow(&t->continuations, &cap, n,
+	                     sizeof(*t->continuations)))
+		return ENOMEM;
+	for (t->continuations_count = 0; t->continuations_count < n;
+	     ++ t->continuations_count)
+	{
+		struct dlgraphfile_continuation *c = t->continuations +
+		                                     t->continuations_count;
+		char *line = dlgraphfile_line(t, f);
+		unsigned long long v[2];
+		if (!line || dlgraphfile_fields(line, v, 2))
+			return EINVAL;
+		c->head = v[0];
+		c->tail = v[1];
+	}
+
+	cap = 0;
+	if (dlgraphfile_count(t, f, "edges", &n)) return EINVAL;
+	if (dlgraphfile_grow(&t->edges, &cap, n, sizeof(*t->edges)))
+		return ENOMEM;
+	for (t->edges_count = 0; t->edges_count < n; ++ t->edges_count) {
+		struct dlgraphfile_edge *e = t->edges + t->edges_count;
+		char *line = dlgraphfile_line(t, f);
+		unsigned long long v[3];
+		if (!line || dlgraphfile_fields(line, v, 3))
+			return EINVAL;
+		e->ts_ns = v[0];
+		e->head = v[1];
+		e->tail = v[2];
+		if (v[0] < *base) *base = v[0];
+	}
+
+	if (dlgraphfile_count(t, f, "nodes", &n)) return EINVAL;
+	size_t workers_size = 0;
+	for (size_t i = 0; i < n; ++ i) {
+		char *line = dlgraphfile_line(t, f);
+		if (!line) return EINVAL;
+		/* glibc prints NULL labels as (null) */
+		int has_label = strcmp(line, "(null)") != 0;
+		uint32_t label = DLGRAPHFILE_NO_LABEL;
+		if (has_label) {
+			/* The label is kept aside while its node's line is read */
+			size_t len = strlen(line) + 1;
+			if (dlgraphfile_grow(&t->label, &t->label_size, len, 1))
+				return ENOMEM;
+			memcpy(t->label, line, len);
+		}
+
+		line = dlgraphfile_line(t, f);
+		unsigned long long v[5];
+		if (!line || dlgraphfile_fields(line, v, 5) || v[0] > UINT32_MAX)
+			return EINVAL;
+		size_t w = (size_t)v[0];
+		unsigned long long task = v[1], desc = v[2], begin = v[3], end = v[4];
+		if (w >= t->nworkers) {
+			if (dlgraphfile_grow(&t->workers, &workers_size,
+			                     w + 1, sizeof(*t->workers)))
+				return ENOMEM;
+			memset(t->workers + t->nworkers, 0,
+			       (w + 1 - t->nworkers) * sizeof(*t->workers));
+			t->nworkers = w + 1;
+		}
+		struct dlgraphfile_text_worker *tw = t->workers + w;
+		if (has_label && dlgraphfile_append(&tw->labels, &tw->labels_count,
+		                                    &tw->labels_size, t->label,
+		                                    &label))
+			return ENOMEM;
+		if (dlgraphfile_grow(&tw->nodes, &tw->nodes_size,
+		                     tw->nodes_count + 1, sizeof(*tw->nodes)))
+			return ENOMEM;
+		tw->nodes[tw->nodes_count ++] = (struct dlgraphfile_node) {
+			.task = task,
+			.desc = (uint32_t)desc,
+			.label = label,
+			.begin_ns = begin,
+			.duration_ns = end - begin
+		};
+		if (begin < *base) *base = begin;
+	}
+	return 0;
+}
+
+static int
+dlgraphfile_read_text(dlgraphfile *g, FILE *f)
+{
+	struct dlgraphfile_text t;
+	memset(&t, 0, sizeof t);
+	unsigned long long base = ~0ull;
+	int result = dlgraphfile_parse_text(&t, f, &base);
+	if (result)
+		goto cleanup;
+	if (base == ~0ull)
+		base = 0;
+	/* Edges and continuations need a worker to belong to */
+	size_t nw = t.nworkers ? t.nworkers : 1;
+
+	struct dlgraphfile_header h = {
+		.magic = DLGRAPHFILE_MAGIC,
+		.version = DLGRAPHFILE_VERSION,
+		.byte_order = DLGRAPHFILE_BYTE_ORDER,
+		.base_ns = base,
+		.nworkers = (uint32_t)nw,
+		.ndescs = (uint32_t)t.ndescs,
+		.strings_size = t.strings_count,
+		.parent_id = DLGRAPHFILE_NO_PARENT
+	};
+	struct dlgraphfile_worker *workers = calloc(nw, sizeof(*workers));
+	if (!workers) {
+		result = ENOMEM;
+		goto cleanup;
+	}
+	for (size_t w = 0; w < t.nworkers; ++ w) {
+		workers[w].nodes_count = t.workers[w].nodes_count;
+		workers[w].labels_size = t.workers[w].labels_count;
+	}
+	workers[0].edges_count = t.edges_count;
+	workers[0].continuations_count = t.continuations_count;
+
+	g->size = (size_t)dlgraphfile_layout(&h, workers);
+	g->image = calloc(1, g->size);
+	if (!g->image) {
+		free(workers);
+		result = ENOMEM;
+		goto cleanup;
+	}
+
+	unsigned char *img = g->image;
+	memcpy(img, &h, sizeof h);
+	g->header = h;
+	memcpy(img + h.workers_offset, workers, nw * sizeof(*workers));
+	if (t.ndescs)
+		memcpy(img + h.descs_offset, t.descs, t.ndescs * sizeof(*t.descs));
+	if (t.strings_count)
+		memcpy(img + h.strings_offset, t.strings, t.strings_count);
+
+	struct dlgraphfile_edge *edges = (void *)(img + workers[0].edges_offset);
+	for (size_t i = 0; i < t.edges_count; ++ i) {
+		edges[i] = t.edges[i];
+		edges[i].ts_ns -= base;
+	}
+	if (t.continuations_count)
+		memcpy(img + workers[0].continuations_offset, t.continuations,
+		       t.continuations_count * sizeof(*t.continuations));
+	for (size_t w = 0; w < t.nworkers; ++ w) {
+		struct dlgraphfile_text_worker *tw = t.workers + w;
+		struct dlgraphfile_node *nodes = (void *)(img + workers[w].nodes_offset);
+		for (size_t i = 0; i < tw->nodes_count; ++ i) {
+			nodes[i] = tw->nodes[i];
+			nodes[i].begin_ns -= base;
+		}
+		if (tw->labels_count)
+			memcpy(img + workers[w].labels_offset, tw->labels,
+			       tw->labels_count);
+	}
+	free(workers);
+
+cleanup:
+	for (size_t w = 0; w < t.nworkers; ++ w) {
+		free(t.workers[w].nodes);
+		free(t.workers[w].labels);
+	}
+	free(t.workers);
+	free(t.edges);
+	free(t.continuations);
+	free(t.descs);
+	free(t.strings);
+	free(t.label);
+	free(t.line);
+	return result;
+}
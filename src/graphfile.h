@@ -0,0 +1,48 @@
+#ifndef DEADLOCK_GRAPHFILE_PRIVATE_H_
+#define DEADLOCK_GRAPHFILE_PRIVATE_H_
+
+#include "deadlock/graphfile.h"
+
+/*
+ * dlgraphfile_align() rounds an offset up to the 8 byte alignment of every
+ * section of a binary graph.
+ *
+ * dlgraphfile_layout() is shared by the writer and the reader, which lays
+ * out text graphs as binary images in memory. Every count and size in the
+ * header and each of its nworkers workers must be set; every offset is
+ * filled in and the total size of the file is returned.
+ */
+static inline uint64_t
+dlgraphfile_align(uint64_t offset)
+{
+	return (offset + 7) & ~(uint64_t)7;
+}
+
+static inline uint64_t
+dlgraphfile_layout(struct dlgraphfile_header *h,
+                   struct dlgraphfile_worker *workers)
+{
+	uint64_t off = sizeof *h;
+	h->descs_offset = off;
+	off += h->ndescs * (uint64_t)sizeof(struct dlgraphfile_desc);
+	h->workers_offset = off;
+	off += h->nworkers * (uint64_t)sizeof(struct dlgraphfile_worker);
+	h->strings_offset = off;
+	off = dlgraphfile_align(off + h->strings_size);
+
+	for (uint32_t i = 0; i < h->nworkers; ++ i) {
+		struct dlgraphfile_worker *w = workers + i;
+		w->nodes_offset = off;
+		off += w->nodes_count * sizeof(struct dlgraphfile_node);
+		w->edges_offset = off;
+		off += w->edges_count * sizeof(struct dlgraphfile_edge);
+		w->continuations_offset = off;
+		off += w->continuations_count *
+		       sizeof(struct dlgraphfile_continuation);
+		w->labels_offset = off;
+		off = dlgraphfile_align(off + w->labels_size);
+	}
+	return off;
+}
+
+#endif /* DEADLOCK_GRAPHFILE_PRIVATE_H_ */
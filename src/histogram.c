@@ -0,0 +1,303 @@
+#include "deadlock/dl.h"
+#include "deadlock/graph.h"
+#include "histogram.h"
+#include "json.h"
+
+#ifdef DEADLOCK_GRAPH_EXPORT
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * A worker's histograms are found by description ID through a two level
+ * table, so that a description's histogram never moves once published:
+ * pages[id / DLHIST_PAGE] points to a page of DLHIST_PAGE histogram
+ * pointers. Descriptions beyond DLHIST_PAGES * DLHIST_PAGE are not counted.
+ *
+ * Tables are indexed by worker index and outlive schedulers, so histograms
+ * accumulate across dlmain() calls until dlgraph_latency_reset().
+ * dlhist_nworkers is one more than the greatest worker index recorded.
+ * Concurrent schedulers share tables between their workers of the same
+ * index, which may lose counts but nothing worse.
+ */
+#define DLHIST_PAGE  64
+#define DLHIST_PAGES 1024
+
+struct dlhist_table {
+	_Atomic(_Atomic(struct dlhist *) *) pages[DLHIST_PAGES];
+};
+
+static _Atomic(struct dlhist_table *) dlhist_tables[DLTASK_ID_WORKERS];
+static atomic_int                     dlhist_nworkers = 0;
+
+/*
+ * dlhist_get() returns worker's histogram of desc, or NULL if it has never
+ * been recorded. dlhist_create() returns it, allocating it if needed.
+ */
+static struct dlhist *dlhist_get(int worker, unsigned long desc);
+static struct dlhist *dlhist_create(int worker, unsigned long desc);
+
+/*
+ * dlhist_add() adds n to a counter, see dlstats_add().
+ */
+static inline void
+dlhist_add(atomic_ullong *c, unsigned long long n)
+{
+	atomic_store_explicit(c, atomic_load_explicit(c, memory_order_relaxed) + n,
+	                      memory_order_relaxed);
+}
+
+static unsigned long long
+dlhist_load(atomic_ullong *c)
+{
+	return atomic_load_explicit(c, memory_order_relaxed);
+}
+
+/*
+ * dlhist_percentile() returns the duration below which p of a merged
+ * histogram's count fall, as the middle of its bucket clamped to the exact
+ * minimum and maximum.
+ */
+static unsigned long long dlhist_percentile(const unsigned long long *buckets,
+                                            unsigned long long count,
+                                            unsigned long long min_ns,
+                                            unsigned long long max_ns,
+                                            double p);
+
+void
+dlhist_record(int worker, unsigned long desc, unsigned long long ns)
+{
+	struct dlhist *h = dlhist_get(worker, desc);
+	if (!h && !(h = dlhist_create(worker, desc)))
+		return;
+	unsigned long long count = dlhist_load(&h->count);
+	if (count == 0 || ns < dlhist_load(&h->min_ns))
+		atomic_store_explicit(&h->min_ns, ns, memory_order_relaxed);
+	if (ns > dlhist_load(&h->max_ns))
+		atomic_store_explicit(&h->max_ns, ns, memory_order_relaxed);
+	dlhist_add(&h->sum_ns, ns);
+	dlhist_add(&h->buckets[dlhist_bucket(ns)], 1);
+	atomic_store_explicit(&h->count, count + 1, memory_order_release);
+}
+
+static struct dlhist *
+dlhist_get(int worker, unsigned long desc)
+{
+	struct dlhist_table *t = atomic_load_explicit(&dlhist_tables[worker],
+	                                              memory_order_acquire);
+	if (!t || desc >= DLHIST_PAGES * DLHIST_PAGE)
+		return NULL;
+	_Atomic(struct dlhist *) *page;
+	page = atomic_load_explicit(&t->pages[desc / DLHIST_PAGE], memory_order_acquire);
+	if (!page)
+		return NULL;
+	return atomic_load_explicit(&page[desc % DLHIST_PAGE], memory_order_acquire);
+}
+
+static struct dlhist *
+dlhist_create(int worker, unsigned long desc)
+{
+	if (desc >= DLHIST_PAGES * DLHIST_PAGE)
+		return NULL;
+
+	struct dlhist_table *t = atomic_load(&dlhist_tables[worker]);
+	if (!t) {
+		t = calloc(1, sizeof(*t));
+		if (!t) goto nomem;
+		atomic_store(&dlhist_tables[worker], t);
+		int nworkers = atomic_load(&dlhist_nworkers);
+		while (nworkers <= worker &&
+		       !atomic_compare_exchange_weak(&dlhist_nworkers, &nworkers, worker + 1));
+	}
+
+	_Atomic(struct dlhist *) *page = atomic_load(&t->pages[desc / DLHIST_PAGE]);
+	if (!page) {
+		page = calloc(DLHIST_PAGE, sizeof(*page));
+		if (!page) goto nomem;
+		atomic_store(&t->pages[desc / DLHIST_PAGE], page);
+	}
+
+	struct dlhist *h = calloc(1, sizeof(*h));
+	if (!h) goto nomem;
+	atomic_store(&page[desc % DLHIST_PAGE], h);
+	return h;
+
+nomem:
+	perror("dlgraph failed to allocate latency histogram");
+	exit(errno);
+}
+
+int
+dlgraph_latency_snapshot(struct dlgraph_latencies *latencies)
+{
+	*latencies = (struct dlgraph_latencies) { 0, NULL };
+	struct dlgraph_node_description *head;
+	head = atomic_load_explicit(&dl_node_description_lst_head, memory_order_acquire);
+	if (!head)
+		return 0;
+	size_t ndescs = head->id + 1;
+	if (ndescs > DLHIST_PAGES * DLHIST_PAGE)
+		ndescs = DLHIST_PAGES * DLHIST_PAGE;
+
+	latencies->descs = calloc(ndescs, sizeof(*latencies->descs));
+	unsigned long long *buckets = malloc(DLHIST_BUCKETS * sizeof(*buckets));
+	if (!latencies->descs || !buckets) {
+		free(buckets);
+		dlgraph_latency_free(latencies);
+		return errno = ENOMEM;
+	}
+
+	/* Descriptions are listed newest first, latencies oldest first */
+	int nworkers = atomic_load(&dlhist_nworkers);
+	for (struct dlgraph_node_description *d = head; d; d = d->next) {
+		if (d->id >= ndescs)
+			continue;
+		struct dlgraph_latency l = {
+			.file = d->file,
+			.func = d->func,
+			.line = d->line
+		};
+		unsigned long long sum = 0;
+		memset(buckets, 0, DLHIST_BUCKETS * sizeof(*buckets));
+		for (int w = 0; w < nworkers; ++ w) {
+			struct dlhist *h = dlhist_get(w, d->id);
+			if (!h)
+				continue;
+			unsigned long long count = atomic_load_explicit(&h->count, memory_order_acquire);
+			if (!count)
+				continue;
+			unsigned long long min_ns = dlhist_load(&h->min_ns);
+			unsigned long long max_ns = dlhist_load(&h->max_ns);
+			if (!l.count || min_ns < l.min_ns) l.min_ns = min_ns;
+			if (max_ns > l.max_ns)             l.max_ns = max_ns;
+			l.count += count;
+			sum += dlhist_load(&h->sum_ns);
+			for (unsigned b = 0; b < DLHIST_BUCKETS; ++ b)
+				buckets[b] += dlhist_load(&h->buckets[b]);
+		}
+		if (!l.count)
+			continue;
+		l.mean_ns = sum / l.count;
+		l.p50_ns  = dlhist_percentile(buckets, l.count, l.min_ns, l.max_ns, 0.5);
+		l.p90_ns  = dlhist_percentile(buckets, l.count, l.min_ns, l.max_ns, 0.9);
+		l.p99_ns  = dlhist_percentile(buckets, l.count, l.min_ns, l.max_ns, 0.99);
+		l.p999_ns = dlhist_percentile(buckets, l.count, l.min_ns, l.max_ns, 0.999);
+		latencies->descs[d->id] = l;
+	}
+	free(buckets);
+
+	/* Drop descriptions never recorded */
+	for (size_t i = 0; i < ndescs; ++ i) {
+		if (latencies->descs[i].count)
+			latencies->descs[latencies->count ++] = latencies->descs[i];
+	}
+	return 0;
+}
+
+void
+dlgraph_latency_free(struct dlgraph_latencies *latencies)
+{
+	free(latencies->descs);
+	latencies->descs = NULL;
+	latencies->count = 0;
+}
+
+void
+dlgraph_latency_reset(void)
+{
+	struct dlgraph_node_description *head;
+	head = atomic_load_explicit(&dl_node_description_lst_head, memory_order_acquire);
+	int nworkers = atomic_load(&dlhist_nworkers);
+	for (struct dlgraph_node_description *d = head; d; d = d->next) {
+		for (int w = 0; w < nworkers; ++ w) {
+			struct dlhist *h = dlhist_get(w, d->id);
+			if (!h)
+				continue;
+			atomic_store_explicit(&h->count, 0, memory_order_relaxed);
+			atomic_store_explicit(&h->sum_ns, 0, memory_order_relaxed);
+			atomic_store_explicit(&h->min_ns, 0, memory_order_relaxed);
+			atomic_store_explicit(&h->max_ns, 0, memory_order_relaxed);
+			for (unsigned b = 0; b < DLHIST_BUCKETS; ++ b)
+				atomic_store_explicit(&h->buckets[b], 0, memory_order_relaxed);
+		}
+	}
+}
+
+int
+dlgraph_latency_dump(const char *filename, int format)
+{
+	if (format != DLGRAPH_FORMAT_TEXT && format != DLGRAPH_FORMAT_JSON)
+		return errno = EINVAL;
+
+	struct dlgraph_latencies latencies;
+	if (dlgraph_latency_snapshot(&latencies))
+		return errno;
+	FILE *f = filename ? fopen(filename, "w") : stdout;
+	if (!f) {
+		int result = errno;
+		dlgraph_latency_free(&latencies);
+		return errno = result;
+	}
+
+	if (format == DLGRAPH_FORMAT_JSON)
+		fprintf(f, "[\n");
+	else
+		fprintf(f, "%-32s %12s %10s %10s %10s %10s %10s %10s %10s  %s\n",
+		        "function", "count", "mean", "min", "p50", "p90", "p99",
+		        "p99.9", "max", "location");
+	for (size_t i = 0; i < latencies.count; ++ i) {
+		const struct dlgraph_latency *l = latencies.descs + i;
+		if (format == DLGRAPH_FORMAT_JSON) {
+			fprintf(f, "{\"func\":\"");
+			dljson_puts(f, l->func);
+			fprintf(f, "\",\"file\":\"");
+			dljson_puts(f, l->file);
+			fprintf(f, "\",\"line\":%lu,"
+			           "\"count\":%llu,\"mean_ns\":%llu,\"min_ns\":%llu,"
+			           "\"p50_ns\":%llu,\"p90_ns\":%llu,\"p99_ns\":%llu,"
+			           "\"p999_ns\":%llu,\"max_ns\":%llu}%s\n",
+			        l->line, l->count, l->mean_ns,
+			        l->min_ns, l->p50_ns, l->p90_ns, l->p99_ns,
+			        l->p999_ns, l->max_ns,
+			        i + 1 < latencies.count ? "," : "");
+		} else {
+			fprintf(f, "%-32s %12llu %8lluns %8lluns %8lluns %8lluns %8lluns %8lluns %8lluns  %s:%lu\n",
+			        l->func, l->count, l->mean_ns, l->min_ns, l->p50_ns,
+			        l->p90_ns, l->p99_ns, l->p999_ns, l->max_ns,
+			        l->file, l->line);
+		}
+	}
+	if (format == DLGRAPH_FORMAT_JSON)
+		fprintf(f, "]\n");
+
+	dlgraph_latency_free(&latencies);
+	if (f == stdout)
+		return fflush(f) ? errno : 0;
+	return fclose(f) ? errno : 0;
+}
+
+static unsigned long long
+dlhist_percentile(const unsigned long long *buckets, unsigned long long count,
+                  unsigned long long min_ns, unsigned long long max_ns, double p)
+{
+	unsigned long long rank = (unsigned long long)(p * (double)count);
+	if (rank >= count)
+		rank = count - 1;
+	unsigned long long seen = 0;
+	unsigned b = 0;
+	for (; b < DLHIST_BUCKETS - 1; ++ b) {
+		seen += buckets[b];
+		if (seen > rank)
+			break;
+	}
+	unsigned long long lo = dlhist_bucket_ns(b);
+	unsigned long long hi = b + 1 < DLHIST_BUCKETS ? dlhist_bucket_ns(b + 1) : max_ns;
+	unsigned long long ns = lo + (hi > lo ? (hi - lo) / 2 : 0);
+	if (ns < min_ns) ns = min_ns;
+	if (ns > max_ns) ns = max_ns;
+	return ns;
+}
+
+#endif /* DEADLOCK_GRAPH_EXPORT */
@@ -0,0 +1,70 @@
+#ifndef DEADLOCK_HISTOGRAM_H_
+#define DEADLOCK_HISTOGRAM_H_
+
+#include <stdatomic.h>
+
+/*
+ * Every worker keeps a latency histogram of each node description whose
+ * tasks it recorded, updated as each node is added to a graph. Histograms
+ * are log-linear, as in HdrHistogram: durations below DLHIST_SUB_BUCKETS
+ * nanoseconds have a bucket each, and every power of two above is split
+ * into DLHIST_SUB_BUCKETS equal buckets, so a bucket is within 1 /
+ * DLHIST_SUB_BUCKETS of every duration it counts. Durations of 2^40ns,
+ * around eighteen minutes, or longer are counted in the last bucket.
+ * count, sum_ns, min_ns and max_ns are exact.
+ *
+ * Like dlstats_counters only its worker writes a histogram, with relaxed
+ * loads and stores, so merging reads them while they are written.
+ *
+ * dlhist_record() adds a duration in nanoseconds to worker's histogram of
+ * desc. Histograms are allocated the first time a worker records a
+ * description, failing which the process exits.
+ *
+ * dlhist_bucket() returns the bucket counting a duration and
+ * dlhist_bucket_ns() the least duration a bucket counts.
+ */
+#define DLHIST_SUB_BUCKET_BITS 4
+#define DLHIST_SUB_BUCKETS     (1 << DLHIST_SUB_BUCKET_BITS)
+#define DLHIST_MAX_BITS        40
+#define DLHIST_BUCKETS         ((DLHIST_MAX_BITS - DLHIST_SUB_BUCKET_BITS + 1) * DLHIST_SUB_BUCKETS)
+
+struct dlhist {
+	atomic_ullong count;
+	atomic_ullong sum_ns;
+	atomic_ullong min_ns;
+	atomic_ullong max_ns;
+	atomic_ullong buckets[DLHIST_BUCKETS];
+};
+
+void dlhist_record(int worker, unsigned long desc, unsigned long long ns);
+
+static inline unsigned
+dlhist_bucket(unsigned long long ns)
+{
+	if (ns < DLHIST_SUB_BUCKETS)
+		return (unsigned)ns;
+	if (ns >> DLHIST_MAX_BITS)
+		return DLHIST_BUCKETS - 1;
+	unsigned msb = 0;
+#ifdef __GNUC__
+	msb = 63u - (unsigned)__builtin_clzll(ns);
+#else
+	for (unsigned long long v = ns; v >>= 1; )
+		++ msb;
+#endif
+	unsigned shift = msb - DLHIST_SUB_BUCKET_BITS;
+	unsigned sub = (unsigned)(ns >> shift) & (DLHIST_SUB_BUCKETS - 1);
+	return (shift + 1) * DLHIST_SUB_BUCKETS + sub;
+}
+
+static inline unsigned long long
+dlhist_bucket_ns(unsigned bucket)
+{
+	if (bucket < DLHIST_SUB_BUCKETS)
+		return bucket;
+	unsigned shift = bucket / DLHIST_SUB_BUCKETS - 1;
+	unsigned long long sub = bucket % DLHIST_SUB_BUCKETS;
+	return (DLHIST_SUB_BUCKETS + sub) << shift;
+}
+
+#endif /* DEADLOCK_HISTOGRAM_H_ */
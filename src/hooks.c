@@ -0,0 +1,24 @@
+#include "hooks.h"
+#include <errno.h>
+
+#ifdef DEADLOCK_HOOKS
+
+_Atomic(const struct dlhooks *) dl_hooks = NULL;
+
+int
+dlhooks_register(const struct dlhooks *hooks)
+{
+	atomic_store_explicit(&dl_hooks, hooks, memory_order_release);
+	return 0;
+}
+
+#else
+
+int
+dlhooks_register(const struct dlhooks *hooks)
+{
+	(void)hooks;
+	return errno = ENOTSUP;
+}
+
+#endif
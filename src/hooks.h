@@ -0,0 +1,28 @@
+#ifndef DEADLOCK_HOOKS_PRIVATE_H_
+#define DEADLOCK_HOOKS_PRIVATE_H_
+
+#include "deadlock/hooks.h"
+#include <stdatomic.h>
+
+/*
+ * dl_hooks points to the registered hooks, or is NULL. dlhooks() loads it
+ * before each event. When compiled without DEADLOCK_HOOKS dlhooks() is
+ * always NULL, so every test of it and every hook call compile away.
+ */
+#ifdef DEADLOCK_HOOKS
+extern _Atomic(const struct dlhooks *) dl_hooks;
+
+static inline const struct dlhooks *
+dlhooks(void)
+{
+	return atomic_load_explicit(&dl_hooks, memory_order_acquire);
+}
+#else
+static inline const struct dlhooks *
+dlhooks(void)
+{
+	return NULL;
+}
+#endif
+
+#endif /* DEADLOCK_HOOKS_PRIVATE_H_ */
@@ -0,0 +1,24 @@
+#ifndef DEADLOCK_JSON_H_
+#define DEADLOCK_JSON_H_
+
+#include <stdio.h>
+
+/*
+ * dljson_puts() writes s as the contents of a JSON string, escaping quotes,
+ * backslashes, e.g. of Windows paths, and control characters.
+ */
+static inline void
+dljson_puts(FILE *f, const char *s)
+{
+	for (; *s; ++ s) {
+		unsigned char c = (unsigned char)*s;
+		if (c == '"' || c == '\\')
+			fprintf(f, "\\%c", c);
+		else if (c < 0x20)
+			fprintf(f, "\\u%04x", c);
+		else
+			fputc(c, f);
+	}
+}
+
+#endif /* DEADLOCK_JSON_H_ */
@@ -0,0 +1,124 @@
+#include "sched.h"
+#include "metrics.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+/*
+ * The name published to, or empty to publish nothing. Until
+ * dlmetrics_publish() is called dlmetrics_named is zero and the
+ * DEADLOCK_METRICS environment variable is read instead. lock is held
+ * while either is read or written.
+ */
+static char              dlmetrics_name[DLMETRICS_NAME_MAX + 1];
+static int               dlmetrics_named = 0;
+static struct dlspinlock dlmetrics_lock = DLSPINLOCK_INIT;
+
+int
+dlmetrics_publish(const char *name)
+{
+	size_t length = name ? strlen(name) : 0;
+	if (length > DLMETRICS_NAME_MAX)
+		return errno = ENAMETOOLONG;
+
+	dlspinlock_lock(&dlmetrics_lock);
+	memcpy(dlmetrics_name, name ? name : "", length);
+	dlmetrics_name[length] = '\0';
+	dlmetrics_named = 1;
+	dlspinlock_unlock(&dlmetrics_lock);
+	return 0;
+}
+
+void
+dlmetrics_attach(struct dlsched *s)
+{
+	s->metrics = NULL;
+
+	dlspinlock_lock(&dlmetrics_lock);
+	if (!dlmetrics_named) {
+		const char *env = getenv("DEADLOCK_METRICS");
+		if (env && strlen(env) <= DLMETRICS_NAME_MAX)
+			strcpy(dlmetrics_name, env);
+		dlmetrics_named = 1;
+	}
+	strcpy(s->metrics_name, dlmetrics_name);
+	dlspinlock_unlock(&dlmetrics_lock);
+	if (!s->metrics_name[0])
+		return;
+
+	/*
+	 * Replace rather than truncate any object of this name, since a
+	 * process still mapping it would fault once it shrinks.
+	 */
+	size_t size = sizeof(struct dlmetrics_header) +
+	              sizeof(struct dlmetrics_worker) * (size_t)s->nworkers;
+	shm_unlink(s->metrics_name);
+	int fd = shm_open(s->metrics_name, O_CREAT | O_EXCL | O_RDWR, 0644);
+	if (fd < 0) {
+		perror("dlmetrics_attach failed to create shared memory");
+		return;
+	}
+	void *m = MAP_FAILED;
+	if (ftruncate(fd, (off_t)size) == 0)
+		m = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (m == MAP_FAILED) {
+		perror("dlmetrics_attach failed to map shared memory");
+		close(fd);
+		shm_unlink(s->metrics_name);
+		return;
+	}
+	close(fd);
+
+	/* The object is zero filled, so every worker starts idle */
+	struct dlmetrics_header *h = m;
+	h->version     = DLMETRICS_VERSION;
+	h->worker_size = sizeof(struct dlmetrics_worker);
+	h->pid         = (uint64_t)getpid();
+	h->nworkers    = (uint32_t)s->nworkers;
+	h->running     = 1;
+	/* Readers trust nothing until they see magic */
+	atomic_thread_fence(memory_order_release);
+	dlmetrics_store(&h->magic, DLMETRICS_MAGIC);
+	s->metrics = h;
+}
+
+void
+dlmetrics_detach(struct dlsched *s)
+{
+	if (!s->metrics)
+		return;
+	*(volatile uint32_t *)&s->metrics->running = 0;
+	munmap(s->metrics, sizeof(struct dlmetrics_header) +
+	                   sizeof(struct dlmetrics_worker) * (size_t)s->nworkers);
+	shm_unlink(s->metrics_name);
+	s->metrics = NULL;
+}
+
+#else
+
+int
+dlmetrics_publish(const char *name)
+{
+	(void)name;
+	return errno = ENOTSUP;
+}
+
+void
+dlmetrics_attach(struct dlsched *s)
+{
+	s->metrics = NULL;
+}
+
+void
+dlmetrics_detach(struct dlsched *s)
+{
+	(void)s;
+}
+
+#endif
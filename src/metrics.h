@@ -0,0 +1,42 @@
+#ifndef DEADLOCK_METRICS_PRIVATE_H_
+#define DEADLOCK_METRICS_PRIVATE_H_
+
+#include "deadlock/metrics.h"
+#include <stddef.h>
+
+/*
+ * dlmetrics_attach() creates the shared memory object a starting scheduler
+ * publishes to, see deadlock/metrics.h, maps it into s->metrics and marks
+ * it running. It must be called before any worker is initialized. If
+ * nothing is published, or the object cannot be created, s->metrics is
+ * NULL. It cannot fail.
+ *
+ * dlmetrics_detach() marks the scheduler exited, unmaps and unlinks its
+ * object once every worker has exited.
+ *
+ * dlmetrics_worker() returns the metrics worker index writes, or NULL if s
+ * publishes nothing.
+ *
+ * dlmetrics_store() stores a member with a single plain store the compiler
+ * may neither tear nor elide. Workers own their members and readers are
+ * other processes, so no ordering is needed.
+ */
+struct dlsched;
+
+void dlmetrics_attach(struct dlsched *);
+void dlmetrics_detach(struct dlsched *);
+
+static inline struct dlmetrics_worker *
+dlmetrics_worker(struct dlmetrics_header *metrics, int index)
+{
+	if (!metrics) return NULL;
+	return (struct dlmetrics_worker *)(metrics + 1) + index;
+}
+
+static inline void
+dlmetrics_store(uint64_t *member, uint64_t value)
+{
+	*(volatile uint64_t *)member = value;
+}
+
+#endif /* DEADLOCK_METRICS_PRIVATE_H_ */
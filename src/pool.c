@@ -0,0 +1,45 @@
+#include "pool.h"
+
+#include <stdlib.h>
+
+void
+dlpool_init(struct dlpool *p)
+{
+	p->head = NULL;
+	p->count = 0;
+}
+
+void
+dlpool_destroy(struct dlpool *p)
+{
+	while (p->head) {
+		void *block = p->head;
+		p->head = *(void **)block;
+		free(block);
+	}
+	p->count = 0;
+}
+
+void *
+dlpool_alloc(struct dlpool *p, size_t size)
+{
+	if (p && p->head) {
+		void *block = p->head;
+		p->head = *(void **)block;
+		-- p->count;
+		return block;
+	}
+	return malloc(size < sizeof(void *) ? sizeof(void *) : size);
+}
+
+void
+dlpool_free(struct dlpool *p, void *block)
+{
+	if (!p || p->count >= DLPOOL_MAX) {
+		free(block);
+		return;
+	}
+	*(void **)block = p->head;
+	p->head = block;
+	++ p->count;
+}
@@ -0,0 +1,36 @@
+#ifndef DEADLOCK_POOL_H_
+#define DEADLOCK_POOL_H_
+
+#include <stddef.h>
+
+/*
+ * A dlpool is a worker's free list of fixed size blocks, so that small
+ * runtime objects such as futures need not touch the global heap once a
+ * worker is warm. Blocks are individually allocated by malloc() and may be
+ * freed to a different worker's pool than allocated them, or with free()
+ * once the scheduler is gone.
+ *
+ * dlpool_init() initializes an empty pool.
+ *
+ * dlpool_destroy() frees every block in a pool.
+ *
+ * dlpool_alloc() pops a block from pool, which may be NULL, otherwise
+ * allocates a block of size bytes. NULL is returned if insufficient memory
+ * exists to allocate a block.
+ *
+ * dlpool_free() pushes block onto pool unless pool is NULL or already holds
+ * DLPOOL_MAX blocks, in which case the block is freed.
+ */
+#define DLPOOL_MAX 1024
+
+struct dlpool {
+	void    *head;
+	unsigned count;
+};
+
+void  dlpool_init   (struct dlpool *);
+void  dlpool_destroy(struct dlpool *);
+void *dlpool_alloc  (struct dlpool *, size_t size);
+void  dlpool_free   (struct dlpool *, void *block);
+
+#endif /* DEADLOCK_POOL_H_ */
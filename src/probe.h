@@ -0,0 +1,35 @@
+#ifndef DEADLOCK_PROBE_H_
+#define DEADLOCK_PROBE_H_
+
+/*
+ * When compiled with DEADLOCK_PROBES, which is set when sys/sdt.h from
+ * SystemTap is found, the scheduler defines USDT probes of the provider
+ * deadlock which perf, bpftrace and SystemTap may attach to, e.g.
+ * 	bpftrace -e 'usdt:./app:deadlock:task__end { @[arg0] = count(); }'
+ * A probe compiles to a single nop and a note describing where its
+ * arguments live, so an unattached probe costs nothing but the nop.
+ * Otherwise probes compile to nothing. Probes and their arguments:
+ *
+ * task__begin(worker, task, fn), a worker is about to invoke task's
+ * function fn, or resume its fiber;
+ * task__end(worker, task, cancelled), task's function returned, its fiber
+ * suspended, or it was skipped because it was cancelled. task may already
+ * have been freed;
+ * steal(thief, victim, task), thief stole task from victim's queue;
+ * steal__fail(thief), thief found every other worker's queue empty;
+ * park(worker), a worker found no work and is about to block;
+ * unpark(worker), a parked worker was woken.
+ *
+ * Arguments which are never read when probes compile to nothing are still
+ * evaluated, so they should have no side effects.
+ */
+#ifdef DEADLOCK_PROBES
+#include <sys/sdt.h>
+#define DLPROBE1(name, a)       DTRACE_PROBE1(deadlock, name, a)
+#define DLPROBE3(name, a, b, c) DTRACE_PROBE3(deadlock, name, a, b, c)
+#else
+#define DLPROBE1(name, a)       ((void)(a))
+#define DLPROBE3(name, a, b, c) ((void)(a), (void)(b), (void)(c))
+#endif
+
+#endif /* DEADLOCK_PROBE_H_ */
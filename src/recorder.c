@@ -0,0 +1,254 @@
+#include "sched.h"
+#include "recorder.h"
+
+#ifdef DEADLOCK_FLIGHT_RECORDER
+
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <fcntl.h>    /* _O_* */
+#include <io.h>       /* _open, _write, _close */
+#include <sys/stat.h> /* _S_* */
+#define dlrecorder_open_(path) _open((path), _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE)
+#define dlrecorder_write_(fd, buf, n) _write((fd), (buf), (unsigned)(n))
+#define dlrecorder_close_(fd) _close(fd)
+#else
+#include <fcntl.h>  /* open */
+#include <unistd.h> /* write, close */
+#define dlrecorder_open_(path) open((path), O_WRONLY | O_CREAT | O_TRUNC, 0644)
+#define dlrecorder_write_(fd, buf, n) write((fd), (buf), (n))
+#define dlrecorder_close_(fd) close(fd)
+#endif
+
+/*
+ * The scheduler whose rings are dumped, the number of dumps reading it, and
+ * the path dumped to by signal handlers, which may not allocate. A lock
+ * would deadlock a signal handler interrupting its holder, so detaching
+ * instead waits for dumps to finish.
+ */
+static _Atomic(struct dlsched *) dlrecorder_sched = NULL;
+static atomic_int                dlrecorder_dumps = 0;
+static char dlrecorder_path[4096];
+
+/*
+ * Dumps may run inside signal handlers, so rather than stdio a dlrecorder_out
+ * buffers text on the stack and writes it with write(). error holds the first
+ * errno encountered.
+ */
+struct dlrecorder_out {
+	int    fd;
+	int    error;
+	size_t count;
+	char   buffer[4096];
+};
+
+/*
+ * dlrecorder_flush() writes out buffered text.
+ *
+ * dlrecorder_puts() appends a string and dlrecorder_putu() an unsigned
+ * integer in base 10 or 16.
+ *
+ * dlrecorder_write() writes every ring of the attached scheduler to fd,
+ * counted in dlrecorder_dumps so the scheduler is not destroyed meanwhile.
+ * Zero is returned on success, otherwise ENODATA if no scheduler is
+ * attached, or the errno of a failed write.
+ *
+ * dlrecorder_dump_path() opens path and writes every ring to it.
+ *
+ * dlrecorder_signal() is the handler installed by dlrecorder_install().
+ */
+static void dlrecorder_flush(struct dlrecorder_out *);
+static void dlrecorder_puts(struct dlrecorder_out *, const char *);
+static void dlrecorder_putu(struct dlrecorder_out *, unsigned long long, unsigned base);
+static int  dlrecorder_write(int fd);
+static int  dlrecorder_dump_path(const char *path);
+static void dlrecorder_signal(int signo);
+
+int
+dlrecorder_init(struct dlrecorder *r)
+{
+	r->events = calloc(DLRECORDER_EVENTS, sizeof(*r->events));
+	if (!r->events) return ENOMEM;
+	atomic_init(&r->head, 0);
+	return 0;
+}
+
+void
+dlrecorder_destroy(struct dlrecorder *r)
+{
+	free(r->events);
+	r->events = NULL;
+}
+
+void
+dlrecorder_attach(struct dlsched *s)
+{
+	atomic_store(&dlrecorder_sched, s);
+}
+
+void
+dlrecorder_detach(struct dlsched *s)
+{
+	atomic_compare_exchange_strong(&dlrecorder_sched, &s, NULL);
+	/* Any dump counted now may have loaded s before it was cleared */
+	while (atomic_load(&dlrecorder_dumps))
+		dlthread_yield();
+}
+
+int
+dlrecorder_dump(const char *path)
+{
+	int result = dlrecorder_dump_path(path);
+	if (result) errno = result;
+	return result;
+}
+
+int
+dlrecorder_install(const char *path, int signo)
+{
+	if (strlen(path) >= sizeof dlrecorder_path)
+		return errno = EINVAL;
+	strcpy(dlrecorder_path, path);
+
+#ifdef _WIN32
+	if (signal(SIGABRT, dlrecorder_signal) == SIG_ERR ||
+	    (signo && signal(signo, dlrecorder_signal) == SIG_ERR))
+	{
+		return errno = EINVAL;
+	}
+#else
+	struct sigaction sa;
+	memset(&sa, 0, sizeof sa);
+	sa.sa_handler = dlrecorder_signal;
+	sigemptyset(&sa.sa_mask);
+	sa.sa_flags = SA_RESTART;
+	if (sigaction(SIGABRT, &sa, NULL) ||
+	    (signo && sigaction(signo, &sa, NULL)))
+	{
+		return errno;
+	}
+#endif
+	return 0;
+}
+
+static void
+dlrecorder_signal(int signo)
+{
+	int saved = errno;
+	dlrecorder_dump_path(dlrecorder_path);
+	if (signo == SIGABRT) {
+		signal(SIGABRT, SIG_DFL);
+		raise(SIGABRT);
+	}
+	errno = saved;
+}
+
+static int
+dlrecorder_dump_path(const char *path)
+{
+	int fd = dlrecorder_open_(path);
+	if (fd < 0)
+		return errno;
+	int result = dlrecorder_write(fd);
+	if (dlrecorder_close_(fd) && !result)
+		result = errno;
+	return result;
+}
+
+static int
+dlrecorder_write(int fd)
+{
+	static const char *const names[] = {
+		[DLRECORDER_BEGIN] = "begin",
+		[DLRECORDER_END]   = "end",
+		[DLRECORDER_STEAL] = "steal",
+		[DLRECORDER_STALL] = "stall",
+		[DLRECORDER_WAKE]  = "wake"
+	};
+
+	atomic_fetch_add(&dlrecorder_dumps, 1);
+	struct dlsched *s = atomic_load(&dlrecorder_sched);
+	if (!s) {
+		atomic_fetch_sub(&dlrecorder_dumps, 1);
+		return ENODATA;
+	}
+
+	struct dlrecorder_out out;
+	out.fd = fd;
+	out.error = 0;
+	out.count = 0;
+	for (int w = 0; w < s->nworkers; ++ w) {
+		struct dlrecorder *r = &s->workers[w].recorder;
+		if (!r->events)
+			continue;
+		unsigned long head = atomic_load_explicit(&r->head,
+		                                          memory_order_acquire);
+		unsigned long i = head > DLRECORDER_EVENTS ? head - DLRECORDER_EVENTS : 0;
+		for (; i < head; ++ i) {
+			struct dlrecorder_event e = r->events[i & (DLRECORDER_EVENTS - 1)];
+			if (e.type >= sizeof names / sizeof *names)
+				continue;
+			dlrecorder_putu(&out, (unsigned)w, 10);
+			dlrecorder_puts(&out, " ");
+			dlrecorder_putu(&out, dlclock_ns(e.ts), 10);
+			dlrecorder_puts(&out, " ");
+			dlrecorder_puts(&out, names[e.type]);
+			dlrecorder_puts(&out, " ");
+			if (e.type == DLRECORDER_BEGIN || e.type == DLRECORDER_END) {
+				dlrecorder_puts(&out, "0x");
+				dlrecorder_putu(&out, e.arg, 16);
+			} else {
+				dlrecorder_putu(&out, e.arg, 10);
+			}
+			dlrecorder_puts(&out, "\n");
+		}
+	}
+	dlrecorder_flush(&out);
+	atomic_fetch_sub(&dlrecorder_dumps, 1);
+	return out.error;
+}
+
+static void
+dlrecorder_flush(struct dlrecorder_out *out)
+{
+	size_t written = 0;
+	while (!out->error && written < out->count) {
+		long n = (long)dlrecorder_write_(out->fd, out->buffer + written,
+		                                 out->count - written);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			out->error = n < 0 ? errno : EIO;
+		else
+			written += (size_t)n;
+	}
+	out->count = 0;
+}
+
+static void
+dlrecorder_puts(struct dlrecorder_out *out, const char *s)
+{
+	while (*s) {
+		if (out->count == sizeof out->buffer)
+			dlrecorder_flush(out);
+		out->buffer[out->count ++] = *s ++;
+	}
+}
+
+static void
+dlrecorder_putu(struct dlrecorder_out *out, unsigned long long v, unsigned base)
+{
+	char digits[24];
+	size_t n = sizeof digits;
+	digits[-- n] = '\0';
+	do {
+		digits[-- n] = "0123456789abcdef"[v % base];
+		v /= base;
+	} while (v);
+	dlrecorder_puts(out, digits + n);
+}
+
+#endif /* DEADLOCK_FLIGHT_RECORDER */
@@ -0,0 +1,70 @@
+#ifndef DEADLOCK_RECORDER_PRIVATE_H_
+#define DEADLOCK_RECORDER_PRIVATE_H_
+
+#include "deadlock/recorder.h"
+
+#ifdef DEADLOCK_FLIGHT_RECORDER
+
+#include "clock.h"
+#include <stdatomic.h>
+#include <stdint.h>
+
+/*
+ * Each worker owns a dlrecorder ring of DLRECORDER_EVENTS events, a power
+ * of two which may be overridden at compile time. head counts every event
+ * ever recorded; only its owning worker writes the ring.
+ *
+ * dlrecorder_init() allocates a ring. Zero is returned on success,
+ * otherwise ENOMEM.
+ *
+ * dlrecorder_destroy() frees a ring.
+ *
+ * dlrecorder_attach() makes a scheduler's rings the ones dumped, and
+ * dlrecorder_detach() forgets them before they are destroyed, waiting for
+ * any dump in progress.
+ *
+ * dlrecorder_record() appends an event, overwriting the oldest. Its time is
+ * kept in clock ticks and converted to nanoseconds only when dumped.
+ */
+#ifndef DLRECORDER_EVENTS
+#define DLRECORDER_EVENTS 4096
+#endif
+
+#define DLRECORDER_BEGIN 0
+#define DLRECORDER_END   1
+#define DLRECORDER_STEAL 2
+#define DLRECORDER_STALL 3
+#define DLRECORDER_WAKE  4
+
+struct dlrecorder_event {
+	unsigned long long ts;
+	uintptr_t          arg;
+	unsigned           type;
+};
+
+struct dlrecorder {
+	struct dlrecorder_event *events;
+	atomic_ulong             head;
+};
+
+struct dlsched;
+
+int  dlrecorder_init   (struct dlrecorder *);
+void dlrecorder_destroy(struct dlrecorder *);
+void dlrecorder_attach (struct dlsched *);
+void dlrecorder_detach (struct dlsched *);
+
+static inline void
+dlrecorder_record(struct dlrecorder *r, unsigned type, uintptr_t arg)
+{
+	unsigned long h = atomic_load_explicit(&r->head, memory_order_relaxed);
+	struct dlrecorder_event *e = r->events + (h & (DLRECORDER_EVENTS - 1));
+	e->ts = dlclock_ticks();
+	e->arg = arg;
+	e->type = type;
+	atomic_store_explicit(&r->head, h + 1, memory_order_release);
+}
+
+#endif
+
+#endif /* DEADLOCK_RECORDER_PRIVATE_H_ */
@@ -1,4 +1,6 @@
 #include "sched.h"
+#include "clock.h"
+#include "probe.h"
 #include <assert.h>
 #include <errno.h>
 #include <stdint.h>
@@ -25,6 +27,14 @@ dlsched_destroy(struct dlsched *s)
 	assert(atomic_load_explicit(&s->wbarrier, memory_order_relaxed)
 	         == s->nworkers);
 
+	dlstats_detach(s);
+#ifdef DEADLOCK_FLIGHT_RECORDER
+	dlrecorder_detach(s);
+#endif
+	dlmetrics_detach(s);
+#ifdef DEADLOCK_WATCHDOG
+	dlwatchdog_detach(s);
+#endif
 	for (int w = 0; w < s->nworkers; ++ w) {
 		dlworker_destroy(s->workers + w);
 	}
@@ -41,19 +51,37 @@ dlsched_init(struct dlsched *s,
              int nworkers,
              dltask *task,
              dlwentryfn entryfn,
-             dlwexitfn exitfn)
+             dlwexitfn exitfn,
+             int quiesce)
 {
 	if (task == NULL) return errno = EINVAL;
+#ifdef DEADLOCK_GRAPH_EXPORT
+	/* Worker index + 1 must fit in the top bits of task IDs */
+	if (nworkers >= DLTASK_ID_WORKERS) return errno = EINVAL;
+#endif
 
 	int result = 0;
 
+#if defined(DEADLOCK_GRAPH_EXPORT) || defined(DEADLOCK_FLIGHT_RECORDER) || \
+    defined(DEADLOCK_WATCHDOG)
+	dlclock_init();
+#endif
+
 	atomic_init(&s->terminate, 0);
 	atomic_init(&s->wbarrier, nworkers);
+	atomic_init(&s->nidle, 0);
 	s->nworkers  = nworkers;
+	s->quiesce   = quiesce;
 
 	result = dlwait_init(&s->stall);
 	if (result) goto stall_init_failed;
 
+	/* Workers find their metrics and watchdog as they are initialized */
+	dlmetrics_attach(s);
+#ifdef DEADLOCK_WATCHDOG
+	dlwatchdog_attach(s);
+#endif
+
 	int w = 0;
 	for (; w < nworkers; ++ w) {
 		result = dlworker_init(s->workers + w, s, !w ? task : NULL,
@@ -61,6 +89,13 @@ dlsched_init(struct dlsched *s,
 		if (result) goto dlworker_init_failed;
 	}
 
+	dlstats_attach(s);
+#ifdef DEADLOCK_FLIGHT_RECORDER
+	dlrecorder_attach(s);
+#endif
+#ifdef DEADLOCK_WATCHDOG
+	dlwatchdog_start(s);
+#endif
 	return result;
 
 dlworker_init_failed: ;
@@ -70,6 +105,10 @@ dlworker_init_failed: ;
 		dlworker_join(s->workers + (unwind-1));
 		dlworker_destroy(s->workers + (unwind-1));
 	}
+	dlmetrics_detach(s);
+#ifdef DEADLOCK_WATCHDOG
+	dlwatchdog_detach(s);
+#endif
 	if ((errno = dlwait_destroy(&s->stall))) {
 		perror("dlsched_init::dlworker_init_failed freeing stall");
 		exit(errno);
@@ -92,8 +131,9 @@ dlsched_join(struct dlsched *s)
  * testing required...
  */
 int
-dlsched_steal(struct dlsched *s, dltask **dst, int src)
+dlsched_steal(struct dlsched *s, dltask **dst, int src, int *victim_index)
 {
+	struct dlstats_victim_counters *stats = s->workers[src].stats.victims;
 	int tgt = 0;
 	for (int n = 0; n < s->nworkers; ++ n) {
 		if (tgt == src) {
@@ -101,34 +141,60 @@ dlsched_steal(struct dlsched *s, dltask **dst, int src)
 			continue;
 		}
 		struct dlworker *victim = s->workers + tgt;
+		dlstats_add(&stats[tgt].steal_attempts, 1);
 		steal: ;
 		int rc = dltqueue_steal(&victim->tqueue, dst);
 		if (rc == EAGAIN) {
+			dlstats_add(&stats[tgt].steal_retries, 1);
 			_mm_pause();
 			goto steal;
 		}
 		switch (rc) {
 			case ENODATA: ++ tgt; break;
-			case 0: return 0;
+			case 0:
+				dlstats_add(&stats[tgt].steals, 1);
+				DLPROBE3(steal, src, tgt, *dst);
+				*victim_index = tgt;
+				return 0;
 		}
 	}
+	DLPROBE1(steal__fail, src);
 	return ENODATA;
 }
 
+int
+dlsched_idle(struct dlsched *s)
+{
+	if (!s->quiesce)
+		return 0;
+
+	int idle = atomic_fetch_add(&s->nidle, 1) + 1;
+	if (idle < s->nworkers)
+		return 0;
+
+	for (int w = 0; w < s->nworkers; ++ w) {
+		if (!dltqueue_empty(&s->workers[w].tqueue)) {
+			atomic_fetch_sub(&s->nidle, 1);
+			return 1;
+		}
+	}
+	dlsched_terminate(s);
+	return 1;
+}
+
+void
+dlsched_wake(struct dlsched *s)
+{
+	if (s->quiesce)
+		atomic_fetch_sub(&s->nidle, 1);
+}
+
 void
 dlsched_terminate(struct dlsched *s)
 {
-	atomic_store(&s->wbarrier, 0);
 	atomic_store(&s->terminate, 1);
-
-	int exited;
-	do {
-		if ((errno = dlwait_broadcast(&s->stall))) {
-			perror("dlsched_terminate failed to broadcast on stall");
-			exit(errno);
-		}
-		exited = atomic_load(&s->wbarrier);
-		/* if this is a worker thread consider it exited */
-		if (dl_this_worker) ++ exited;
-	} while (exited < s->nworkers);
+	if ((errno = dlwait_release(&s->stall))) {
+		perror("dlsched_terminate failed to release stall");
+		exit(errno);
+	}
 }
@@ -3,6 +3,8 @@
 
 #include "thread.h"
 #include "worker.h"
+#include "metrics.h"
+#include "watchdog.h"
 #include <stdatomic.h>
 
 /*
@@ -23,36 +25,59 @@
  * dlsched_destroy() must be called to destroy an initialized scheduler.
  *
  * dlsched_init() initializes a scheduler. A task is required to prime the
- * scheduler with work since there is no global work queue. Zero is returned
- * on success, otherwise the scheduler is uninitialized and errno is set and
- * returned.
+ * scheduler with work since there is no global work queue. If quiesce is
+ * nonzero the scheduler terminates itself once it is quiescent, see
+ * dlsched_idle(). Zero is returned on success, otherwise the scheduler is
+ * uninitialized and errno is set and returned.
  *
  * dlsched_join() blocks the calling thread until the scheduler is terminated.
  *
  * dlsched_steal() attempts to steal a task from all workers other than src
- * (the calling worker's index), starting with tgt. Zero is returned on
- * success otherwise ENODATA is returned if there are no available tasks.
+ * (the calling worker's index). Zero is returned on success and the index
+ * of the worker stolen from is stored in victim, otherwise ENODATA is
+ * returned if there are no available tasks. Attempts are counted in src's
+ * steal counters, see deadlock/stats.h.
  *
- * dlsched_terminate() signals a scheduler to terminate. All workers should
- * enter a joinable state. Calling sched_terminate before all workers are
- * initialized and in a running state is undefined and the application will
- * probably hang.
+ * dlsched_idle() is called by a worker which found no task to execute
+ * before it stalls. Zero is returned if the worker should stall and call
+ * dlsched_wake() once it is woken. Otherwise nonzero is returned and the
+ * worker should look for work again, or exit if the scheduler terminated.
+ * When running until quiescent, the last worker to go idle checks every
+ * queue and terminates the scheduler if they are all empty: with every
+ * worker idle no task is executing, so nothing can ever be queued again.
+ *
+ * metrics is the shared memory the scheduler publishes to, named
+ * metrics_name, or NULL, see deadlock/metrics.h. watchdog is the watchdog
+ * it runs, or NULL, see deadlock/watchdog.h.
+ *
+ * dlsched_terminate() signals a scheduler to terminate and releases every
+ * stalled worker exactly once; it does not wait for workers to exit, which
+ * dlsched_join() does. All workers should enter a joinable state.
  */
 
 struct dlsched {
-	struct dlwait   stall;
-	atomic_int      terminate;
-	atomic_int      wbarrier;
-	int             nworkers;
-	struct dlworker workers[];
+	struct dlwait             stall;
+	atomic_int                terminate;
+	atomic_int                wbarrier;
+	atomic_int                nidle;
+	int                       nworkers;
+	int                       quiesce;
+	struct dlmetrics_header  *metrics;
+	char                      metrics_name[DLMETRICS_NAME_MAX + 1];
+#ifdef DEADLOCK_WATCHDOG
+	struct dlwatchdog_thread *watchdog;
+#endif
+	struct dlworker           workers[];
 };
 
 void *dlsched_alloc    (int nworkers);
 void  dlsched_destroy  (struct dlsched *);
 int   dlsched_init     (struct dlsched *, int nworkers, dltask *,
-                        dlwentryfn, dlwexitfn);
+                        dlwentryfn, dlwexitfn, int quiesce);
 void  dlsched_join     (struct dlsched *);
-int   dlsched_steal    (struct dlsched *, dltask **, int src);
+int   dlsched_steal    (struct dlsched *, dltask **, int src, int *victim);
+int   dlsched_idle     (struct dlsched *);
+void  dlsched_wake     (struct dlsched *);
 void  dlsched_terminate(struct dlsched *);
 
 #endif /* DEADLOCK_SCHED_H_ */
@@ -0,0 +1,130 @@
+#include "sched.h"
+#include "stats.h"
+#include <errno.h>
+#include <stdlib.h>
+
+/*
+ * The scheduler whose counters are snapshot. lock is held while it is read
+ * so a scheduler cannot be destroyed under a snapshot.
+ */
+static struct dlsched    *dlstats_sched = NULL;
+static struct dlspinlock  dlstats_lock = DLSPINLOCK_INIT;
+
+int
+dlstats_init(struct dlstats_counters *c, int nworkers)
+{
+	atomic_init(&c->executed, 0);
+	atomic_init(&c->taken, 0);
+	atomic_init(&c->stalls, 0);
+	atomic_init(&c->wakes, 0);
+	atomic_init(&c->inline_executions, 0);
+	atomic_init(&c->parked_ns, 0);
+	c->victims = malloc(sizeof(*c->victims) * (size_t)(nworkers ? nworkers : 1));
+	if (!c->victims)
+		return ENOMEM;
+	for (int v = 0; v < nworkers; ++ v) {
+		atomic_init(&c->victims[v].steal_attempts, 0);
+		atomic_init(&c->victims[v].steals, 0);
+		atomic_init(&c->victims[v].steal_retries, 0);
+	}
+	return 0;
+}
+
+void
+dlstats_destroy(struct dlstats_counters *c)
+{
+	free(c->victims);
+	c->victims = NULL;
+}
+
+void
+dlstats_attach(struct dlsched *s)
+{
+	dlspinlock_lock(&dlstats_lock);
+	dlstats_sched = s;
+	dlspinlock_unlock(&dlstats_lock);
+}
+
+void
+dlstats_detach(struct dlsched *s)
+{
+	dlspinlock_lock(&dlstats_lock);
+	if (dlstats_sched == s)
+		dlstats_sched = NULL;
+	dlspinlock_unlock(&dlstats_lock);
+}
+
+static unsigned long long
+dlstats_load(atomic_ullong *c)
+{
+	return atomic_load_explicit(c, memory_order_relaxed);
+}
+
+int
+dlstats_snapshot(struct dlstats *stats)
+{
+	int result = 0;
+	dlspinlock_lock(&dlstats_lock);
+	struct dlsched *s = dlstats_sched;
+	if (!s) {
+		result = ENODATA;
+		goto release;
+	}
+
+	size_t nw = (size_t)s->nworkers;
+	*stats = (struct dlstats) {
+		.nworkers = s->nworkers,
+		.workers = calloc(nw ? nw : 1, sizeof(*stats->workers)),
+		.victims = calloc(nw ? nw * nw : 1, sizeof(*stats->victims))
+	};
+	if (!stats->workers || !stats->victims) {
+		dlstats_free(stats);
+		result = ENOMEM;
+		goto release;
+	}
+
+	struct dlstats_worker *total = &stats->total;
+	for (size_t w = 0; w < nw; ++ w) {
+		struct dlstats_counters *c = &s->workers[w].stats;
+		struct dlstats_worker *sw = stats->workers + w;
+		sw->executed          = dlstats_load(&c->executed);
+		sw->taken             = dlstats_load(&c->taken);
+		sw->stalls            = dlstats_load(&c->stalls);
+		sw->wakes             = dlstats_load(&c->wakes);
+		sw->inline_executions = dlstats_load(&c->inline_executions);
+		sw->parked_ns         = dlstats_load(&c->parked_ns);
+		for (size_t v = 0; v < nw; ++ v) {
+			struct dlstats_victim *sv = stats->victims + w * nw + v;
+			sv->steal_attempts = dlstats_load(&c->victims[v].steal_attempts);
+			sv->steals         = dlstats_load(&c->victims[v].steals);
+			sv->steal_retries  = dlstats_load(&c->victims[v].steal_retries);
+			sw->steal_attempts += sv->steal_attempts;
+			sw->steals         += sv->steals;
+			sw->steal_retries  += sv->steal_retries;
+		}
+
+		total->executed          += sw->executed;
+		total->taken             += sw->taken;
+		total->steal_attempts    += sw->steal_attempts;
+		total->steals            += sw->steals;
+		total->steal_retries     += sw->steal_retries;
+		total->stalls            += sw->stalls;
+		total->wakes             += sw->wakes;
+		total->inline_executions += sw->inline_executions;
+		total->parked_ns         += sw->parked_ns;
+	}
+
+release:
+	dlspinlock_unlock(&dlstats_lock);
+	if (result) errno = result;
+	return result;
+}
+
+void
+dlstats_free(struct dlstats *stats)
+{
+	free(stats->workers);
+	free(stats->victims);
+	stats->workers = NULL;
+	stats->victims = NULL;
+}
@@ -0,0 +1,55 @@
+#ifndef DEADLOCK_STATS_PRIVATE_H_
+#define DEADLOCK_STATS_PRIVATE_H_
+
+#include "deadlock/stats.h"
+#include <stdatomic.h>
+
+/*
+ * Each worker owns a dlstats_counters, which only it writes. Counters are
+ * atomics so snapshots may read them while they are written, but they are
+ * incremented with a relaxed load and store rather than a locked
+ * read-modify-write. victims holds the worker's steal counters for each
+ * victim.
+ *
+ * dlstats_init() allocates the victim counters of a scheduler of nworkers
+ * and zeroes every counter. Zero is returned on success, otherwise ENOMEM.
+ *
+ * dlstats_destroy() frees the victim counters.
+ *
+ * dlstats_attach() makes a scheduler's counters the ones snapshot, and
+ * dlstats_detach() forgets them before they are destroyed, waiting for any
+ * snapshot in progress.
+ *
+ * dlstats_add() adds n to a counter.
+ */
+struct dlstats_victim_counters {
+	atomic_ullong steal_attempts;
+	atomic_ullong steals;
+	atomic_ullong steal_retries;
+};
+
+struct dlstats_counters {
+	atomic_ullong executed;
+	atomic_ullong taken;
+	atomic_ullong stalls;
+	atomic_ullong wakes;
+	atomic_ullong inline_executions;
+	atomic_ullong parked_ns;
+	struct dlstats_victim_counters *victims;
+};
+
+struct dlsched;
+
+int  dlstats_init   (struct dlstats_counters *, int nworkers);
+void dlstats_destroy(struct dlstats_counters *);
+void dlstats_attach (struct dlsched *);
+void dlstats_detach (struct dlsched *);
+
+static inline void
+dlstats_add(atomic_ullong *c, unsigned long long n)
+{
+	atomic_store_explicit(c, atomic_load_explicit(c, memory_order_relaxed) + n,
+	                      memory_order_relaxed);
+}
+
+#endif /* DEADLOCK_STATS_PRIVATE_H_ */
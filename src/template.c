@@ -0,0 +1,277 @@
+#include "deadlock/template.h"
+
+#include "sched.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/*
+ * Each recorded task stores everything dlcreate() would have initialized,
+ * plus the wait count precomputed by dltemplate_finalize().
+ */
+struct dltemplate_node {
+	dltask  *task;
+	dltask  *next;
+	dltaskfn fn;
+	unsigned wait;
+};
+
+/*
+ * A task outside of the template and the number of recorded tasks which
+ * join to it.
+ */
+struct dltemplate_external {
+	dltask  *task;
+	unsigned count;
+};
+
+struct dltemplate_ {
+	struct dltemplate_node     *nodes;
+	struct dltemplate_external *externals;
+	dltask                    **roots;
+	size_t nodes_count;
+	size_t nodes_size;
+	size_t externals_count;
+	size_t roots_count;
+	int    finalized;
+};
+
+/*
+ * cmp_task_ptr() orders task pointers by address, via uintptr_t because
+ * comparing pointers to unrelated objects is undefined.
+ */
+static int cmp_task_ptr(const void *, const void *);
+
+/*
+ * find_node() returns the index of task in the sorted array of recorded
+ * task pointers, or SIZE_MAX if it was not recorded.
+ */
+static size_t find_node(dltask *const *sorted, size_t count, dltask *task);
+
+dltemplate *
+dltemplate_create(void)
+{
+	dltemplate *tpl = calloc(1, sizeof *tpl);
+	if (!tpl) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	return tpl;
+}
+
+void
+dltemplate_destroy(dltemplate *tpl)
+{
+	if (tpl) {
+		free(tpl->nodes);
+		free(tpl->externals);
+		free(tpl->roots);
+		free(tpl);
+	}
+}
+
+int
+dltemplate_add(dltemplate *tpl, dltask *task, dltaskfn fn, dltask *next)
+{
+	assert(tpl);
+	assert(task);
+	assert(fn);
+
+	if (tpl->finalized) return errno = EBUSY;
+
+	if (tpl->nodes_count == tpl->nodes_size) {
+		size_t size = tpl->nodes_size ? tpl->nodes_size * 2 : 64;
+		struct dltemplate_node *nodes;
+		nodes = realloc(tpl->nodes, size * sizeof *nodes);
+		if (!nodes) return errno = ENOMEM;
+		tpl->nodes = nodes;
+		tpl->nodes_size = size;
+	}
+	tpl->nodes[tpl->nodes_count ++] = (struct dltemplate_node) {
+		.task = task,
+		.next = next,
+		.fn = fn,
+		.wait = 0
+	};
+	return 0;
+}
+
+int
+dltemplate_finalize(dltemplate *tpl)
+{
+	assert(tpl);
+
+	if (tpl->finalized) return errno = EBUSY;
+
+	int result = 0;
+	size_t n = tpl->nodes_count;
+	dltask **sorted = malloc((n ? n : 1) * sizeof *sorted);
+	dltask **externals = malloc((n ? n : 1) * sizeof *externals);
+	if (!sorted || !externals) {
+		result = ENOMEM;
+		goto cleanup;
+	}
+
+	for (size_t i = 0; i < n; ++ i) {
+		sorted[i] = tpl->nodes[i].task;
+	}
+	qsort(sorted, n, sizeof *sorted, cmp_task_ptr);
+	for (size_t i = 1; i < n; ++ i) {
+		if (sorted[i] == sorted[i-1]) {
+			result = EINVAL;
+			goto cleanup;
+		}
+	}
+
+	/*
+	 * Count in-degrees of recorded tasks, indexed by sorted position, and
+	 * gather every external next pointer.
+	 */
+	unsigned *wait = calloc(n ? n : 1, sizeof *wait);
+	if (!wait) {
+		result = ENOMEM;
+		goto cleanup;
+	}
+	size_t nexternal = 0;
+	for (size_t i = 0; i < n; ++ i) {
+		dltask *next = tpl->nodes[i].next;
+		if (!next) continue;
+		size_t idx = find_node(sorted, n, next);
+		if (idx == SIZE_MAX) {
+			externals[nexternal ++] = next;
+		} else {
+			assert(wait[idx] < UINT_MAX);
+			++ wait[idx];
+		}
+	}
+	size_t *order = malloc((n ? n : 1) * sizeof *order);
+	if (!order) {
+		free(wait);
+		result = ENOMEM;
+		goto cleanup;
+	}
+	size_t nroots = 0;
+	for (size_t i = 0; i < n; ++ i) {
+		size_t idx = find_node(sorted, n, tpl->nodes[i].task);
+		order[idx] = i;
+		tpl->nodes[i].wait = wait[idx];
+		if (wait[idx] == 0) ++ nroots;
+	}
+
+	/*
+	 * Every recorded task has at most one next, so walking next from each
+	 * root and releasing each task once its last predecessor is walked
+	 * reaches every task unless some are on, or only reachable through, a
+	 * cycle, which would never be released.
+	 */
+	size_t nreached = nroots;
+	for (size_t i = 0; i < n; ++ i) {
+		if (tpl->nodes[i].wait) continue;
+		size_t idx = find_node(sorted, n, tpl->nodes[i].next);
+		while (idx != SIZE_MAX && -- wait[idx] == 0) {
+			++ nreached;
+			idx = find_node(sorted, n, tpl->nodes[order[idx]].next);
+		}
+	}
+	free(order);
+	free(wait);
+	if (nroots == 0 || nreached != n) {
+		result = EINVAL;
+		goto cleanup;
+	}
+
+	/* Collapse duplicate external tasks into a single count */
+	qsort(externals, nexternal, sizeof *externals, cmp_task_ptr);
+	size_t nunique = 0;
+	for (size_t i = 0; i < nexternal; ++ i) {
+		if (i == 0 || externals[i] != externals[i-1])
+			++ nunique;
+	}
+	tpl->externals = malloc((nunique ? nunique : 1) * sizeof *tpl->externals);
+	tpl->roots = malloc(nroots * sizeof *tpl->roots);
+	if (!tpl->externals || !tpl->roots) {
+		free(tpl->externals);
+		free(tpl->roots);
+		tpl->externals = NULL;
+		tpl->roots = NULL;
+		result = ENOMEM;
+		goto cleanup;
+	}
+	for (size_t i = 0, u = 0; i < nexternal; ++ i) {
+		if (i == 0 || externals[i] != externals[i-1]) {
+			tpl->externals[u ++] = (struct dltemplate_external) {
+				.task = externals[i],
+				.count = 0
+			};
+		}
+		++ tpl->externals[u-1].count;
+	}
+	tpl->externals_count = nunique;
+
+	for (size_t i = 0; i < n; ++ i) {
+		if (tpl->nodes[i].wait == 0)
+			tpl->roots[tpl->roots_count ++] = tpl->nodes[i].task;
+	}
+	tpl->finalized = 1;
+
+cleanup:
+	free(sorted);
+	free(externals);
+	return result ? (errno = result) : 0;
+}
+
+void
+dltemplate_replay(dltemplate *tpl)
+{
+	assert(dl_this_worker);
+	assert(tpl);
+	assert(tpl->finalized);
+
+	struct dlworker *w = dl_this_worker;
+
+	for (size_t i = 0; i < tpl->externals_count; ++ i) {
+		struct dltemplate_external *e = tpl->externals + i;
+		atomic_fetch_add(&e->task->wait_, e->count);
+	}
+
+	/* Published by the release fence in dltqueue_pushv */
+	for (size_t i = 0; i < tpl->nodes_count; ++ i) {
+		struct dltemplate_node *node = tpl->nodes + i;
+		dltask *t = node->task;
+		t->next_ = node->next;
+		t->cancel_ = w->cancel;
+		t->fn_ = node->fn;
+		atomic_store_explicit(&t->wait_, node->wait,
+		                      memory_order_relaxed);
+#ifdef DEADLOCK_FIBERS
+		t->fiber_ = NULL;
+#endif
+#ifdef DEADLOCK_GRAPH_EXPORT
+		t->graph_ = NULL;
+		t->tid_ = dltask_next_id();
+		if (node->wait == 0)
+			dlworker_add_edge_from_current(w, t);
+#endif
+	}
+
+	dlworker_asyncv(w, tpl->roots, tpl->roots_count);
+}
+
+static int
+cmp_task_ptr(const void *a, const void *b)
+{
+	uintptr_t x = (uintptr_t)*(dltask *const *)a;
+	uintptr_t y = (uintptr_t)*(dltask *const *)b;
+	return (x > y) - (x < y);
+}
+
+static size_t
+find_node(dltask *const *sorted, size_t count, dltask *task)
+{
+	dltask *const *found = bsearch(&task, sorted, count, sizeof *sorted,
+	                               cmp_task_ptr);
+	return found ? (size_t)(found - sorted) : SIZE_MAX;
+}
@@ -1,6 +1,9 @@
 #ifndef DEADLOCK_THREAD_H_
 #define DEADLOCK_THREAD_H_
 
+struct dlcond;
+struct dlmutex;
+struct dlspinlock;
 struct dlthread;
 struct dlwait;
 
@@ -11,10 +14,33 @@ static int  dlthread_create(struct dlthread *, dlthreadfn, void *, int);
 static int  dlthread_join(struct dlthread *);
 static void dlthread_yield(void);
 static int  dlwait_broadcast(struct dlwait *);
+static int  dlwait_release(struct dlwait *);
 static int  dlwait_wait(struct dlwait *);
 static int  dlwait_init(struct dlwait *);
 static int  dlwait_destroy(struct dlwait *);
 
+/*
+ * dlmutex and dlcond are a plain mutex and condition variable, for the few
+ * places outside the scheduler which need one, e.g. the graph writer.
+ */
+static int  dlmutex_init(struct dlmutex *);
+static int  dlmutex_destroy(struct dlmutex *);
+static int  dlmutex_lock(struct dlmutex *);
+static int  dlmutex_unlock(struct dlmutex *);
+static int  dlcond_init(struct dlcond *);
+static int  dlcond_destroy(struct dlcond *);
+static int  dlcond_wait(struct dlcond *, struct dlmutex *);
+static int  dlcond_broadcast(struct dlcond *);
+
+/*
+ * dlspinlock is a spin lock for short, rarely contended critical sections
+ * which cannot afford to initialize a dlmutex, e.g. static configuration
+ * and attaching schedulers. A statically allocated lock is initialized by
+ * DLSPINLOCK_INIT. Waiters yield rather than spin hot.
+ */
+static void dlspinlock_lock(struct dlspinlock *);
+static void dlspinlock_unlock(struct dlspinlock *);
+
 #if defined(_WIN32)
 
 #include <windows.h>
@@ -59,6 +85,15 @@ struct dlwait {
 	CONDITION_VARIABLE cv;
 	SRWLOCK srwlock;
 	int should_wait;
+	int released;
+};
+
+struct dlmutex {
+	SRWLOCK srwlock;
+};
+
+struct dlcond {
+	CONDITION_VARIABLE cv;
 };
 
 static inline DWORD
@@ -122,12 +157,23 @@ dlwait_broadcast(struct dlwait *wait)
 	return 0;
 }
 
+static inline int
+dlwait_release(struct dlwait *wait)
+{
+	/* Cannot fail */
+	AcquireSRWLockExclusive(&wait->srwlock);
+	wait->released = 1;
+	ReleaseSRWLockExclusive(&wait->srwlock);
+	WakeAllConditionVariable(&wait->cv);
+	return 0;
+}
+
 static inline int
 dlwait_wait(struct dlwait *wait)
 {
 	BOOL success = TRUE;
 	AcquireSRWLockShared(&wait->srwlock);
-	while (wait->should_wait && (success ||
+	while (wait->should_wait && !wait->released && (success ||
 	                             GetLastError() == ERROR_TIMEOUT))
 	{
 		success = SleepConditionVariableSRW(
@@ -151,6 +197,7 @@ dlwait_init(struct dlwait *wait)
 	InitializeSRWLock(&wait->srwlock);
 	InitializeConditionVariable(&wait->cv);
 	wait->should_wait = 1;
+	wait->released = 0;
 	return 0;
 }
 
@@ -162,6 +209,66 @@ dlwait_destroy(struct dlwait *wait)
 	return 0;
 }
 
+static inline int
+dlmutex_init(struct dlmutex *m)
+{
+	/* Cannot fail */
+	InitializeSRWLock(&m->srwlock);
+	return 0;
+}
+
+static inline int
+dlmutex_destroy(struct dlmutex *m)
+{
+	(void) m;
+	return 0;
+}
+
+static inline int
+dlmutex_lock(struct dlmutex *m)
+{
+	AcquireSRWLockExclusive(&m->srwlock);
+	return 0;
+}
+
+static inline int
+dlmutex_unlock(struct dlmutex *m)
+{
+	ReleaseSRWLockExclusive(&m->srwlock);
+	return 0;
+}
+
+static inline int
+dlcond_init(struct dlcond *c)
+{
+	/* Cannot fail */
+	InitializeConditionVariable(&c->cv);
+	return 0;
+}
+
+static inline int
+dlcond_destroy(struct dlcond *c)
+{
+	(void) c;
+	return 0;
+}
+
+static inline int
+dlcond_wait(struct dlcond *c, struct dlmutex *m)
+{
+	if (SleepConditionVariableSRW(&c->cv, &m->srwlock, INFINITE, 0))
+		return 0;
+	/* TODO: GetLastError does not return errno values */
+	return -1;
+}
+
+static inline int
+dlcond_broadcast(struct dlcond *c)
+{
+	WakeAllConditionVariable(&c->cv);
+	return 0;
+}
+
 #else
 
 #include <pthread.h>
@@ -177,6 +284,15 @@ struct dlwait {
 	pthread_cond_t cv;
 	pthread_mutex_t mtx;
 	int should_wait;
+	int released;
+};
+
+struct dlmutex {
+	pthread_mutex_t mtx;
+};
+
+struct dlcond {
+	pthread_cond_t cv;
 };
 
 static inline void *
@@ -233,6 +349,18 @@ dlwait_broadcast(struct dlwait *wait)
 	return pthread_cond_signal(&wait->cv);
 }
 
+static inline int
+dlwait_release(struct dlwait *wait)
+{
+	int pr;
+	if ((pr = pthread_mutex_lock(&wait->mtx)))
+		return pr;
+	wait->released = 1;
+	if ((pr = pthread_mutex_unlock(&wait->mtx)))
+		return pr;
+	return pthread_cond_broadcast(&wait->cv);
+}
+
 static inline int
 dlwait_wait(struct dlwait *wait)
 {
@@ -241,7 +369,7 @@ dlwait_wait(struct dlwait *wait)
 	if ((pr = pthread_mutex_lock(&wait->mtx)))
 		return pr;
 
-	while (wait->should_wait) {
+	while (wait->should_wait && !wait->released) {
 		if ((pr = pthread_cond_wait(&wait->cv, &wait->mtx)))
 			return pr;
 	}
@@ -262,6 +390,7 @@ dlwait_init(struct dlwait *wait)
 		return pr;
 	}
 	wait->should_wait = 1;
+	wait->released = 0;
 	return 0;
 }
 
@@ -277,6 +406,75 @@ dlwait_destroy(struct dlwait *wait)
 	return 0;
 }
 
+static inline int
+dlmutex_init(struct dlmutex *m)
+{
+	return pthread_mutex_init(&m->mtx, NULL);
+}
+
+static inline int
+dlmutex_destroy(struct dlmutex *m)
+{
+	return pthread_mutex_destroy(&m->mtx);
+}
+
+static inline int
+dlmutex_lock(struct dlmutex *m)
+{
+	return pthread_mutex_lock(&m->mtx);
+}
+
+static inline int
+dlmutex_unlock(struct dlmutex *m)
+{
+	return pthread_mutex_unlock(&m->mtx);
+}
+
+static inline int
+dlcond_init(struct dlcond *c)
+{
+	return pthread_cond_init(&c->cv, NULL);
+}
+
+static inline int
+dlcond_destroy(struct dlcond *c)
+{
+	return pthread_cond_destroy(&c->cv);
+}
+
+static inline int
+dlcond_wait(struct dlcond *c, struct dlmutex *m)
+{
+	return pthread_cond_wait(&c->cv, &m->mtx);
+}
+
+static inline int
+dlcond_broadcast(struct dlcond *c)
+{
+	return pthread_cond_broadcast(&c->cv);
+}
+
 #endif
 
+#include <stdatomic.h>
+
+struct dlspinlock {
+	atomic_flag flag;
+};
+
+#define DLSPINLOCK_INIT { ATOMIC_FLAG_INIT }
+
+static inline void
+dlspinlock_lock(struct dlspinlock *l)
+{
+	while (atomic_flag_test_and_set_explicit(&l->flag, memory_order_acquire))
+		dlthread_yield();
+}
+
+static inline void
+dlspinlock_unlock(struct dlspinlock *l)
+{
+	atomic_flag_clear_explicit(&l->flag, memory_order_release);
+}
+
 #endif /* DEADLOCK_THREAD_H_ */
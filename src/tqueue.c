@@ -48,6 +48,48 @@ dltqueue_push(struct dltqueue *q, dltask *tsk)
 	return 0;
 }
 
+/*
+ * dltqueue_pushmany() implements dltqueue_pushn() and dltqueue_pushv(). Each
+ * task is located stride bytes after the previous, starting at base. If
+ * indirect is set each element is a pointer to a task rather than a task.
+ */
+static int
+dltqueue_pushmany(struct dltqueue *q, char *base, size_t n, size_t stride,
+                  int indirect, size_t *pushed)
+{
+	unsigned h = atomic_load_explicit(&q->head, memory_order_relaxed);
+	unsigned t = atomic_load_explicit(&q->tail, memory_order_acquire);
+	size_t avail = (size_t)q->szmask + 1 - (h - t);
+	size_t count = n < avail ? n : avail;
+	*pushed = count;
+	if (count == 0) {
+		return n ? ENOBUFS : 0;
+	}
+	for (size_t i = 0; i < count; ++ i, base += stride) {
+		dltask *tsk = indirect ? *(dltask **)base : (dltask *)base;
+		atomic_store_explicit(&q->tasks[(h + (unsigned)i) & q->szmask],
+		                      tsk, memory_order_relaxed);
+	}
+	atomic_thread_fence(memory_order_release);
+	atomic_store_explicit(&q->head, h + (unsigned)count,
+	                      memory_order_relaxed);
+	return count == n ? 0 : ENOBUFS;
+}
+
+int
+dltqueue_pushn(struct dltqueue *q, dltask *first, size_t n, size_t stride,
+               size_t *pushed)
+{
+	return dltqueue_pushmany(q, (char *)first, n, stride, 0, pushed);
+}
+
+int
+dltqueue_pushv(struct dltqueue *q, dltask *const *tasks, size_t n,
+               size_t *pushed)
+{
+	return dltqueue_pushmany(q, (char *)tasks, n, sizeof *tasks, 1, pushed);
+}
+
 int
 dltqueue_steal(struct dltqueue *q, dltask **dst)
 {
@@ -72,6 +114,16 @@ dltqueue_steal(struct dltqueue *q, dltask **dst)
 	return 0;
 }
 
+int
+dltqueue_empty(struct dltqueue *q)
+{
+	/* Same ordering as steal, without claiming anything */
+	unsigned t = atomic_load_explicit(&q->tail, memory_order_acquire);
+	atomic_thread_fence(memory_order_seq_cst);
+	unsigned h = atomic_load_explicit(&q->head, memory_order_acquire);
+	return h <= t;
+}
+
 /*
  * I believe the implementation of take in Correct and efficient work-stealing
  * for weak memory models is bugged. If we're dealing with unsigned indices
@@ -3,6 +3,7 @@
 
 #include "deadlock/dl.h"
 #include <stdatomic.h>
+#include <stddef.h>
 
 /*
  * Correct and efficient work-stealing for weak memory models.
@@ -23,6 +24,17 @@
  * Zero is returned on success, otherwise the task is not queued and:
  * ENOBUFS shall be returned if the queue is full.
  *
+ * dltqueue_pushn() appends up to n tasks to the bottom of the queue, where the
+ * i-th task is located stride bytes after the (i-1)-th, starting at first.
+ * All queued tasks are published with a single release fence and head
+ * update. The number of tasks queued is stored in pushed. Zero is returned
+ * if all n tasks were queued, otherwise:
+ * ENOBUFS shall be returned if the queue filled up and only the first
+ * *pushed tasks were queued.
+ *
+ * dltqueue_pushv() behaves like dltqueue_pushn() but takes an array of n
+ * task pointers.
+ *
  * dltqueue_steal() moves the oldest task into dst.
  * Zero is returned on success, otherwise dst is undefined and:
  * ENODATA shall be returned if the queue is empty;
@@ -33,6 +45,9 @@
  * ENODATA shall be returned if the queue is empty;
  * EAGAIN shall be returned if this thead failed to atomically acquire a task.
  *
+ * dltqueue_empty() returns nonzero if the queue held no tasks at some point
+ * during the call. Tasks may be pushed by the owner immediately afterwards.
+ *
  * push, take, and steal cannot fail except with EAGAIN, ENOBUFS, and ENODATA
  * where specified above.
  */
@@ -53,7 +68,12 @@ struct dltqueue {
 void dltqueue_destroy(struct dltqueue *);
 int  dltqueue_init   (struct dltqueue *, unsigned int size);
 int  dltqueue_push   (struct dltqueue *, dltask *);
+int  dltqueue_pushn  (struct dltqueue *, dltask *first, size_t n,
+                      size_t stride, size_t *pushed);
+int  dltqueue_pushv  (struct dltqueue *, dltask *const *tasks, size_t n,
+                      size_t *pushed);
 int  dltqueue_steal  (struct dltqueue *, dltask **dst);
 int  dltqueue_take   (struct dltqueue *, dltask **dst);
+int  dltqueue_empty  (struct dltqueue *);
 
 #endif /* DEADLOCK_TQUEUE_H_ */
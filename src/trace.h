@@ -0,0 +1,221 @@
+#ifndef DEADLOCK_TRACE_H_
+#define DEADLOCK_TRACE_H_
+
+#include "deadlock/graphfile.h"
+#include "json.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+ * Writes a graph as Chrome Trace Event JSON, which chrome://tracing and
+ * Perfetto open directly. Shared by dlgraph_joinex() at runtime and the
+ * deadlock-graph tool offline, which see graphs through a dltrace_source.
+ *
+ * Each worker is a thread track of complete ("X") events, one per node,
+ * named by the node's label or else its function, with the task ID,
+ * function and source location as arguments. Every edge and continuation
+ * becomes a flow arrow from the end of its head node to the start of its
+ * tail node. Timestamps are microseconds from the graph's base.
+ *
+ * A dltrace_source describes a graph held in any form: descs and strings
+ * are the description table and string table of deadlock/graphfile.h.
+ * segment() returns the next contiguous run of records of kind, one of the
+ * DLGRAPHFILE_CHUNK_ kinds, for worker and stores its size in bytes in
+ * size, or returns NULL once there are no more; cursor is NULL before the
+ * first run and is otherwise left as segment() set it. label() returns the
+ * label at offset in a worker's labels, or NULL.
+ *
+ * dltrace_write() writes the trace of source to f. Zero is returned on
+ * success, otherwise errno is set and:
+ * ENOMEM shall be returned if insufficient memory exists;
+ * or any error returned by writing to f.
+ */
+struct dltrace_source {
+	void                          *ctx;
+	uint32_t                       nworkers;
+	uint32_t                       ndescs;
+	const struct dlgraphfile_desc *descs;
+	const char                    *strings;
+	uint64_t                       strings_size;
+	const void *(*segment)(void *ctx, uint32_t worker, unsigned kind,
+	                       const void **cursor, size_t *size);
+	const char *(*label)(void *ctx, uint32_t worker, uint32_t offset);
+};
+
+static int dltrace_write(FILE *f, const struct dltrace_source *);
+
+/*
+ * dltrace_task is the index flow arrows are resolved through: a node's
+ * worker and extent, sorted by task ID.
+ */
+struct dltrace_task {
+	uint64_t task;
+	uint64_t begin_ns;
+	uint64_t end_ns;
+	uint32_t worker;
+};
+
+static int
+dltrace_task_cmp(const void *xa, const void *xb)
+{
+	const struct dltrace_task *a = xa, *b = xb;
+	return (a->task > b->task) - (a->task < b->task);
+}
+
+static const struct dltrace_task *
+dltrace_task_find(const struct dltrace_task *tasks, size_t n, uint64_t task)
+{
+	size_t lo = 0, hi = n;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (tasks[mid].task < task)       lo = mid + 1;
+		else if (tasks[mid].task > task)  hi = mid;
+		else                              return tasks + mid;
+	}
+	return NULL;
+}
+
+static const char *
+dltrace_string(const struct dltrace_source *src, uint32_t offset)
+{
+	return offset < src->strings_size ? src->strings + offset : "?";
+}
+
+/*
+ * dltrace_put_us() writes nanoseconds as fractional microseconds.
+ */
+static void
+dltrace_put_us(FILE *f, uint64_t ns)
+{
+	fprintf(f, "%llu.%03llu", (unsigned long long)(ns / 1000),
+	        (unsigned long long)(ns % 1000));
+}
+
+static void
+dltrace_flows(FILE *f, const struct dltrace_source *src, unsigned kind,
+              const struct dltrace_task *tasks, size_t ntasks,
+              unsigned long long *flow)
+{
+	size_t stride = kind == DLGRAPHFILE_CHUNK_EDGES
+	                ? sizeof(struct dlgraphfile_edge)
+	                : sizeof(struct dlgraphfile_continuation);
+	const char *name = kind == DLGRAPHFILE_CHUNK_EDGES ? "edge" : "continuation";
+	for (uint32_t w = 0; w < src->nworkers; ++ w) {
+		const void *cursor = NULL;
+		const unsigned char *seg;
+		size_t size;
+		while ((seg = src->segment(src->ctx, w, kind, &cursor, &size))) {
+			for (size_t i = 0; i + stride <= size; i += stride) {
+				uint64_t head, tail;
+				if (kind == DLGRAPHFILE_CHUNK_EDGES) {
+					const struct dlgraphfile_edge *e = (const void *)(seg + i);
+					head = e->head;
+					tail = e->tail;
+				} else {
+					const struct dlgraphfile_continuation *c = (const void *)(seg + i);
+					head = c->head;
+					tail = c->tail;
+				}
+				const struct dltrace_task *h = dltrace_task_find(tasks, ntasks, head);
+				const struct dltrace_task *t = dltrace_task_find(tasks, ntasks, tail);
+				if (!h || !t)
+					continue;
+				/* Flows bind to the slice enclosing them, so stay inside */
+				uint64_t from = h->end_ns > h->begin_ns ? h->end_ns - 1 : h->begin_ns;
+				fprintf(f, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"s\","
+				           "\"id\":%llu,\"pid\":0,\"tid\":%u,\"ts\":",
+				        name, name, *flow, (unsigned)h->worker);
+				dltrace_put_us(f, from);
+				fprintf(f, "}");
+				fprintf(f, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"f\","
+				           "\"bp\":\"e\",\"id\":%llu,\"pid\":0,\"tid\":%u,\"ts\":",
+				        name, name, *flow, (unsigned)t->worker);
+				dltrace_put_us(f, t->begin_ns);
+				fprintf(f, "}");
+				++ *flow;
+			}
+		}
+	}
+}
+
+static int
+dltrace_write(FILE *f, const struct dltrace_source *src)
+{
+	/* Index every node by task to resolve flow endpoints */
+	size_t ntasks = 0;
+	for (uint32_t w = 0; w < src->nworkers; ++ w) {
+		const void *cursor = NULL;
+		size_t size;
+		while (src->segment(src->ctx, w, DLGRAPHFILE_CHUNK_NODES, &cursor, &size))
+			ntasks += size / sizeof(struct dlgraphfile_node);
+	}
+	struct dltrace_task *tasks = malloc((ntasks ? ntasks : 1) * sizeof(*tasks));
+	if (!tasks)
+		return errno = ENOMEM;
+
+	fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+	fprintf(f, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":0,"
+	           "\"args\":{\"name\":\"deadlock\"}}");
+	for (uint32_t w = 0; w < src->nworkers; ++ w) {
+		fprintf(f, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,"
+		           "\"tid\":%u,\"args\":{\"name\":\"worker %u\"}}",
+		        (unsigned)w, (unsigned)w);
+	}
+
+	size_t t = 0;
+	for (uint32_t w = 0; w < src->nworkers; ++ w) {
+		const void *cursor = NULL;
+		const struct dlgraphfile_node *n;
+		size_t size;
+		while ((n = src->segment(src->ctx, w, DLGRAPHFILE_CHUNK_NODES, &cursor, &size))) {
+			for (size_t i = 0; i < size / sizeof(*n); ++ i) {
+				const struct dlgraphfile_desc *d = n[i].desc < src->ndescs
+				                                   ? src->descs + n[i].desc
+				                                   : NULL;
+				const char *func = d ? dltrace_string(src, d->func) : "?";
+				const char *label = n[i].label != DLGRAPHFILE_NO_LABEL
+				                    ? src->label(src->ctx, w, n[i].label)
+				                    : NULL;
+				fprintf(f, ",\n{\"name\":\"");
+				dljson_puts(f, label ? label : func);
+				fprintf(f, "\",\"cat\":\"task\",\"ph\":\"X\",\"pid\":0,"
+				           "\"tid\":%u,\"ts\":", (unsigned)w);
+				dltrace_put_us(f, n[i].begin_ns);
+				fprintf(f, ",\"dur\":");
+				dltrace_put_us(f, n[i].duration_ns);
+				/* A string, since JSON numbers are doubles which round 64 bit IDs */
+				fprintf(f, ",\"args\":{\"task\":\"%llu\",\"func\":\"",
+				        (unsigned long long)n[i].task);
+				dljson_puts(f, func);
+				if (d) {
+					fprintf(f, "\",\"source\":\"");
+					dljson_puts(f, dltrace_string(src, d->file));
+					fprintf(f, ":%u", (unsigned)d->line);
+				}
+				fprintf(f, "\"}}");
+
+				tasks[t ++] = (struct dltrace_task) {
+					.task = n[i].task,
+					.begin_ns = n[i].begin_ns,
+					.end_ns = n[i].begin_ns + n[i].duration_ns,
+					.worker = w
+				};
+			}
+		}
+	}
+
+	qsort(tasks, t, sizeof(*tasks), dltrace_task_cmp);
+	unsigned long long flow = 0;
+	dltrace_flows(f, src, DLGRAPHFILE_CHUNK_EDGES, tasks, t, &flow);
+	dltrace_flows(f, src, DLGRAPHFILE_CHUNK_CONTINUATIONS, tasks, t, &flow);
+	fprintf(f, "\n]}\n");
+	free(tasks);
+
+	if (ferror(f))
+		return errno ? errno : (errno = EIO);
+	return 0;
+}
+
+#endif /* DEADLOCK_TRACE_H_ */
@@ -0,0 +1,242 @@
+#include "sched.h"
+#include "watchdog.h"
+#include <errno.h>
+
+#ifdef DEADLOCK_WATCHDOG
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+#include <time.h> /* nanosleep */
+#endif
+
+/*
+ * A scheduler's watchdog. reported holds the begin stamp of the task each
+ * worker last reported, so a task is reported once however long it runs.
+ */
+struct dlwatchdog_thread {
+	struct dlthread    thread;
+	struct dlwatchdog  config;
+	atomic_int         stop;
+	int                started;
+	unsigned long long reported[];
+};
+
+/*
+ * The configuration of watchdogs started. Until dlwatchdog_configure() is
+ * called dlwatchdog_configured is zero and the DEADLOCK_WATCHDOG environment
+ * variable is read instead. lock is held while any is read or written.
+ */
+static struct dlwatchdog dlwatchdog_config;
+static int               dlwatchdog_enabled = 0;
+static int               dlwatchdog_configured = 0;
+static struct dlspinlock dlwatchdog_lock = DLSPINLOCK_INIT;
+
+int
+dlwatchdog_configure(const struct dlwatchdog *watchdog)
+{
+	if (watchdog && !watchdog->threshold_ns)
+		return errno = EINVAL;
+
+	dlspinlock_lock(&dlwatchdog_lock);
+	if (watchdog)
+		dlwatchdog_config = *watchdog;
+	dlwatchdog_enabled = watchdog != NULL;
+	dlwatchdog_configured = 1;
+	dlspinlock_unlock(&dlwatchdog_lock);
+	return 0;
+}
+
+void
+dlwatchdog_attach(struct dlsched *s)
+{
+	s->watchdog = NULL;
+
+	dlspinlock_lock(&dlwatchdog_lock);
+	if (!dlwatchdog_configured) {
+		const char *env = getenv("DEADLOCK_WATCHDOG");
+		char *end;
+		unsigned long long ms = env ? strtoull(env, &end, 10) : 0;
+		if (ms && !*end) {
+			dlwatchdog_config = (struct dlwatchdog) {
+				.threshold_ns = ms * 1000000
+			};
+			dlwatchdog_enabled = 1;
+		}
+		dlwatchdog_configured = 1;
+	}
+	struct dlwatchdog config = dlwatchdog_config;
+	int enabled = dlwatchdog_enabled;
+	dlspinlock_unlock(&dlwatchdog_lock);
+	if (!enabled)
+		return;
+
+	struct dlwatchdog_thread *wd = malloc(sizeof(*wd) +
+	                                      sizeof(*wd->reported) * (size_t)s->nworkers);
+	if (!wd) {
+		errno = ENOMEM;
+		perror("dlwatchdog_attach failed to allocate watchdog");
+		return;
+	}
+	wd->config = config;
+	atomic_init(&wd->stop, 0);
+	wd->started = 0;
+	memset(wd->reported, 0, sizeof(*wd->reported) * (size_t)s->nworkers);
+	s->watchdog = wd;
+}
+
+static void
+dlwatchdog_sleep(unsigned long long ns)
+{
+#ifdef _WIN32
+	Sleep((DWORD)(ns / 1000000));
+#else
+	struct timespec ts = {
+		.tv_sec = (time_t)(ns / 1000000000),
+		.tv_nsec = (long)(ns % 1000000000)
+	};
+	while (nanosleep(&ts, &ts) != 0 && errno == EINTR) ;
+#endif
+}
+
+static void
+dlwatchdog_log(int worker, const struct dlwatchdog_task *t)
+{
+	double ms = (double)t->running_ns / 1e6;
+	const char *label = t->label ? t->label : "";
+	const char *quote = t->label ? "\"" : "";
+#ifdef DEADLOCK_GRAPH_EXPORT
+	if (t->desc) {
+		fprintf(stderr, "dlwatchdog: worker %d has run %s (%s:%lu) %s%s%s for %.1fms\n",
+		        worker, t->desc->func, t->desc->file, t->desc->line,
+		        quote, label, quote, ms);
+		return;
+	}
+#endif
+	fprintf(stderr, "dlwatchdog: worker %d has run task %p of function %p %s%s%s for %.1fms\n",
+	        worker, (void *)t->task, (void *)(uintptr_t)t->fn,
+	        quote, label, quote, ms);
+}
+
+/*
+ * dlwatchdog_check() reports the task worker is executing if it has run
+ * past the threshold at now and has not been reported. A stamp which
+ * changes while it is read is left for the next check.
+ */
+static void
+dlwatchdog_check(struct dlwatchdog_thread *wd, struct dlworker *worker,
+                 unsigned long long now)
+{
+	struct dlwatch *w = &worker->watch;
+	unsigned long long seq = atomic_load_explicit(&w->seq, memory_order_acquire);
+	if (!(seq & 1))
+		return;
+	unsigned long long begin = atomic_load_explicit(&w->begin, memory_order_relaxed);
+	if (begin == wd->reported[worker->index] || now < begin)
+		return;
+	unsigned long long running_ns = dlclock_ticks_ns(now - begin);
+	if (running_ns < wd->config.threshold_ns)
+		return;
+
+	struct dlwatchdog_task task = {
+		.task       = atomic_load_explicit(&w->task, memory_order_relaxed),
+		.fn         = atomic_load_explicit(&w->fn, memory_order_relaxed),
+		.desc       = atomic_load_explicit(&w->desc, memory_order_relaxed),
+		.running_ns = running_ns
+	};
+	char label[DLWATCH_LABEL_MAX];
+	for (size_t i = 0; i < sizeof(label); ++ i)
+		label[i] = ((volatile char *)w->label)[i];
+	label[sizeof(label) - 1] = '\0';
+	atomic_thread_fence(memory_order_acquire);
+	if (atomic_load_explicit(&w->seq, memory_order_relaxed) != seq)
+		return;
+	task.label = label[0] ? label : NULL;
+
+	wd->reported[worker->index] = begin;
+	if (wd->config.report)
+		wd->config.report(wd->config.ctx, worker->index, &task);
+	else
+		dlwatchdog_log(worker->index, &task);
+}
+
+static void
+dlwatchdog_run(void *xsched)
+{
+	struct dlsched *s = xsched;
+	struct dlwatchdog_thread *wd = s->watchdog;
+
+	/* Check a few times per threshold, but neither too often nor rarely */
+	unsigned long long interval = wd->config.threshold_ns / 4;
+	if (interval < 1000000)  interval = 1000000;
+	if (interval > 10000000) interval = 10000000;
+
+	while (!atomic_load_explicit(&wd->stop, memory_order_acquire)) {
+		dlwatchdog_sleep(interval);
+		unsigned long long now = dlclock_ticks();
+		for (int w = 0; w < s->nworkers; ++ w)
+			dlwatchdog_check(wd, s->workers + w, now);
+	}
+}
+
+void
+dlwatchdog_start(struct dlsched *s)
+{
+	struct dlwatchdog_thread *wd = s->watchdog;
+	if (!wd)
+		return;
+	int result = dlthread_create(&wd->thread, dlwatchdog_run, s, -1);
+	if (result) {
+		errno = result;
+		perror("dlwatchdog_start failed to create watchdog thread");
+		return;
+	}
+	wd->started = 1;
+}
+
+void
+dlwatchdog_detach(struct dlsched *s)
+{
+	struct dlwatchdog_thread *wd = s->watchdog;
+	if (!wd)
+		return;
+	if (wd->started) {
+		atomic_store_explicit(&wd->stop, 1, memory_order_release);
+		if ((errno = dlthread_join(&wd->thread))) {
+			perror("dlwatchdog_detach failed to join watchdog thread");
+			exit(errno);
+		}
+	}
+	free(wd);
+	s->watchdog = NULL;
+}
+
+#ifdef __clang__
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wformat-nonliteral"
+#endif
+void
+dlwatch_label(struct dlwatch *w, const char *format, va_list args)
+{
+	if (!w->enabled || w->depth != 1)
+		return;
+	dlwatch_unstable(w);
+	vsnprintf(w->label, sizeof(w->label), format, args);
+	dlwatch_stable(w);
+}
+#ifdef __clang__
+#pragma clang diagnostic pop
+#endif
+
+#else
+
+int
+dlwatchdog_configure(const struct dlwatchdog *watchdog)
+{
+	(void)watchdog;
+	return errno = ENOTSUP;
+}
+
+#endif
@@ -0,0 +1,119 @@
+#ifndef DEADLOCK_WATCHDOG_PRIVATE_H_
+#define DEADLOCK_WATCHDOG_PRIVATE_H_
+
+#include "deadlock/watchdog.h"
+
+#ifdef DEADLOCK_WATCHDOG
+
+#include "clock.h"
+#include <stdarg.h>
+#include <stdatomic.h>
+
+/*
+ * Each worker owns a dlwatch, the stamp of the outermost task it executes,
+ * which the watchdog reads. Only its worker writes it, guarded by seq like a
+ * seqlock: seq is odd while a task runs and its stamp is stable, and is
+ * incremented to even before the stamp changes and back to odd after, so
+ * the watchdog trusts a stamp it read between two equal odd loads of seq.
+ * enabled is set if the scheduler runs a watchdog and depth counts tasks
+ * invoked within each other; both are private to the worker.
+ *
+ * dlwatchdog_attach() prepares the watchdog a starting scheduler runs, if it
+ * is configured, see deadlock/watchdog.h, in s->watchdog. It must be called
+ * before any worker is initialized, so workers know to stamp their tasks.
+ * dlwatchdog_start() starts its thread once every worker is initialized.
+ * Neither can fail: without memory or a thread the scheduler runs without a
+ * watchdog, printing why.
+ *
+ * dlwatchdog_detach() stops the watchdog's thread, if it was started, and
+ * frees it, before workers are destroyed.
+ *
+ * dlwatch_begin() stamps task t, whose function is fn, as it begins, and
+ * dlwatch_end() clears it once it ends. dlwatch_describe() adds a captured
+ * task's description and dlwatch_label() its label, formatted into label and
+ * truncated. Each only stamps the outermost task.
+ */
+#define DLWATCH_LABEL_MAX 64
+
+struct dlwatch {
+	int                  enabled;
+	int                  depth;
+	atomic_ullong        seq;
+	atomic_ullong        begin;
+	_Atomic(dltask *)    task;
+	_Atomic(dltaskfn)    fn;
+	_Atomic(const struct dlgraph_node_description *) desc;
+	char                 label[DLWATCH_LABEL_MAX];
+};
+
+struct dlsched;
+struct dlwatchdog_thread;
+
+void dlwatchdog_attach(struct dlsched *);
+void dlwatchdog_start (struct dlsched *);
+void dlwatchdog_detach(struct dlsched *);
+void dlwatch_label    (struct dlwatch *, const char *format, va_list);
+
+static inline void
+dlwatch_init(struct dlwatch *w, int enabled)
+{
+	w->enabled = enabled;
+	w->depth = 0;
+	atomic_init(&w->seq, 0);
+	atomic_init(&w->begin, 0);
+	atomic_init(&w->task, NULL);
+	atomic_init(&w->fn, NULL);
+	atomic_init(&w->desc, NULL);
+	w->label[0] = '\0';
+}
+
+/* seq becomes even before the stamp changes, as a seqlock writer */
+static inline void
+dlwatch_unstable(struct dlwatch *w)
+{
+	atomic_store_explicit(&w->seq, atomic_load_explicit(&w->seq, memory_order_relaxed) + 1,
+	                      memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+}
+
+static inline void
+dlwatch_stable(struct dlwatch *w)
+{
+	atomic_store_explicit(&w->seq, atomic_load_explicit(&w->seq, memory_order_relaxed) + 1,
+	                      memory_order_release);
+}
+
+static inline void
+dlwatch_begin(struct dlwatch *w, dltask *t, dltaskfn fn)
+{
+	if (!w->enabled || w->depth ++)
+		return;
+	atomic_store_explicit(&w->begin, dlclock_ticks(), memory_order_relaxed);
+	atomic_store_explicit(&w->task, t, memory_order_relaxed);
+	atomic_store_explicit(&w->fn, fn, memory_order_relaxed);
+	atomic_store_explicit(&w->desc, NULL, memory_order_relaxed);
+	w->label[0] = '\0';
+	dlwatch_stable(w);
+}
+
+static inline void
+dlwatch_end(struct dlwatch *w)
+{
+	if (!w->enabled || -- w->depth)
+		return;
+	dlwatch_unstable(w);
+}
+
+static inline void
+dlwatch_describe(struct dlwatch *w, const struct dlgraph_node_description *desc)
+{
+	if (!w->enabled || w->depth != 1)
+		return;
+	dlwatch_unstable(w);
+	atomic_store_explicit(&w->desc, desc, memory_order_relaxed);
+	dlwatch_stable(w);
+}
+
+#endif /* DEADLOCK_WATCHDOG */
+
+#endif /* DEADLOCK_WATCHDOG_PRIVATE_H_ */
@@ -1,5 +1,9 @@
 #include "worker.h"
+#include "fiber.h"
 #include "sched.h"
+#include "clock.h"
+#include "hooks.h"
+#include "probe.h"
 #include <assert.h>
 #include <errno.h>
 #include <stdint.h>
@@ -23,6 +27,24 @@ static void    dlworker_entry (void*);
 static dltask *dlworker_invoke(struct dlworker *, dltask *);
 static void    dlworker_stall (struct dlworker *);
 
+/*
+ * dlworker_hook_task() describes t, whose function is fn, to the task_begin
+ * and task_end hooks. A captured task is described by the current node.
+ */
+static struct dlhook_task dlworker_hook_task(struct dlworker *, dltask *t,
+                                             dltaskfn fn, int cancelled);
+
+/*
+ * dlworker_publish() publishes this worker's state, queue depth and tasks
+ * executed to its metrics, if it has any. Only the owner moves head, so
+ * head - tail is the depth unless a thief or take races it below zero.
+ *
+ * dlworker_publish_counters() publishes this worker's steal, stall and
+ * parked counters, which only change while it is out of work.
+ */
+static void dlworker_publish         (struct dlworker *, uint64_t state);
+static void dlworker_publish_counters(struct dlworker *);
+
 void
 dlworker_async(struct dlworker *w, dltask *t)
 {
@@ -31,6 +53,9 @@ dlworker_async(struct dlworker *w, dltask *t)
 		 * dltqueue_push shall only return success or ENOBUFS.
 		 * If there is no space execute this task immediately.
 		 */
+		const struct dlhooks *hooks = dlhooks();
+		if (hooks && hooks->spawn)
+			hooks->spawn(hooks->ctx, w->index, t);
 		switch (dltqueue_push(&w->tqueue, t)) {
 		case 0: {
 			int result = dlwait_broadcast(&w->sched->stall);
@@ -40,15 +65,83 @@ dlworker_async(struct dlworker *w, dltask *t)
 			exit(errno);
 		}
 		case ENOBUFS:
+			dlstats_add(&w->stats.inline_executions, 1);
 			t = dlworker_invoke(w, t);
 		}
 	} while (t);
 }
 
+/*
+ * dlworker_signal_queued() wakes stalled workers once after any number of
+ * tasks are queued.
+ */
+static void
+dlworker_signal_queued(struct dlworker *w)
+{
+	int result = dlwait_broadcast(&w->sched->stall);
+	if (result) {
+		errno = result;
+		perror("dlworker_async failed to signal stall");
+		exit(errno);
+	}
+}
+
+void
+dlworker_asyncn(struct dlworker *w, dltask *first, size_t n, size_t stride)
+{
+	/*
+	 * dltqueue_pushn shall only return success or ENOBUFS. Wake stalled
+	 * workers once for everything queued, then execute any overflow
+	 * immediately.
+	 */
+	const struct dlhooks *hooks = dlhooks();
+	if (hooks && hooks->spawn) {
+		for (size_t i = 0; i < n; ++ i)
+			hooks->spawn(hooks->ctx, w->index, (dltask *)((char *)first + i * stride));
+	}
+	size_t pushed;
+	(void) dltqueue_pushn(&w->tqueue, first, n, stride, &pushed);
+	if (pushed) dlworker_signal_queued(w);
+	dlstats_add(&w->stats.inline_executions, n - pushed);
+	for (size_t i = pushed; i < n; ++ i) {
+		dltask *t = (dltask *)((char *)first + i * stride);
+		t = dlworker_invoke(w, t);
+		if (t) dlworker_async(w, t);
+	}
+}
+
+void
+dlworker_asyncv(struct dlworker *w, dltask *const *tasks, size_t n)
+{
+	/* See dlworker_asyncn */
+	const struct dlhooks *hooks = dlhooks();
+	if (hooks && hooks->spawn) {
+		for (size_t i = 0; i < n; ++ i)
+			hooks->spawn(hooks->ctx, w->index, tasks[i]);
+	}
+	size_t pushed;
+	(void) dltqueue_pushv(&w->tqueue, tasks, n, &pushed);
+	if (pushed) dlworker_signal_queued(w);
+	dlstats_add(&w->stats.inline_executions, n - pushed);
+	for (size_t i = pushed; i < n; ++ i) {
+		dltask *t = dlworker_invoke(w, tasks[i]);
+		if (t) dlworker_async(w, t);
+	}
+}
+
 void
 dlworker_destroy(struct dlworker *w)
 {
 	dltqueue_destroy(&w->tqueue);
+	dlstats_destroy(&w->stats);
+	dlpool_destroy(&w->future_pool);
+	dlpool_destroy(&w->waiter_pool);
+#ifdef DEADLOCK_FLIGHT_RECORDER
+	dlrecorder_destroy(&w->recorder);
+#endif
+#ifdef DEADLOCK_FIBERS
+	dlfiber_pool_destroy(w);
+#endif
 }
 
 void
@@ -70,9 +163,23 @@ dlworker_init(struct dlworker *w, struct dlsched *s, dltask *task,
 	w->entry = entry;
 	w->exit  = exit;
 	w->index = index;
+	w->cancel = NULL;
+	w->metrics = dlmetrics_worker(s->metrics, index);
+#ifdef DEADLOCK_WATCHDOG
+	dlwatch_init(&w->watch, s->watchdog != NULL);
+#endif
+	dlpool_init(&w->future_pool);
+	dlpool_init(&w->waiter_pool);
 
 #ifdef DEADLOCK_GRAPH_EXPORT
 	w->current_graph = NULL;
+	w->current_node = NULL;
+#endif
+
+#ifdef DEADLOCK_FIBERS
+	w->fiber = NULL;
+	w->fiber_pool = NULL;
+	w->fiber_pool_count = 0;
 #endif
 
 	/* TODO: Hardcoded task capacity */
@@ -81,6 +188,14 @@ dlworker_init(struct dlworker *w, struct dlsched *s, dltask *task,
 	result = dltqueue_init(&w->tqueue, initsz);
 	if (result) goto tqueue_init_failed;
 
+	result = dlstats_init(&w->stats, s->nworkers);
+	if (result) goto stats_init_failed;
+
+#ifdef DEADLOCK_FLIGHT_RECORDER
+	result = dlrecorder_init(&w->recorder);
+	if (result) goto recorder_init_failed;
+#endif
+
 	if (task) {
 		result = dltqueue_push(&w->tqueue, task);
 		if (result) goto tqueue_prime_failed;
@@ -94,6 +209,12 @@ dlworker_init(struct dlworker *w, struct dlsched *s, dltask *task,
 
 pthread_create_failed:
 tqueue_prime_failed:
+#ifdef DEADLOCK_FLIGHT_RECORDER
+	dlrecorder_destroy(&w->recorder);
+recorder_init_failed:
+#endif
+	dlstats_destroy(&w->stats);
+stats_init_failed:
 	dltqueue_destroy(&w->tqueue);
 tqueue_init_failed:
 	return errno = result;
@@ -102,22 +223,36 @@ tqueue_init_failed:
 #ifdef DEADLOCK_GRAPH_EXPORT
 
 void
-dlworker_set_current_node(void *wx, unsigned long description)
+dlworker_set_current_node(void *wx, dltask *t, struct dlgraph_node_description *description)
 {
 	struct dlworker *w = wx;
-	w->current_node = (struct dlgraph_node) {
-		.begin_ns = dlgraph_now(),
-		.task = w->invoked_task_id,
+	*w->current_node = (struct dlgraph_node) {
+		.begin = DL_ATOMIC_LOAD_RELAXED_(&description->unselected) ? 0 : dlgraph_now(),
+		.task = dltask_xchg_id(t),
 		.desc = description,
 		.label_offset = ULONG_MAX
 	};
+#ifdef DEADLOCK_WATCHDOG
+	dlwatch_describe(&w->watch, description);
+#endif
+	const struct dlhooks *hooks = dlhooks();
+	if (hooks && hooks->task_begin) {
+		struct dlhook_task ht = dlworker_hook_task(w, t, t->fn_, 0);
+		hooks->task_begin(hooks->ctx, w->index, &ht);
+	}
 }
 
+/*
+ * Tasks whose description dlgraph_select() excludes still propagate their
+ * graph to their children, but record neither their node nor dependencies
+ * from it.
+ */
 void
 dlworker_add_current_node(void *wx)
 {
 	struct dlworker *w = wx;
-	dlgraph_add_node(w->current_graph->fragments + w->index, &w->current_node);
+	if (!dlgraph_node_unselected(w->current_node))
+		dlgraph_add_node(w->current_graph, w->index, w->current_node);
 }
 
 void
@@ -127,7 +262,8 @@ dlworker_add_continuation_from_current(void *wx, dltask *task)
 	struct dlgraph *graph = w->current_graph;
 	if (graph) {
 		task->graph_ = graph;
-		dlgraph_add_continuation(graph->fragments + w->index, w->invoked_task_id, task->tid_);
+		if (!dlgraph_node_unselected(w->current_node))
+			dlgraph_add_continuation(graph, w->index, w->current_node->task, task->tid_);
 	}
 }
 
@@ -138,7 +274,8 @@ dlworker_add_edge_from_current(void *wx, dltask *task)
 	struct dlgraph *graph = w->current_graph;
 	if (graph) {
 		task->graph_ = graph;
-		dlgraph_add_edge(graph->fragments + w->index, w->invoked_task_id, task->tid_);
+		if (!dlgraph_node_unselected(w->current_node))
+			dlgraph_add_edge(graph, w->index, w->current_node->task, task->tid_);
 	}
 }
 
@@ -150,12 +287,12 @@ dlworker_entry(void *xworker)
 	struct dlworker *w = xworker;
 
 	/*
-	 * Initialize this threads task ID generator's most significant byte
+	 * Initialize this threads task ID generator's most significant bits
 	 * with this workers ID (+ 1 to allow for tasks initialized without a
 	 * worker).
 	 */
 #ifdef DEADLOCK_GRAPH_EXPORT
-	dl_next_task_id = ((unsigned long)(w->index+1) << 24) & 0xFF000000;
+	dl_next_task_id = (unsigned long long)(w->index+1) << DLTASK_ID_COUNTER_BITS;
 #endif
 
 	/* Thread local pointer to this worker used by async etc. */
@@ -190,21 +327,55 @@ dlworker_entry(void *xworker)
 			_mm_pause();
 			goto take;
 		} else if (rc == 0) {
+			dlstats_add(&w->stats.taken, 1);
+			dlworker_publish(w, DLMETRICS_BUSY);
 			goto invoke;
 		}
 		assert(rc == ENODATA);
+		dlworker_publish(w, DLMETRICS_IDLE);
 
 		/* attempt to steal before stalling */
 		for (size_t sc = 0; sc < 4; ++ sc) {
-			rc = dlsched_steal(w->sched, &t, w->index);
-			if (rc == 0) goto invoke;
+			int victim;
+			rc = dlsched_steal(w->sched, &t, w->index, &victim);
+			if (rc == 0) {
+#ifdef DEADLOCK_FLIGHT_RECORDER
+				dlrecorder_record(&w->recorder, DLRECORDER_STEAL, (uintptr_t)victim);
+#endif
+				const struct dlhooks *hooks = dlhooks();
+				if (hooks && hooks->steal)
+					hooks->steal(hooks->ctx, w->index, victim, t);
+				dlworker_publish_counters(w);
+				dlworker_publish(w, DLMETRICS_BUSY);
+				goto invoke;
+			}
 			assert(rc == ENODATA);
 			dlthread_yield();
 		}
 		t = NULL;
-		dlworker_stall(w);
+		if (!dlsched_idle(w->sched)) {
+#ifdef DEADLOCK_FLIGHT_RECORDER
+			dlrecorder_record(&w->recorder, DLRECORDER_STALL, 0);
+#endif
+			dlstats_add(&w->stats.stalls, 1);
+			dlworker_publish_counters(w);
+			dlworker_publish(w, DLMETRICS_PARKED);
+			unsigned long long parked = dlclock_now();
+			dlworker_stall(w);
+			dlstats_add(&w->stats.parked_ns, dlclock_now() - parked);
+			dlstats_add(&w->stats.wakes, 1);
+			dlworker_publish_counters(w);
+			dlworker_publish(w, DLMETRICS_IDLE);
+#ifdef DEADLOCK_FLIGHT_RECORDER
+			dlrecorder_record(&w->recorder, DLRECORDER_WAKE, 0);
+#endif
+			dlsched_wake(w->sched);
+		}
 	}
 
+	dlworker_publish_counters(w);
+	dlworker_publish(w, DLMETRICS_EXITED);
+
 	/* Invoke the exit lifetime callback */
 	if (w->exit) w->exit(w->index);
 
@@ -212,32 +383,149 @@ dlworker_entry(void *xworker)
 	atomic_fetch_add(&w->sched->wbarrier, 1);
 }
 
+static void
+dlworker_publish(struct dlworker *w, uint64_t state)
+{
+	struct dlmetrics_worker *m = w->metrics;
+	if (!m) return;
+	unsigned h = atomic_load_explicit(&w->tqueue.head, memory_order_relaxed);
+	unsigned t = atomic_load_explicit(&w->tqueue.tail, memory_order_relaxed);
+	dlmetrics_store(&m->state, state);
+	dlmetrics_store(&m->queued, (int)(h - t) > 0 ? h - t : 0);
+	dlmetrics_store(&m->executed,
+	                atomic_load_explicit(&w->stats.executed, memory_order_relaxed));
+}
+
+static void
+dlworker_publish_counters(struct dlworker *w)
+{
+	struct dlmetrics_worker *m = w->metrics;
+	if (!m) return;
+	uint64_t steal_attempts = 0, steals = 0;
+	for (int v = 0; v < w->sched->nworkers; ++ v) {
+		struct dlstats_victim_counters *c = w->stats.victims + v;
+		steal_attempts += atomic_load_explicit(&c->steal_attempts, memory_order_relaxed);
+		steals         += atomic_load_explicit(&c->steals, memory_order_relaxed);
+	}
+	dlmetrics_store(&m->steal_attempts, steal_attempts);
+	dlmetrics_store(&m->steals, steals);
+	dlmetrics_store(&m->stalls,
+	                atomic_load_explicit(&w->stats.stalls, memory_order_relaxed));
+	dlmetrics_store(&m->parked_ns,
+	                atomic_load_explicit(&w->stats.parked_ns, memory_order_relaxed));
+}
+
 static dltask *
 dlworker_invoke(struct dlworker *w, dltask *t)
 {
-	(void)w;
-
 	assert(t);
 	assert(t->fn_);
 	assert(atomic_load_explicit(&t->wait_, memory_order_relaxed) == 0);
 
 	dltask *next = t->next_;
+	dlstats_add(&w->stats.executed, 1);
 
+	/*
+	 * Tasks may be invoked recursively when a queue is full, so restore
+	 * the outer task's graph node and cancellation token once this task
+	 * completes. A cancelled task is skipped but still releases its next
+	 * task, unless it is a fiber which has already started.
+	 *
+	 * A task's graph node lives in this frame and is only filled by
+	 * DL_TASK_ENTRY() if the task is captured, or by dlgraph_fork(), so an
+	 * uncaptured task pays for swapping two pointers and the one test of
+	 * current_graph once it returns.
+	 *
+	 * Hooks are loaded once so that task_begin and task_end pair up. A
+	 * captured task calls task_begin from DL_TASK_ENTRY(), or its fiber
+	 * from dlfiber_run(), unless it is skipped.
+	 */
+	const struct dlhooks *hooks = dlhooks();
+	dltaskfn fn = t->fn_;
+	DLPROBE3(task__begin, w->index, t, t->fn_);
+#ifdef DEADLOCK_WATCHDOG
+	dlwatch_begin(&w->watch, t, fn);
+#endif
+#ifdef DEADLOCK_FLIGHT_RECORDER
+	dlrecorder_record(&w->recorder, DLRECORDER_BEGIN, (uintptr_t)t);
+#endif
 #ifdef DEADLOCK_GRAPH_EXPORT
+	struct dlgraph *outer_graph = w->current_graph;
+	struct dlgraph_node node, *outer_node = w->current_node;
 	w->current_graph = t->graph_;
-	w->invoked_task_id = dltask_xchg_id(t);
+	w->current_node = &node;
 #endif
+	dlcancel *outer_cancel = w->cancel;
+	w->cancel = t->cancel_;
+	int cancelled = t->cancel_ && dlcancel_requested(t->cancel_);
+#ifdef DEADLOCK_FIBERS
+	if (t->fiber_)
+		cancelled = cancelled && !dlfiber_started(t);
+#endif
+#ifdef DEADLOCK_GRAPH_EXPORT
+	if (hooks && hooks->task_begin && (!t->graph_ || cancelled)) {
+#else
+	if (hooks && hooks->task_begin) {
+#endif
+		struct dlhook_task ht = dlworker_hook_task(w, t, fn, 0);
+		hooks->task_begin(hooks->ctx, w->index, &ht);
+	}
+#ifdef DEADLOCK_FIBERS
+	if (t->fiber_) {
+		if (!cancelled && !dlfiber_run(w, t)) {
+			/* Suspended, invoked again once its child completes */
+			w->cancel = outer_cancel;
+#ifdef DEADLOCK_FLIGHT_RECORDER
+			dlrecorder_record(&w->recorder, DLRECORDER_END, (uintptr_t)t);
+#endif
+			DLPROBE3(task__end, w->index, t, 0);
+#ifdef DEADLOCK_WATCHDOG
+			dlwatch_end(&w->watch);
+#endif
+			if (hooks && hooks->task_end) {
+				struct dlhook_task ht = dlworker_hook_task(w, t, fn, 0);
+				hooks->task_end(hooks->ctx, w->index, &ht);
+			}
+#ifdef DEADLOCK_GRAPH_EXPORT
+			w->current_graph = outer_graph;
+			w->current_node = outer_node;
+#endif
+			return NULL;
+		}
+	} else
+#endif
+	if (!cancelled)
+		fn(w, t);
+	w->cancel = outer_cancel;
+#ifdef DEADLOCK_FLIGHT_RECORDER
+	/* t may have been freed, only its address is recorded */
+	dlrecorder_record(&w->recorder, DLRECORDER_END, (uintptr_t)t);
+#endif
+	DLPROBE3(task__end, w->index, t, cancelled);
+#ifdef DEADLOCK_WATCHDOG
+	dlwatch_end(&w->watch);
+#endif
+	if (hooks && hooks->task_end) {
+		struct dlhook_task ht = dlworker_hook_task(w, t, fn, cancelled);
+		hooks->task_end(hooks->ctx, w->index, &ht);
+	}
 
-	t->fn_(w, t);
-
-	/* Propegate graph to child and add this completed node to graph. */
+	/*
+	 * Propegate graph to child and add this completed node to graph. A
+	 * cancelled task never filled its node, so it records nothing, but
+	 * still passes the graph on so its join task can join it.
+	 */
 #ifdef DEADLOCK_GRAPH_EXPORT
 	struct dlgraph *graph = w->current_graph;
-	if (graph) {
+	if (graph && !cancelled) {
 		dlworker_add_current_node(w);
 		if (next)
 			dlworker_add_edge_from_current(w, next);
+	} else if (graph && next) {
+		next->graph_ = graph;
 	}
+	w->current_graph = outer_graph;
+	w->current_node = outer_node;
 #endif
 
 	if (next) {
@@ -258,10 +546,39 @@ dlworker_invoke(struct dlworker *w, dltask *t)
 static void
 dlworker_stall(struct dlworker *w)
 {
+	DLPROBE1(park, w->index);
+	const struct dlhooks *hooks = dlhooks();
+	if (hooks && hooks->park)
+		hooks->park(hooks->ctx, w->index);
 	int pr = dlwait_wait(&w->sched->stall);
 	if (pr) {
 		errno = pr;
 		perror("dlworker_stall failed to dlwait_wait on stall");
 		exit(errno);
 	}
+	DLPROBE1(unpark, w->index);
+	hooks = dlhooks();
+	if (hooks && hooks->unpark)
+		hooks->unpark(hooks->ctx, w->index);
+}
+
+static struct dlhook_task
+dlworker_hook_task(struct dlworker *w, dltask *t, dltaskfn fn, int cancelled)
+{
+	struct dlhook_task ht = {
+		.task = t,
+		.fn = fn,
+		.cancelled = cancelled
+	};
+#ifdef DEADLOCK_GRAPH_EXPORT
+	/* A skipped task never entered, so its node was never filled */
+	if (w->current_graph && !cancelled) {
+		ht.desc = w->current_node->desc;
+		if (!dlgraph_node_unselected(w->current_node))
+			ht.label = dlgraph_node_label(w->current_graph, w->index, w->current_node);
+	}
+#else
+	(void)w;
+#endif
+	return ht;
 }
@@ -3,8 +3,12 @@
 
 #include "deadlock/graph.h"
 
+#include "pool.h"
 #include "thread.h"
+#include "recorder.h"
+#include "stats.h"
 #include "tqueue.h"
+#include "watchdog.h"
 
 /*
  * Each dlworker owns a queue of tasks and spawns a thread to execute them.
@@ -15,6 +19,14 @@
  * overflows and livelocks, namely: assume dlworker_async will always invoke
  * the task immediately on the stack.
  *
+ * dlworker_asyncn() runs n tasks asynchronously, the i-th task located stride
+ * bytes after first. Every task that fits in this worker's queue is
+ * published at once and stalled workers are signalled once. Any tasks that
+ * do not fit are executed immediately, just like dlworker_async().
+ *
+ * dlworker_asyncv() behaves like dlworker_asyncn() but takes an array of n
+ * task pointers.
+ *
  * dlworker_destroy() must be called to destroy an initialized worker.
  * Termination must be signalled on the scheduler and this worker must be
  * woken from any stall state, otherwise dlworker_destroy will spin forever
@@ -28,6 +40,7 @@
  * worker.
  */
 
+struct dlmetrics_worker;
 struct dlsched;
 
 struct dlworker {
@@ -36,21 +49,55 @@ struct dlworker {
 	struct dlthread  thread;
 	dlwentryfn       entry;
 	dlwexitfn        exit;
+	dlcancel        *cancel; /* token of the currently executing task */
 	int              index;
 
+	/* Scheduler loop counters, see deadlock/stats.h */
+	struct dlstats_counters stats;
+
+	/* Live metrics published to shared memory, or NULL, see metrics.h */
+	struct dlmetrics_worker *metrics;
+
+	/* Free blocks for futures and their waiters, see future.c */
+	struct dlpool    future_pool;
+	struct dlpool    waiter_pool;
+
 	/*
 	 * When graphing it's useful to store information about the currently
 	 * executing task in this threads worker struct. This eliminates
-	 * needless argument passing.
+	 * needless argument passing. current_node points into the frame of
+	 * dlworker_invoke() and is only filled while current_graph is set.
 	 */
 #ifdef DEADLOCK_GRAPH_EXPORT
-	struct dlgraph_node current_node;
-	struct dlgraph *current_graph;
-	unsigned long   invoked_task_id;
+	struct dlgraph_node *current_node;
+	struct dlgraph      *current_graph;
+#endif
+
+	/* Stamp of the outermost task executing, read by the watchdog */
+#ifdef DEADLOCK_WATCHDOG
+	struct dlwatch watch;
+#endif
+
+	/* Ring of this worker's most recent scheduler events */
+#ifdef DEADLOCK_FLIGHT_RECORDER
+	struct dlrecorder recorder;
+#endif
+
+	/*
+	 * The fiber currently running on this worker, if any, and a pool of
+	 * free fibers.
+	 */
+#ifdef DEADLOCK_FIBERS
+	struct dlfiber *fiber;
+	struct dlfiber *fiber_pool;
+	unsigned int    fiber_pool_count;
 #endif
 };
 
 void dlworker_async  (struct dlworker *, dltask *);
+void dlworker_asyncn (struct dlworker *, dltask *first, size_t n,
+                      size_t stride);
+void dlworker_asyncv (struct dlworker *, dltask *const *tasks, size_t n);
 void dlworker_destroy(struct dlworker *);
 void dlworker_join   (struct dlworker *);
 int  dlworker_init   (struct dlworker *, struct dlsched *, dltask *,
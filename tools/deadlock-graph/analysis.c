@@ -0,0 +1,311 @@
+#include "analysis.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Dependencies are gathered as head, tail and offset, the time into head
+ * after which tail may start, then bucketed by head so that each node's
+ * dependents are contiguous.
+ */
+struct analysis_dep {
+	size_t   head;
+	size_t   tail;
+	uint64_t offset_ns;
+};
+
+/*
+ * Nodes are found by task through an open addressing hash table of node
+ * indices, at most half full, which is several times faster than a binary
+ * search once there are millions of nodes. A repeated task ID finds the
+ * first node with it.
+ */
+struct analysis_index {
+	size_t *slots;
+	size_t  mask;
+};
+
+static size_t
+analysis_hash(uint64_t task, size_t mask)
+{
+	return (size_t)((task * 0x9E3779B97F4A7C15ull) >> 17) & mask;
+}
+
+static int
+analysis_index_init(struct analysis_index *index, const struct analysis *a)
+{
+	size_t size = 16;
+	while (size < a->nnodes * 2)
+		size *= 2;
+	index->mask = size - 1;
+	index->slots = malloc(size * sizeof(*index->slots));
+	if (!index->slots)
+		return ENOMEM;
+	for (size_t s = 0; s < size; ++ s)
+		index->slots[s] = ANALYSIS_NONE;
+	for (size_t i = 0; i < a->nnodes; ++ i) {
+		size_t s = analysis_hash(a->nodes[i].task, index->mask);
+		while (index->slots[s] != ANALYSIS_NONE) {
+			if (a->nodes[index->slots[s]].task == a->nodes[i].task)
+				break;
+			s = (s + 1) & index->mask;
+		}
+		if (index->slots[s] == ANALYSIS_NONE)
+			index->slots[s] = i;
+	}
+	return 0;
+}
+
+static size_t
+analysis_find(const struct analysis *a, const struct analysis_index *index,
+              uint64_t task)
+{
+	size_t s = analysis_hash(task, index->mask);
+	for (; index->slots[s] != ANALYSIS_NONE; s = (s + 1) & index->mask) {
+		if (a->nodes[index->slots[s]].task == task)
+			return index->slots[s];
+	}
+	return ANALYSIS_NONE;
+}
+
+/*
+ * analysis_gather() copies every worker's nodes.
+ */
+static int
+analysis_gather(struct analysis *a)
+{
+	const struct dlgraphfile_header *h = dlgraphfile_header(a->g);
+	size_t n = 0, count;
+	for (uint32_t w = 0; w < h->nworkers; ++ w) {
+		dlgraphfile_nodes(a->g, w, &count);
+		n += count;
+	}
+	a->nodes = malloc((n ? n : 1) * sizeof(*a->nodes));
+	if (!a->nodes)
+		return ENOMEM;
+
+	a->begin_ns = n ? UINT64_MAX : 0;
+	for (uint32_t w = 0; w < h->nworkers; ++ w) {
+		const struct dlgraphfile_node *nodes = dlgraphfile_nodes(a->g, w, &count);
+		for (size_t i = 0; i < count; ++ i) {
+			struct analysis_node *an = a->nodes + a->nnodes ++;
+			*an = (struct analysis_node) {
+				.task = nodes[i].task,
+				.begin_ns = nodes[i].begin_ns,
+				.end_ns = nodes[i].begin_ns + nodes[i].duration_ns,
+				.pred = ANALYSIS_NONE,
+				.worker = w,
+				.desc = nodes[i].desc,
+				.label = nodes[i].label
+			};
+			a->work_ns += nodes[i].duration_ns;
+			if (an->begin_ns < a->begin_ns) a->begin_ns = an->begin_ns;
+			if (an->end_ns > a->end_ns)     a->end_ns = an->end_ns;
+		}
+	}
+	return 0;
+}
+
+/*
+ * analysis_resolve() resolves one dependency, storing it in deps unless
+ * either end has no node. Edges carry the time they were added, which is
+ * clamped to their head; continuations depend on the whole head.
+ */
+static void
+analysis_resolve(struct analysis *a, const struct analysis_index *index,
+                 struct analysis_dep *deps, uint64_t head, uint64_t tail,
+                 const uint64_t *ts_ns)
+{
+	size_t h = analysis_find(a, index, head);
+	size_t t = analysis_find(a, index, tail);
+	if (h == ANALYSIS_NONE || t == ANALYSIS_NONE || h == t) {
+		++ a->unresolved;
+		return;
+	}
+	const struct analysis_node *hn = a->nodes + h;
+	uint64_t offset = hn->end_ns - hn->begin_ns;
+	if (ts_ns && *ts_ns < hn->end_ns)
+		offset = *ts_ns > hn->begin_ns ? *ts_ns - hn->begin_ns : 0;
+	deps[a->ndeps ++] = (struct analysis_dep) {
+		.head = h,
+		.tail = t,
+		.offset_ns = offset
+	};
+}
+
+/*
+ * analysis_order() visits nodes in topological order, by Kahn's algorithm,
+ * computing start_ns along the longest path to each node and ready_ns from
+ * the actual times of its dependencies.
+ */
+static int
+analysis_order(struct analysis *a, const struct analysis_dep *deps,
+               const size_t *first)
+{
+	size_t n = a->nnodes;
+	size_t *indegree = calloc(n ? n : 1, sizeof(*indegree));
+	size_t *queue = malloc((n ? n : 1) * sizeof(*queue));
+	if (!indegree || !queue) {
+		free(indegree);
+		free(queue);
+		return ENOMEM;
+	}
+	for (size_t d = 0; d < a->ndeps; ++ d)
+		++ indegree[deps[d].tail];
+
+	size_t head = 0, tail = 0;
+	for (size_t i = 0; i < n; ++ i) {
+		if (!indegree[i])
+			queue[tail ++] = i;
+		/* Nodes without dependencies were ready when they began */
+		a->nodes[i].ready_ns = indegree[i] ? 0 : a->nodes[i].begin_ns;
+	}
+
+	uint64_t span = 0;
+	a->critical = ANALYSIS_NONE;
+	while (head < tail) {
+		size_t u = queue[head ++];
+		struct analysis_node *un = a->nodes + u;
+		uint64_t finish = un->start_ns + (un->end_ns - un->begin_ns);
+		if (finish >= span) {
+			span = finish;
+			a->critical = u;
+		}
+		for (size_t d = first[u]; d < first[u + 1]; ++ d) {
+			struct analysis_node *vn = a->nodes + deps[d].tail;
+			uint64_t start = un->start_ns + deps[d].offset_ns;
+			if (vn->pred == ANALYSIS_NONE || start > vn->start_ns) {
+				vn->start_ns = start;
+				vn->pred = u;
+				vn->pred_ns = deps[d].offset_ns;
+			}
+			uint64_t ready = un->begin_ns + deps[d].offset_ns;
+			if (ready > vn->ready_ns)
+				vn->ready_ns = ready;
+			if (-- indegree[deps[d].tail] == 0)
+				queue[tail ++] = deps[d].tail;
+		}
+	}
+	a->span_ns = span;
+	a->unordered = n - tail;
+
+	/* Dependencies are recorded a little after they are satisfied */
+	for (size_t i = 0; i < n; ++ i) {
+		if (a->nodes[i].ready_ns > a->nodes[i].begin_ns)
+			a->nodes[i].ready_ns = a->nodes[i].begin_ns;
+	}
+
+	free(indegree);
+	free(queue);
+	return 0;
+}
+
+int
+analysis_init(struct analysis *a, dlgraphfile *g)
+{
+	memset(a, 0, sizeof *a);
+	a->g = g;
+	a->critical = ANALYSIS_NONE;
+	int result = analysis_gather(a);
+	if (result)
+		return result;
+
+	const struct dlgraphfile_header *h = dlgraphfile_header(g);
+	size_t max_deps = 0, count;
+	for (uint32_t w = 0; w < h->nworkers; ++ w) {
+		dlgraphfile_edges(g, w, &count);
+		max_deps += count;
+		dlgraphfile_continuations(g, w, &count);
+		max_deps += count;
+	}
+
+	struct analysis_index index = { NULL, 0 };
+	struct analysis_dep *deps = malloc((max_deps ? max_deps : 1) * sizeof(*deps));
+	struct analysis_dep *sorted = NULL;
+	size_t *first = NULL;
+	if (!deps || analysis_index_init(&index, a))
+		goto nomem;
+	for (uint32_t w = 0; w < h->nworkers; ++ w) {
+		const struct dlgraphfile_edge *e = dlgraphfile_edges(g, w, &count);
+		for (size_t i = 0; i < count; ++ i)
+			analysis_resolve(a, &index, deps, e[i].head, e[i].tail, &e[i].ts_ns);
+		const struct dlgraphfile_continuation *c = dlgraphfile_continuations(g, w, &count);
+		for (size_t i = 0; i < count; ++ i)
+			analysis_resolve(a, &index, deps, c[i].head, c[i].tail, NULL);
+	}
+	free(index.slots);
+	index.slots = NULL;
+
+	/* Counting sort by head, first[u] is the first dependency of u */
+	sorted = malloc((a->ndeps ? a->ndeps : 1) * sizeof(*sorted));
+	first = calloc(a->nnodes + 1, sizeof(*first));
+	if (!sorted || !first)
+		goto nomem;
+	for (size_t d = 0; d < a->ndeps; ++ d)
+		++ first[deps[d].head + 1];
+	for (size_t i = 0; i < a->nnodes; ++ i)
+		first[i + 1] += first[i];
+	for (size_t d = 0; d < a->ndeps; ++ d)
+		sorted[first[deps[d].head] ++] = deps[d];
+	for (size_t i = a->nnodes; i > 0; -- i)
+		first[i] = first[i - 1];
+	first[0] = 0;
+	free(deps);
+	deps = NULL;
+
+	result = analysis_order(a, sorted, first);
+	free(sorted);
+	free(first);
+	if (result)
+		analysis_destroy(a);
+	return result;
+
+nomem:
+	free(index.slots);
+	free(deps);
+	free(sorted);
+	free(first);
+	analysis_destroy(a);
+	return ENOMEM;
+}
+
+void
+analysis_destroy(struct analysis *a)
+{
+	free(a->nodes);
+	a->nodes = NULL;
+	a->nnodes = 0;
+}
+
+const char *
+analysis_func(const struct analysis *a, uint32_t desc)
+{
+	const struct dlgraphfile_desc *d = dlgraphfile_desc(a->g, desc);
+	const char *s = d ? dlgraphfile_string(a->g, d->func) : NULL;
+	return s ? s : "?";
+}
+
+const char *
+analysis_file(const struct analysis *a, uint32_t desc)
+{
+	const struct dlgraphfile_desc *d = dlgraphfile_desc(a->g, desc);
+	const char *s = d ? dlgraphfile_string(a->g, d->file) : NULL;
+	return s ? s : "?";
+}
+
+unsigned
+analysis_line(const struct analysis *a, uint32_t desc)
+{
+	const struct dlgraphfile_desc *d = dlgraphfile_desc(a->g, desc);
+	return d ? (unsigned)d->line : 0;
+}
+
+const char *
+analysis_label(const struct analysis *a, const struct analysis_node *n)
+{
+	if (n->label == DLGRAPHFILE_NO_LABEL)
+		return NULL;
+	struct dlgraphfile_node node = { .label = n->label };
+	return dlgraphfile_label(a->g, n->worker, &node);
+}
@@ -0,0 +1,84 @@
+#ifndef DEADLOCK_GRAPH_ANALYSIS_H_
+#define DEADLOCK_GRAPH_ANALYSIS_H_
+
+#include "deadlock/graphfile.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * The analysis treats a graph as a DAG of nodes joined by dependencies.
+ * An edge from a node lets its tail start once the head reaches the edge's
+ * timestamp, e.g. a child detached partway through its parent, or a
+ * successor released when its last predecessor ends. A continuation lets
+ * its tail start once the head ends.
+ *
+ * struct analysis_node is a node of any worker, extended with:
+ * start_ns, when the node would start with unlimited workers and no
+ * scheduling overhead, that is the longest path to it from any node without
+ * dependencies;
+ * ready_ns, when its dependencies were actually satisfied during the run,
+ * or begin_ns if it has none;
+ * pred, the dependency which determined start_ns, or ANALYSIS_NONE; and
+ * pred_ns, how far into pred its dependency was satisfied.
+ * Times are relative to the graph's base.
+ *
+ * struct analysis holds the nodes of every worker, and:
+ * work_ns, the sum of every node's duration;
+ * span_ns, the length of the critical path, the longest chain of
+ * dependencies, which bounds the run time with unlimited workers;
+ * critical, the last node of the critical path;
+ * begin_ns and end_ns, the extent of the run;
+ * ndeps, the dependencies joining two nodes, and unresolved, those naming a
+ * task with no node, e.g. dropped over budget;
+ * unordered, the nodes which could not be ordered because task IDs repeat
+ * and form a cycle. Their start_ns is not meaningful.
+ *
+ * analysis_init() analyses a graph. Zero is returned on success, otherwise
+ * ENOMEM.
+ *
+ * analysis_destroy() frees an analysis.
+ *
+ * analysis_func(), analysis_file() and analysis_line() return the function
+ * and source location of a description, or ? and zero if it is unknown.
+ *
+ * analysis_label() returns a node's label or NULL if it has none.
+ */
+#define ANALYSIS_NONE SIZE_MAX
+
+struct analysis_node {
+	uint64_t task;
+	uint64_t begin_ns;
+	uint64_t end_ns;
+	uint64_t start_ns;
+	uint64_t ready_ns;
+	uint64_t pred_ns;
+	size_t   pred;
+	uint32_t worker;
+	uint32_t desc;
+	uint32_t label;
+};
+
+struct analysis {
+	dlgraphfile          *g;
+	struct analysis_node *nodes;
+	size_t                nnodes;
+	uint64_t              work_ns;
+	uint64_t              span_ns;
+	size_t                critical;
+	uint64_t              begin_ns;
+	uint64_t              end_ns;
+	size_t                ndeps;
+	size_t                unresolved;
+	size_t                unordered;
+};
+
+int  analysis_init(struct analysis *, dlgraphfile *);
+void analysis_destroy(struct analysis *);
+
+const char *analysis_func(const struct analysis *, uint32_t desc);
+const char *analysis_file(const struct analysis *, uint32_t desc);
+unsigned    analysis_line(const struct analysis *, uint32_t desc);
+const char *analysis_label(const struct analysis *, const struct analysis_node *);
+
+#endif /* DEADLOCK_GRAPH_ANALYSIS_H_ */
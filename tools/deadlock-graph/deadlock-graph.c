@@ -0,0 +1,443 @@
+#include "deadlock/graphfile.h"
+#include "analysis.h"
+#include "trace.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * deadlock-graph reads graphs written by Deadlock in the text, binary or
+ * stream formats, see deadlock/graphfile.h.
+ *
+ * Usage: deadlock-graph <command> <graph> [<output>]
+ * where command is one of:
+ * 	summary: total work, span, available and achieved parallelism.
+ * 	critical: the critical path, the chain of tasks bounding the run time
+ * 	          however many workers run it, first to last.
+ * 	profile: time spent in each task description, busiest first, and how
+ * 	         much of it lies on the critical path.
+ * 	parallelism: tasks running and tasks ready to run over time.
+ * 	trace: writes Chrome Trace Event JSON, for chrome://tracing or
+ * 	       Perfetto.
+ * Output is written to output or to stdout.
+ *
+ * Tasks on the critical path are worth splitting, since nothing else can
+ * shorten the run once workers are plentiful. Descriptions whose tasks are
+ * many and short compared to the cost of scheduling them are worth fusing.
+ */
+
+static int summary    (dlgraphfile *, FILE *out);
+static int critical   (dlgraphfile *, FILE *out);
+static int profile    (dlgraphfile *, FILE *out);
+static int parallelism(dlgraphfile *, FILE *out);
+static int trace      (dlgraphfile *, FILE *out);
+
+static const struct command {
+	const char *name;
+	int       (*run)(dlgraphfile *, FILE *out);
+	const char *help;
+} commands[] = {
+	{ "summary",     summary,     "Work, span and parallelism" },
+	{ "critical",    critical,    "Critical path" },
+	{ "profile",     profile,     "Time per task description" },
+	{ "parallelism", parallelism, "Running and ready tasks over time" },
+	{ "trace",       trace,       "Chrome Trace Event JSON" }
+};
+#define NCOMMANDS (sizeof commands / sizeof *commands)
+
+static void
+usage(void)
+{
+	fprintf(stderr, "Usage: deadlock-graph <command> <graph> [<output>]\n"
+	                "Commands:\n");
+	for (size_t i = 0; i < NCOMMANDS; ++ i)
+		fprintf(stderr, "\t%-12s %s\n", commands[i].name, commands[i].help);
+}
+
+int
+main(int argc, char **argv)
+{
+	if (argc < 3 || argc > 4) {
+		usage();
+		return EXIT_FAILURE;
+	}
+	const struct command *command = NULL;
+	for (size_t i = 0; i < NCOMMANDS; ++ i) {
+		if (strcmp(argv[1], commands[i].name) == 0)
+			command = commands + i;
+	}
+	if (!command) {
+		fprintf(stderr, "Unknown command %s\n", argv[1]);
+		usage();
+		return EXIT_FAILURE;
+	}
+
+	dlgraphfile *g;
+	if (dlgraphfile_open(&g, argv[2])) {
+		perror("Error opening graph");
+		return EXIT_FAILURE;
+	}
+	FILE *out = argc == 4 ? fopen(argv[3], "wb") : stdout;
+	if (!out) {
+		perror("Error opening output");
+		dlgraphfile_close(g);
+		return EXIT_FAILURE;
+	}
+
+	int result = command->run(g, out);
+	if (result)
+		perror("Error writing output");
+	if (out != stdout && fclose(out) != 0 && !result) {
+		perror("Error writing output");
+		result = errno;
+	}
+	dlgraphfile_close(g);
+	return result ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/*
+ * duration() formats nanoseconds in the largest unit below them, to four
+ * significant digits or so.
+ */
+static const char *
+duration(char buf[32], uint64_t ns)
+{
+	static const struct { const char *unit; uint64_t ns; } units[] = {
+		{ "s", 1000000000 }, { "ms", 1000000 }, { "us", 1000 }
+	};
+	for (size_t i = 0; i < sizeof units / sizeof *units; ++ i) {
+		if (ns >= units[i].ns) {
+			snprintf(buf, 32, "%.3f%s", (double)ns / (double)units[i].ns,
+			         units[i].unit);
+			return buf;
+		}
+	}
+	snprintf(buf, 32, "%lluns", (unsigned long long)ns);
+	return buf;
+}
+
+/*
+ * task_id() formats a task ID as the worker which created it, counting from
+ * one, and its sequence number on that worker, e.g. 3:1042.
+ */
+static const char *
+task_id(char buf[48], const struct analysis *a, uint64_t task)
+{
+	uint64_t seq;
+	uint32_t worker = dlgraphfile_task_worker(a->g, task, &seq);
+	snprintf(buf, 48, "%u:%llu", (unsigned)worker, (unsigned long long)seq);
+	return buf;
+}
+
+/*
+ * open_analysis() analyses g, setting errno on failure.
+ */
+static int
+open_analysis(struct analysis *a, dlgraphfile *g)
+{
+	int result = analysis_init(a, g);
+	if (result) errno = result;
+	return result;
+}
+
+static int
+finish(FILE *out)
+{
+	if (ferror(out))
+		return errno ? errno : (errno = EIO);
+	return 0;
+}
+
+/*
+ * critical_path() stores the nodes of the critical path in path, last
+ * first, and returns their count. path must hold every node.
+ */
+static size_t
+critical_path(const struct analysis *a, size_t *path)
+{
+	size_t n = 0;
+	for (size_t i = a->critical; i != ANALYSIS_NONE; i = a->nodes[i].pred)
+		path[n ++] = i;
+	return n;
+}
+
+static int
+summary(dlgraphfile *g, FILE *out)
+{
+	struct analysis a;
+	if (open_analysis(&a, g))
+		return errno;
+	size_t *path = malloc((a.nnodes ? a.nnodes : 1) * sizeof(*path));
+	if (!path) {
+		analysis_destroy(&a);
+		return errno = ENOMEM;
+	}
+	size_t npath = critical_path(&a, path);
+	free(path);
+
+	char buf[32];
+	uint64_t run = a.end_ns - a.begin_ns;
+	fprintf(out, "nodes          %zu\n", a.nnodes);
+	fprintf(out, "dependencies   %zu (%zu unresolved)\n", a.ndeps, a.unresolved);
+	fprintf(out, "workers        %u\n", (unsigned)dlgraphfile_header(g)->nworkers);
+	fprintf(out, "run time       %s\n", duration(buf, run));
+	fprintf(out, "work           %s\n", duration(buf, a.work_ns));
+	fprintf(out, "span           %s\n", duration(buf, a.span_ns));
+	fprintf(out, "parallelism    %.2f (work / span)\n",
+	        a.span_ns ? (double)a.work_ns / (double)a.span_ns : 0.0);
+	fprintf(out, "achieved       %.2f (work / run time)\n",
+	        run ? (double)a.work_ns / (double)run : 0.0);
+	fprintf(out, "critical path  %zu nodes\n", npath);
+	uint64_t parent = dlgraphfile_header(g)->parent_id;
+	if (parent != DLGRAPHFILE_NO_PARENT)
+		fprintf(out, "nested within  graph %llu\n", (unsigned long long)parent);
+	if (a.unordered) {
+		fprintf(out, "warning: %zu nodes with repeated task IDs could "
+		             "not be ordered and were left out of the span\n",
+		        a.unordered);
+	}
+	analysis_destroy(&a);
+	return finish(out);
+}
+
+static int
+critical(dlgraphfile *g, FILE *out)
+{
+	struct analysis a;
+	if (open_analysis(&a, g))
+		return errno;
+	size_t *path = malloc((a.nnodes ? a.nnodes : 1) * sizeof(*path));
+	if (!path) {
+		analysis_destroy(&a);
+		return errno = ENOMEM;
+	}
+	size_t npath = critical_path(&a, path);
+
+	/*
+	 * A node only lies on the path up to the point its successor was
+	 * released, e.g. a parent detaching a child halfway through.
+	 */
+	char on[32], dur[32], begin[32], task[48];
+	fprintf(out, "%10s %10s %12s %6s %20s  %s\n",
+	        "on path", "duration", "begin", "worker", "task", "function (source) label");
+	for (size_t i = npath; i > 0; -- i) {
+		const struct analysis_node *n = a.nodes + path[i - 1];
+		uint64_t on_path = i > 1 ? a.nodes[path[i - 2]].pred_ns
+		                         : n->end_ns - n->begin_ns;
+		const char *label = analysis_label(&a, n);
+		fprintf(out, "%10s %10s %12s %6u %20s  %s (%s:%u)%s%s\n",
+		        duration(on, on_path), duration(dur, n->end_ns - n->begin_ns),
+		        duration(begin, n->begin_ns), (unsigned)n->worker,
+		        task_id(task, &a, n->task), analysis_func(&a, n->desc),
+		        analysis_file(&a, n->desc), analysis_line(&a, n->desc),
+		        label ? " " : "", label ? label : "");
+	}
+	free(path);
+	analysis_destroy(&a);
+	return finish(out);
+}
+
+struct profile_entry {
+	uint32_t desc;
+	uint64_t count;
+	uint64_t total_ns;
+	uint64_t min_ns;
+	uint64_t max_ns;
+	uint64_t critical_ns;
+};
+
+static int
+profile_cmp(const void *xa, const void *xb)
+{
+	const struct profile_entry *a = xa, *b = xb;
+	return (a->total_ns < b->total_ns) - (a->total_ns > b->total_ns);
+}
+
+static int
+profile(dlgraphfile *g, FILE *out)
+{
+	struct analysis a;
+	if (open_analysis(&a, g))
+		return errno;
+
+	/* Descriptions unknown to the file still get their own entry */
+	size_t n = dlgraphfile_header(g)->ndescs;
+	for (size_t i = 0; i < a.nnodes; ++ i)
+		if (a.nodes[i].desc >= n) n = (size_t)a.nodes[i].desc + 1;
+	struct profile_entry *entries = calloc(n ? n : 1, sizeof(*entries));
+	size_t *path = malloc((a.nnodes ? a.nnodes : 1) * sizeof(*path));
+	if (!entries || !path) {
+		free(entries);
+		free(path);
+		analysis_destroy(&a);
+		return errno = ENOMEM;
+	}
+	for (size_t d = 0; d < n; ++ d) {
+		entries[d].desc = (uint32_t)d;
+		entries[d].min_ns = UINT64_MAX;
+	}
+	for (size_t i = 0; i < a.nnodes; ++ i) {
+		struct profile_entry *e = entries + a.nodes[i].desc;
+		uint64_t d = a.nodes[i].end_ns - a.nodes[i].begin_ns;
+		++ e->count;
+		e->total_ns += d;
+		if (d < e->min_ns) e->min_ns = d;
+		if (d > e->max_ns) e->max_ns = d;
+	}
+	size_t npath = critical_path(&a, path);
+	for (size_t i = npath; i > 0; -- i) {
+		const struct analysis_node *node = a.nodes + path[i - 1];
+		entries[node->desc].critical_ns += i > 1 ? a.nodes[path[i - 2]].pred_ns
+		                                         : node->end_ns - node->begin_ns;
+	}
+	free(path);
+	qsort(entries, n, sizeof(*entries), profile_cmp);
+
+	char total[32], mean[32], min[32], max[32], crit[32];
+	fprintf(out, "%10s %6s %10s %10s %10s %10s %10s  %s\n", "total", "work",
+	        "count", "mean", "min", "max", "critical", "function (source)");
+	for (size_t d = 0; d < n && entries[d].count; ++ d) {
+		struct profile_entry *e = entries + d;
+		fprintf(out, "%10s %5.1f%% %10llu %10s %10s %10s %10s  %s (%s:%u)\n",
+		        duration(total, e->total_ns),
+		        a.work_ns ? 100.0 * (double)e->total_ns / (double)a.work_ns : 0.0,
+		        (unsigned long long)e->count,
+		        duration(mean, e->total_ns / e->count),
+		        duration(min, e->min_ns), duration(max, e->max_ns),
+		        duration(crit, e->critical_ns), analysis_func(&a, e->desc),
+		        analysis_file(&a, e->desc), analysis_line(&a, e->desc));
+	}
+	free(entries);
+	analysis_destroy(&a);
+	return finish(out);
+}
+
+/*
+ * spread() adds the overlap of [begin, end) with each bucket of width
+ * starting at zero to acc.
+ */
+static void
+spread(uint64_t *acc, size_t nbuckets, uint64_t width,
+       uint64_t begin, uint64_t end)
+{
+	if (end <= begin)
+		return;
+	size_t last = (size_t)((end - 1) / width);
+	if (last >= nbuckets) last = nbuckets - 1;
+	for (size_t b = (size_t)(begin / width); b <= last; ++ b) {
+		uint64_t lo = b * width, hi = lo + width;
+		acc[b] += (end < hi ? end : hi) - (begin > lo ? begin : lo);
+	}
+}
+
+#define PARALLELISM_BUCKETS 40
+#define PARALLELISM_BAR     50
+
+static int
+parallelism(dlgraphfile *g, FILE *out)
+{
+	struct analysis a;
+	if (open_analysis(&a, g))
+		return errno;
+
+	/*
+	 * A task is ready from when its dependencies were satisfied until it
+	 * ends, and running from when it began. Ready tasks beyond those
+	 * running were waiting for a worker; too few ready tasks to keep every
+	 * worker busy means the graph lacks parallelism at that moment.
+	 */
+	uint64_t running[PARALLELISM_BUCKETS] = { 0 };
+	uint64_t ready[PARALLELISM_BUCKETS] = { 0 };
+	uint64_t run = a.end_ns - a.begin_ns;
+	uint64_t width = run / PARALLELISM_BUCKETS + 1;
+	for (size_t i = 0; i < a.nnodes; ++ i) {
+		const struct analysis_node *n = a.nodes + i;
+		spread(running, PARALLELISM_BUCKETS, width,
+		       n->begin_ns - a.begin_ns, n->end_ns - a.begin_ns);
+		spread(ready, PARALLELISM_BUCKETS, width,
+		       n->ready_ns - a.begin_ns, n->end_ns - a.begin_ns);
+	}
+
+	double scale = dlgraphfile_header(g)->nworkers;
+	for (size_t b = 0; b < PARALLELISM_BUCKETS; ++ b)
+		if ((double)ready[b] / (double)width > scale)
+			scale = (double)ready[b] / (double)width;
+
+	char begin[32];
+	fprintf(out, "%12s %8s %8s  # running, - ready, | %u workers\n",
+	        "begin", "running", "ready", (unsigned)dlgraphfile_header(g)->nworkers);
+	for (size_t b = 0; b < PARALLELISM_BUCKETS && b * width < run; ++ b) {
+		double r = (double)running[b] / (double)width;
+		double q = (double)ready[b] / (double)width;
+		char bar[PARALLELISM_BAR + 1];
+		int nr = (int)(r / scale * PARALLELISM_BAR + 0.5);
+		int nq = (int)(q / scale * PARALLELISM_BAR + 0.5);
+		int nw = (int)(dlgraphfile_header(g)->nworkers / scale * PARALLELISM_BAR + 0.5);
+		for (int c = 0; c < PARALLELISM_BAR; ++ c)
+			bar[c] = c < nr ? '#' : c < nq ? '-' : c == nw ? '|' : ' ';
+		bar[PARALLELISM_BAR] = '\0';
+		fprintf(out, "%12s %8.2f %8.2f  %s\n", duration(begin, b * width),
+		        r, q, bar);
+	}
+	analysis_destroy(&a);
+	return finish(out);
+}
+
+/*
+ * graph_segment() and graph_label() expose a dlgraphfile as a
+ * dltrace_source; each worker's records of a kind are one segment.
+ */
+static const void *
+graph_segment(void *ctx, uint32_t worker, unsigned kind,
+              const void **cursor, size_t *size)
+{
+	dlgraphfile *g = ctx;
+	const void *records = NULL;
+	size_t count = 0, stride = 0;
+	if (*cursor)
+		return NULL;
+	switch (kind) {
+	case DLGRAPHFILE_CHUNK_NODES:
+		records = dlgraphfile_nodes(g, worker, &count);
+		stride = sizeof(struct dlgraphfile_node);
+		break;
+	case DLGRAPHFILE_CHUNK_EDGES:
+		records = dlgraphfile_edges(g, worker, &count);
+		stride = sizeof(struct dlgraphfile_edge);
+		break;
+	case DLGRAPHFILE_CHUNK_CONTINUATIONS:
+		records = dlgraphfile_continuations(g, worker, &count);
+		stride = sizeof(struct dlgraphfile_continuation);
+		break;
+	}
+	if (!count)
+		return NULL;
+	*cursor = records;
+	*size = count * stride;
+	return records;
+}
+
+static const char *
+graph_label(void *ctx, uint32_t worker, uint32_t offset)
+{
+	struct dlgraphfile_node n = { .label = offset };
+	return dlgraphfile_label(ctx, worker, &n);
+}
+
+static int
+trace(dlgraphfile *g, FILE *out)
+{
+	const struct dlgraphfile_header *h = dlgraphfile_header(g);
+	struct dltrace_source src = {
+		.ctx = g,
+		.nworkers = h->nworkers,
+		.ndescs = h->ndescs,
+		.descs = dlgraphfile_desc(g, 0),
+		.strings = dlgraphfile_string(g, 0),
+		.strings_size = h->strings_size,
+		.segment = graph_segment,
+		.label = graph_label
+	};
+	return dltrace_write(out, &src);
+}
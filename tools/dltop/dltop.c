@@ -0,0 +1,255 @@
+#include "deadlock/metrics.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * dltop watches the live metrics a running scheduler publishes to shared
+ * memory, see deadlock/metrics.h, like top. It maps them read only, so it
+ * never disturbs the scheduler beyond the cache misses of its reads.
+ *
+ * Usage: dltop [-i <interval ms>] [-n <count>] <name>
+ * Every interval, by default a second, the state and queue depth of each
+ * worker are printed with the tasks it executed, steals it made and
+ * attempted per second, and the share of the interval it spent parked.
+ * dltop exits after count intervals, or runs until interrupted. If the
+ * scheduler is not running yet, or exits, dltop waits for one to publish
+ * to name again.
+ */
+
+struct metrics {
+	const struct dlmetrics_header *header;
+	size_t                         size;
+};
+
+static const char *states[] = { "idle", "busy", "parked", "exited" };
+
+static void
+usage(void)
+{
+	fprintf(stderr, "Usage: dltop [-i <interval ms>] [-n <count>] <name>\n");
+}
+
+static const struct dlmetrics_worker *
+worker(struct metrics *m, uint32_t w)
+{
+	/* Later versions may append members to each worker */
+	return (const struct dlmetrics_worker *)
+	       ((const char *)(m->header + 1) + (size_t)m->header->worker_size * w);
+}
+
+/*
+ * attach() maps the metrics published to name. Zero is returned on success,
+ * otherwise errno is set and:
+ * ENOENT shall be returned if nothing is published to name;
+ * EPROTO shall be returned if what is published is not metrics dltop reads,
+ * or any error from shm_open(), fstat() or mmap().
+ */
+static int
+attach(struct metrics *m, const char *name)
+{
+	int fd = shm_open(name, O_RDONLY, 0);
+	if (fd < 0)
+		return errno;
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		int result = errno;
+		close(fd);
+		return errno = result;
+	}
+	m->size = (size_t)st.st_size;
+	if (m->size < sizeof(struct dlmetrics_header)) {
+		/* Still being created */
+		close(fd);
+		return errno = ENOENT;
+	}
+	void *p = mmap(NULL, m->size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (p == MAP_FAILED)
+		return errno;
+	m->header = p;
+
+	const volatile struct dlmetrics_header *h = m->header;
+	int result = 0;
+	if (h->magic != DLMETRICS_MAGIC)
+		result = ENOENT;
+	else if (h->version < DLMETRICS_VERSION ||
+	         h->worker_size < sizeof(struct dlmetrics_worker) ||
+	         m->size < sizeof(*h) + (size_t)h->worker_size * h->nworkers)
+		result = EPROTO;
+	if (result) {
+		munmap(p, m->size);
+		m->header = NULL;
+		return errno = result;
+	}
+	return 0;
+}
+
+static void
+detach(struct metrics *m)
+{
+	munmap((void *)m->header, m->size);
+	m->header = NULL;
+}
+
+static void
+snapshot(struct metrics *m, struct dlmetrics_worker *dst)
+{
+	for (uint32_t w = 0; w < m->header->nworkers; ++ w) {
+		const volatile struct dlmetrics_worker *src = worker(m, w);
+		dst[w] = (struct dlmetrics_worker) {
+			.state          = src->state,
+			.queued         = src->queued,
+			.executed       = src->executed,
+			.steal_attempts = src->steal_attempts,
+			.steals         = src->steals,
+			.stalls         = src->stalls,
+			.parked_ns      = src->parked_ns
+		};
+	}
+}
+
+static void
+sleep_ms(unsigned long ms)
+{
+	struct timespec ts = {
+		.tv_sec = (time_t)(ms / 1000),
+		.tv_nsec = (long)(ms % 1000) * 1000000
+	};
+	while (nanosleep(&ts, &ts) != 0 && errno == EINTR) ;
+}
+
+static double
+now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static double
+rate(uint64_t before, uint64_t after, double seconds)
+{
+	return after >= before ? (double)(after - before) / seconds : 0;
+}
+
+static void
+render(const char *name, struct metrics *m, struct dlmetrics_worker *before,
+       struct dlmetrics_worker *after, double seconds, int clear)
+{
+	const volatile struct dlmetrics_header *h = m->header;
+	if (clear)
+		fputs("\033[H\033[2J", stdout);
+	printf("%s: pid %llu, %u workers, %s\n", name,
+	       (unsigned long long)h->pid, (unsigned)h->nworkers,
+	       h->running ? "running" : "exited");
+	printf("%6s %-7s %8s %12s %10s %10s %7s\n", "worker", "state",
+	       "queued", "tasks/s", "steals/s", "tries/s", "parked");
+
+	uint64_t total_queued = 0;
+	double total_tasks = 0, total_steals = 0, total_tries = 0, total_parked = 0;
+	for (uint32_t w = 0; w < h->nworkers; ++ w) {
+		struct dlmetrics_worker *b = before + w, *a = after + w;
+		double tasks  = rate(b->executed, a->executed, seconds);
+		double steals = rate(b->steals, a->steals, seconds);
+		double tries  = rate(b->steal_attempts, a->steal_attempts, seconds);
+		double parked = rate(b->parked_ns, a->parked_ns, seconds) / 1e7;
+		/* A worker parked now has not yet counted this stall */
+		if (a->state == DLMETRICS_PARKED && a->parked_ns == b->parked_ns &&
+		    b->state == DLMETRICS_PARKED)
+			parked = 100;
+		const char *state = a->state < sizeof states / sizeof *states
+		                  ? states[a->state] : "?";
+		printf("%6u %-7s %8llu %12.0f %10.0f %10.0f %6.1f%%\n", (unsigned)w,
+		       state, (unsigned long long)a->queued, tasks, steals, tries,
+		       parked > 100 ? 100 : parked);
+		total_queued += a->queued;
+		total_tasks  += tasks;
+		total_steals += steals;
+		total_tries  += tries;
+		total_parked += parked > 100 ? 100 : parked;
+	}
+	printf("%6s %-7s %8llu %12.0f %10.0f %10.0f %6.1f%%\n", "total", "",
+	       (unsigned long long)total_queued, total_tasks, total_steals,
+	       total_tries, h->nworkers ? total_parked / h->nworkers : 0);
+	fflush(stdout);
+}
+
+int
+main(int argc, char **argv)
+{
+	unsigned long interval = 1000, count = 0;
+	const char *name = NULL;
+	for (int i = 1; i < argc; ++ i) {
+		char *end;
+		if ((!strcmp(argv[i], "-i") || !strcmp(argv[i], "-n")) && i + 1 < argc) {
+			unsigned long *value = argv[i][1] == 'i' ? &interval : &count;
+			*value = strtoul(argv[++ i], &end, 10);
+			if (*end || (value == &interval && !interval)) {
+				usage();
+				return EXIT_FAILURE;
+			}
+		} else if (!name && argv[i][0] != '-') {
+			name = argv[i];
+		} else {
+			usage();
+			return EXIT_FAILURE;
+		}
+	}
+	if (!name) {
+		usage();
+		return EXIT_FAILURE;
+	}
+
+	int clear = isatty(STDOUT_FILENO);
+	struct metrics m = { NULL, 0 };
+	struct dlmetrics_worker *before = NULL, *after = NULL;
+	int waiting = 0;
+	for (unsigned long n = 0; !count || n < count; ) {
+		if (!m.header) {
+			if (attach(&m, name)) {
+				if (errno != ENOENT) {
+					perror("Error reading metrics");
+					return EXIT_FAILURE;
+				}
+				if (!waiting)
+					fprintf(stderr, "Waiting for %s\n", name);
+				waiting = 1;
+				sleep_ms(interval);
+				continue;
+			}
+			waiting = 0;
+			size_t nw = m.header->nworkers ? m.header->nworkers : 1;
+			free(before);
+			free(after);
+			before = malloc(sizeof(*before) * nw);
+			after  = malloc(sizeof(*after) * nw);
+			if (!before || !after) {
+				perror("Error allocating metrics");
+				return EXIT_FAILURE;
+			}
+		}
+
+		double begin = now();
+		snapshot(&m, before);
+		sleep_ms(interval);
+		snapshot(&m, after);
+		render(name, &m, before, after, now() - begin, clear);
+		++ n;
+
+		/* Wait for the next scheduler to publish to name */
+		if (!*(const volatile uint32_t *)&m.header->running)
+			detach(&m);
+	}
+	if (m.header)
+		detach(&m);
+	free(before);
+	free(after);
+	return EXIT_SUCCESS;
+}